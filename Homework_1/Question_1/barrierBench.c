@@ -0,0 +1,163 @@
+/* barrier micro-benchmark using pthreads
+
+   features: measures the latency of one barrier episode for each algorithm
+             in common/barrier.h and 1, 2, 4, ..., maxWorkers threads. Each
+             thread calls barrier_wait episodes times in a row with no work
+             in between; the time per episode is the median over BENCH_RUNS
+             runs. Before timing, a short checked run verifies that no thread
+             leaves an episode before all threads have arrived.
+
+   usage under Linux:
+     gcc -O2 barrierBench.c -lpthread -o barrierBench
+     ./barrierBench [--barrier=condvar|central|tree|dissemination|tournament]
+                    [--episodes=N] [maxWorkers]
+
+   maxWorkers defaults to the number of online CPUs; without --barrier all
+   algorithms are measured. With more threads than CPUs the barriers do not
+   spin, so the numbers then mostly measure futex wake-up latency.
+
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "../../common/barrier.h"
+
+#define DEFAULT_EPISODES 100000 /* episodes per timed run */
+#define CHECK_EPISODES 1000     /* episodes of the checked run */
+#define BENCH_RUNS 5            /* timed runs per configuration, median is reported */
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+ThreadBarrier barrier;
+int numWorkers, episodes;
+bool check;              /* the checked run, not timed */
+atomic_long arrivals;    /* threads that arrived, over all episodes of the checked run */
+atomic_int failures;     /* threads that left an episode too early */
+
+void *Worker(void *);
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* run the workers once over the current barrier; returns the elapsed time */
+static double Run(pthread_t *workerid, pthread_attr_t *attr) {
+  long l;
+  double start = read_timer();
+  for (l = 0; l < numWorkers; l++)
+    pthread_create(&workerid[l], attr, Worker, (void *) l);
+  for (l = 0; l < numWorkers; l++)
+    pthread_join(workerid[l], NULL);
+  return read_timer() - start;
+}
+
+int main(int argc, char *argv[]) {
+  int i, k, run, maxWorkers = 0, timedEpisodes = DEFAULT_EPISODES;
+  int firstKind = 0, lastKind = BARRIER_KINDS - 1;
+  BarrierKind kind;
+  pthread_attr_t attr;
+  pthread_t *workerid;
+  double times[BENCH_RUNS];
+
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--barrier=", 10) == 0) {
+      if (!barrier_parse(argv[i] + 10, &kind)) {
+        fprintf(stderr, "Unknown barrier: %s\n", argv[i] + 10);
+        exit(1);
+      }
+      firstKind = lastKind = kind;
+    }
+    else if (strncmp(argv[i], "--episodes=", 11) == 0)
+      timedEpisodes = atoi(argv[i] + 11);
+    else
+      maxWorkers = atoi(argv[i]);
+  }
+  if (maxWorkers <= 0) maxWorkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (maxWorkers <= 0) maxWorkers = 1;
+  if (timedEpisodes <= 0) timedEpisodes = 1;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  workerid = malloc(maxWorkers * sizeof(pthread_t));
+
+  printf("Barrier episode latency (ns, median of %d runs of %d episodes)\n", BENCH_RUNS, timedEpisodes);
+  printf("%8s", "workers");
+  for (k = firstKind; k <= lastKind; k++)
+    printf(" %14s", barrier_kind_name((BarrierKind) k));
+  printf("\n");
+
+  for (numWorkers = 1; ; numWorkers *= 2) {
+    if (numWorkers > maxWorkers) numWorkers = maxWorkers; /* always end with maxWorkers */
+    printf("%8d", numWorkers);
+    for (k = firstKind; k <= lastKind; k++) {
+      barrier_init(&barrier, (BarrierKind) k, numWorkers);
+
+      check = true;
+      episodes = CHECK_EPISODES;
+      atomic_store(&arrivals, 0);
+      atomic_store(&failures, 0);
+      Run(workerid, &attr);
+      if (atomic_load(&failures) > 0) {
+        fprintf(stderr, "\n%s barrier failed with %d workers\n", barrier_kind_name((BarrierKind) k),
+                numWorkers);
+        exit(1);
+      }
+
+      check = false;
+      episodes = timedEpisodes;
+      for (run = 0; run < BENCH_RUNS; run++)
+        times[run] = Run(workerid, &attr);
+      qsort(times, BENCH_RUNS, sizeof(double), compare_doubles);
+      printf(" %14.0f", times[BENCH_RUNS/2] / episodes * 1e9);
+      fflush(stdout);
+
+      barrier_destroy(&barrier);
+    }
+    printf("\n");
+    if (numWorkers == maxWorkers) break;
+  }
+
+  pthread_attr_destroy(&attr);
+  free(workerid);
+  return 0;
+}
+
+/* Each worker passes the barrier episodes times. In the checked run, every
+   thread counts its arrival before an episode and checks after it that all
+   numWorkers arrivals of that episode are in. */
+void *Worker(void *arg) {
+  long myid = (long) arg;
+  int e;
+
+  for (e = 0; e < episodes; e++) {
+    if (check) {
+      atomic_fetch_add(&arrivals, 1);
+      barrier_wait(&barrier, myid);
+      if (atomic_load(&arrivals) < (long) numWorkers * (e + 1))
+        atomic_fetch_add(&failures, 1);
+      barrier_wait(&barrier, myid); /* nobody counts episode e+1 before all have checked e */
+    } else
+      barrier_wait(&barrier, myid);
+  }
+  return NULL;
+}
@@ -0,0 +1,194 @@
+/* binary matrix file generator for the matrixSum programs
+
+   features: writes a rows x cols matrix of random values between 0 and 99
+             in the format of common/matrix_file.h. Each worker generates its
+             strip of rows into a buffer and writes it at its own offset with
+             pwrite, so the file is written in parallel. Element (i, j) comes
+             from the same counter-based generator as the matrixSum programs,
+             so for a square matrix and the same --seed, reducing the file
+             gives the same results as reducing the generated matrix.
+             --type stores the elements as int8, uint8, int16, int32 (the
+             default), int64, float, or double (common/elem_type.h).
+             --nan=ROW,COL (float and double only, up to MAX_NANS times)
+             makes element (ROW, COL) a NaN, to check how the reducers
+             handle one, e.g. at the start of a row block.
+
+   usage under Linux:
+     gcc -O2 matrixGen.c -lpthread -o matrixGen
+     ./matrixGen [--seed=N] [--type=T] [--nan=ROW,COL ...] <file> <rows> <cols> <numWorkers>
+
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sys/time.h>
+#include "../../common/counter_rng.h"
+#include "../../common/matrix_file.h"
+
+#define BUFFER_BYTES (4 * 1024 * 1024) /* per-worker write buffer */
+#define MAX_NANS 64                    /* --nan options */
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+double start_time, end_time; /* start and end times */
+int fd;                      /* the output file */
+MatrixFileHeader header;
+long long rows, cols;
+int numWorkers;
+uint64_t seed;
+uint32_t elemType = MATRIX_ELEM_INT32;
+size_t elemSize;
+long long nanRow[MAX_NANS], nanCol[MAX_NANS]; /* elements made NaN */
+int numNans = 0;
+
+void *Worker(void *);
+
+int main(int argc, char *argv[]) {
+  int i;
+  long l; /* use long in case of a 64-bit system */
+  pthread_attr_t attr;
+  pthread_t *workerid;
+  char *args[4];
+  int numArgs = 0;
+  double mbytes;
+
+  seed = time(NULL);
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--type=", 7) == 0) {
+      if (!matrix_parse_elem(argv[i] + 7, &elemType)) {
+        fprintf(stderr, "Unknown element type: %s\n", argv[i] + 7);
+        exit(1);
+      }
+    }
+    else if (strncmp(argv[i], "--nan=", 6) == 0) {
+      if (numNans == MAX_NANS ||
+          sscanf(argv[i] + 6, "%lld,%lld", &nanRow[numNans], &nanCol[numNans]) != 2) {
+        fprintf(stderr, "Bad or too many --nan=ROW,COL (at most %d)\n", MAX_NANS);
+        exit(1);
+      }
+      numNans++;
+    }
+    else if (numArgs < 4)
+      args[numArgs++] = argv[i];
+  }
+  if (numArgs < 4) {
+    fprintf(stderr, "Usage: %s [--seed=N] [--type=T] [--nan=ROW,COL ...] <file> <rows> <cols> <numWorkers>\n",
+            argv[0]);
+    exit(1);
+  }
+  rows = atoll(args[1]);
+  cols = atoll(args[2]);
+  numWorkers = atoi(args[3]);
+  if (rows <= 0 || cols <= 0 || numWorkers <= 0) {
+    fprintf(stderr, "rows, cols, and numWorkers must be positive\n");
+    exit(1);
+  }
+  if (numWorkers > rows) numWorkers = rows;
+  if (numNans > 0 && !matrix_elem_is_float(elemType)) {
+    fprintf(stderr, "--nan needs float or double elements, not %s\n", matrix_elem_name(elemType));
+    exit(1);
+  }
+  for (i = 0; i < numNans; i++)
+    if (nanRow[i] < 0 || nanRow[i] >= rows || nanCol[i] < 0 || nanCol[i] >= cols) {
+      fprintf(stderr, "--nan=%lld,%lld is outside the matrix\n", nanRow[i], nanCol[i]);
+      exit(1);
+    }
+  elemSize = matrix_elem_size(elemType);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  workerid = malloc(numWorkers * sizeof(pthread_t));
+
+  start_time = read_timer();
+  fd = matrix_file_create(args[0], elemType, rows, cols, &header);
+  for (l = 0; l < numWorkers; l++)
+    pthread_create(&workerid[l], &attr, Worker, (void *) l);
+  for (l = 0; l < numWorkers; l++)
+    pthread_join(workerid[l], NULL);
+  if (close(fd) != 0) {
+    perror(args[0]);
+    exit(1);
+  }
+  end_time = read_timer();
+
+  mbytes = rows * cols * elemSize / 1e6;
+  printf("Wrote a %lldx%lld %s matrix to %s (seed %llu)\n", rows, cols, matrix_elem_name(elemType),
+         args[0], (unsigned long long) seed);
+  printf("The execution time is %g sec (%g MB/s)\n", end_time - start_time,
+         mbytes / (end_time - start_time));
+
+  pthread_attr_destroy(&attr);
+  free(workerid);
+  return 0;
+}
+
+/* Each worker generates one strip of rows, a buffer at a time, and writes
+   each buffer at its place in the file. */
+void *Worker(void *arg) {
+  long myid = (long) arg;
+  long long stripSize = rows / numWorkers;
+  long long first_row = myid * stripSize;
+  long long end_row = (myid == numWorkers - 1) ? rows : first_row + stripSize;
+  long long rowsPerBuffer = BUFFER_BYTES / (cols * elemSize);
+  long long i, j, r, n;
+  char *buffer;
+  size_t bytes;
+  off_t offset;
+
+  if (rowsPerBuffer < 1) rowsPerBuffer = 1;
+  buffer = malloc(rowsPerBuffer * cols * elemSize);
+  if (buffer == NULL) {
+    fprintf(stderr, "Out of memory for the write buffer\n");
+    exit(1);
+  }
+
+  for (r = first_row; r < end_row; r += n) {
+    n = (end_row - r < rowsPerBuffer) ? end_row - r : rowsPerBuffer;
+    for (i = 0; i < n; i++)
+      for (j = 0; j < cols; j++)
+        matrix_elem_store(buffer, i * cols + j, elemType,
+                          (int) counter_rng_below(seed, (uint64_t) (r + i) * cols + j, 100));
+    for (j = 0; j < numNans; j++)
+      if (nanRow[j] >= r && nanRow[j] < r + n) {
+        size_t idx = (nanRow[j] - r) * cols + nanCol[j];
+        if (elemType == MATRIX_ELEM_FLOAT) ((float *) buffer)[idx] = NAN;
+        else ((double *) buffer)[idx] = NAN;
+      }
+
+    bytes = n * cols * elemSize;
+    offset = header.dataOffset + r * cols * elemSize;
+    while (bytes > 0) { /* pwrite may write less than asked */
+      ssize_t written = pwrite(fd, buffer + (n * cols * elemSize - bytes), bytes, offset);
+      if (written <= 0) {
+        perror("pwrite");
+        exit(1);
+      }
+      bytes -= written;
+      offset += written;
+    }
+  }
+
+  free(buffer);
+  return NULL;
+}
@@ -0,0 +1,225 @@
+/* matrix multiplication using pthreads
+
+   features: C = A * B in double precision for A (M x K) and B (K x N), by
+             the cache-blocked kernel of common/gemm.h (packed A blocks and B
+             panels, a GEMM_MR x GEMM_NR register-tile micro-kernel) with the
+             workers splitting C two-dimensionally: a pr x pc grid of tiles,
+             chosen so the tiles are closest to square, which keeps skinny
+             shapes from handing each worker a sliver.
+             A and B are filled like the matrixSum matrices (0..99 from the
+             counter-based generator, seeds --seed and --seed + 1), so every
+             product is an exact integer in double precision and the blocked
+             result can be checked exactly against the naive one.
+             The naive version is the textbook triple loop (i, j, p), by strips
+             of rows of C over the same workers. Both are reported in GFLOP/s
+             (2*M*N*K flops). With --bench a table of square and skinny shapes
+             is timed.
+
+   usage under Linux:
+     gcc -O2 matrixMul.c -lpthread -o matrixMul
+     ./matrixMul [--kernel=auto|scalar|avx2] [--shape=M,N,K] [--seed=N] [--no-naive]
+                 [--bench] <size> <numWorkers>
+
+   options:
+     --shape=M,N,K  multiply M x K by K x N (default size x size by size x size)
+     --no-naive     skip the naive triple loop (and the check)
+     --bench        time the naive and blocked versions for the shapes
+                    n x n x n, n x n x 32, n x 32 x n, 32 x n x n, and
+                    n x 32 x 32 (M x N x K), n = size
+
+   numWorkers defaults to the number of online CPUs.
+
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np in matrix_alloc.h */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "../../common/matrix_alloc.h"
+#include "../../common/gemm.h"
+
+#define DEFAULTSIZE 2000 /* matrix size if not given */
+#define SKINNY 32        /* the short dimension of the skinny shapes in --bench */
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+int numWorkers;
+int M, N, K;                  /* the current shape */
+const double *A, *B;          /* M x K, K x N */
+double *C;                    /* M x N */
+bool naive;                   /* the current run is the naive one */
+int gridRows, gridCols;       /* the worker grid of the blocked version */
+
+void *Worker(void *);
+
+/* run the workers once over the current shape; returns the time */
+static double Multiply(bool useNaive) {
+  pthread_attr_t attr;
+  pthread_t *workerid = malloc(numWorkers * sizeof(pthread_t));
+  double start_time;
+  long l;
+
+  naive = useNaive;
+  gemm_grid(numWorkers, M, N, &gridRows, &gridCols);
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  start_time = read_timer();
+  for (l = 0; l < numWorkers; l++)
+    pthread_create(&workerid[l], &attr, Worker, (void *) l);
+  for (l = 0; l < numWorkers; l++)
+    pthread_join(workerid[l], NULL);
+  start_time = read_timer() - start_time;
+  pthread_attr_destroy(&attr);
+  free(workerid);
+  return start_time;
+}
+
+static double Gflops(double seconds) {
+  return 2.0 * M * N * K / seconds / 1e9;
+}
+
+/* multiply one M x N x K shape: the naive version (unless skipped), then the
+   blocked one, checked against it; prints one line of the table */
+static bool RunShape(int m, int n, int k, uint64_t seed, bool withNaive) {
+  MatrixStorage stA, stB, stC;
+  MatrixTypedFill fillA = { seed, MATRIX_ELEM_DOUBLE }, fillB = { seed + 1, MATRIX_ELEM_DOUBLE };
+  double *reference = NULL, naiveTime = 0, blockedTime, diff = 0;
+  size_t i;
+
+  M = m; N = n; K = k;
+  A = matrix_alloc_elems(&stA, M, K, sizeof(double), PAGES_DEFAULT);
+  B = matrix_alloc_elems(&stB, K, N, sizeof(double), PAGES_DEFAULT);
+  C = matrix_alloc_elems(&stC, M, N, sizeof(double), PAGES_DEFAULT);
+  matrix_init_parallel((void *) A, M, K, numWorkers, false, matrix_fill_random_typed, &fillA);
+  matrix_init_parallel((void *) B, K, N, numWorkers, false, matrix_fill_random_typed, &fillB);
+
+  if (withNaive) {
+    naiveTime = Multiply(true);
+    reference = malloc((size_t) M * N * sizeof(double));
+    if (reference == NULL) {
+      fprintf(stderr, "Out of memory for the reference product\n");
+      exit(1);
+    }
+    memcpy(reference, C, (size_t) M * N * sizeof(double));
+  }
+  blockedTime = Multiply(false);
+  if (withNaive) {
+    for (i = 0; i < (size_t) M * N; i++)
+      if (C[i] - reference[i] > diff || reference[i] - C[i] > diff)
+        diff = (C[i] > reference[i]) ? C[i] - reference[i] : reference[i] - C[i];
+    printf("%6d %6d %6d %6dx%-3d %12g %12g %9.2f %10g\n", M, N, K, gridRows, gridCols,
+           Gflops(naiveTime), Gflops(blockedTime), naiveTime / blockedTime, diff);
+  } else
+    printf("%6d %6d %6d %6dx%-3d %12s %12g %9s %10s\n", M, N, K, gridRows, gridCols,
+           "-", Gflops(blockedTime), "-", "-");
+
+  free(reference);
+  matrix_free(&stA);
+  matrix_free(&stB);
+  matrix_free(&stC);
+  return diff == 0;
+}
+
+int main(int argc, char *argv[]) {
+  int i, numArgs = 0, size, m = 0, n = 0, k = 0;
+  const char *kernelName = "auto";
+  uint64_t seed = time(NULL);
+  char *args[2];
+  bool withNaive = true, bench = false, ok = true;
+
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--shape=", 8) == 0) {
+      if (sscanf(argv[i] + 8, "%d,%d,%d", &m, &n, &k) != 3 || m < 1 || n < 1 || k < 1) {
+        fprintf(stderr, "Bad shape: %s (use M,N,K)\n", argv[i] + 8);
+        exit(1);
+      }
+    }
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strcmp(argv[i], "--no-naive") == 0)
+      withNaive = false;
+    else if (strcmp(argv[i], "--bench") == 0)
+      bench = true;
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  if (gemm_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+  size = (numArgs > 0)? atoi(args[0]) : DEFAULTSIZE;
+  numWorkers = (numArgs > 1)? atoi(args[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (size < 1) size = 1;
+  if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+
+  printf("GFLOP/s of C = A * B, %d workers, %s micro-kernel (%dx%d), seed %llu\n", numWorkers,
+         gemm_kernel_name, GEMM_MR, GEMM_NR, (unsigned long long) seed);
+  printf("%6s %6s %6s %10s %12s %12s %9s %10s\n", "M", "N", "K", "grid", "naive", "blocked",
+         "speedup", "max diff");
+  if (bench) {
+    ok &= RunShape(size, size, size, seed, withNaive);
+    ok &= RunShape(size, size, SKINNY, seed, withNaive);
+    ok &= RunShape(size, SKINNY, size, seed, withNaive);
+    ok &= RunShape(SKINNY, size, size, seed, withNaive);
+    ok &= RunShape(size, SKINNY, SKINNY, seed, withNaive);
+  } else if (m > 0)
+    ok = RunShape(m, n, k, seed, withNaive);
+  else
+    ok = RunShape(size, size, size, seed, withNaive);
+
+  if (!ok) {
+    printf("The blocked product differs from the naive one\n");
+    return 1;
+  }
+  return 0;
+}
+
+/* Naive: each worker computes one strip of rows of C with the triple loop.
+   Blocked: each worker computes one tile of the gridRows x gridCols grid
+   over C with the blocked kernel, packing into its own buffers. */
+void *Worker(void *arg) {
+  long myid = (long) arg;
+  int first, last, i, j, p;
+
+  if (naive) {
+    matrix_strip(myid, numWorkers, M, &first, &last);
+    for (i = first; i <= last; i++)
+      for (j = 0; j < N; j++) {
+        double sum = 0;
+        for (p = 0; p < K; p++)
+          sum += A[(size_t) i * K + p] * B[(size_t) p * N + j];
+        C[(size_t) i * N + j] = sum;
+      }
+  } else {
+    GemmBuffers buf;
+    int m0, m1, n0, n1;
+    gemm_part(myid / gridCols, gridRows, M, GEMM_MR, &m0, &m1);
+    gemm_part(myid % gridCols, gridCols, N, GEMM_NR, &n0, &n1);
+    if (m0 < m1 && n0 < n1) {
+      gemm_buffers_alloc(&buf);
+      gemm_tile(A, B, C, m0, m1, n0, n1, K, K, N, N, &buf);
+      gemm_buffers_free(&buf);
+    }
+  }
+  return NULL;
+}
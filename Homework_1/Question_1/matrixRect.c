@@ -0,0 +1,271 @@
+/* sub-rectangle sum, min, and max queries using pthreads
+
+   features: builds the summed-area table and 2D sparse table of
+             common/rect_index.h over the random matrix of matrixSum_a (same
+             --seed, same values) or over an --input file, with the workers
+             meeting at the barrier of common/barrier.h between build phases.
+             Then either answers the given rectangles (--query, or lines of
+             "r0 c0 r1 c1" on standard input with --stdin), or runs a query
+             benchmark: each worker answers its share of --queries random
+             rectangles; after the timed run, main checks the first
+             CHECK_QUERIES of them against a direct scan of the matrix.
+             Corners are inclusive: rows r0..r1, columns c0..c1.
+
+   usage under Linux:
+     gcc -O2 matrixRect.c -lpthread -o matrixRect
+     ./matrixRect [--seed=N] [--input=FILE] [--query=r0,c0,r1,c1 ...] [--stdin]
+                  [--queries=Q] [--max-index-mb=M] <size> <numWorkers>
+
+   options:
+     --query=r0,c0,r1,c1  answer this rectangle (may be repeated)
+     --stdin              answer the rectangles read from standard input
+     --queries=Q          random rectangles for the benchmark (default 10000000)
+     --max-index-mb=M     refuse to build an index larger than M MB (default 2048);
+                          the sparse table grows as n^2 log^2 n
+
+   size defaults to DEFAULTSIZE, numWorkers to the number of online CPUs.
+
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np in matrix_alloc.h */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/matrix_alloc.h"
+#include "../../common/matrix_file.h"
+#include "../../common/barrier.h"
+#include "../../common/rect_index.h"
+
+#define DEFAULTSIZE 512      /* matrix size if not given; the index is ~210 MB */
+#define MAXQUERIES 64        /* --query options */
+#define CHECK_QUERIES 1000   /* benchmark queries checked by a direct scan */
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+int rows, cols, numWorkers;
+const int *matrix;
+RectIndex ix;
+ThreadBarrier barrier;
+long long numQueries = 10000000;
+uint64_t seed;
+long long *checksums;    /* per worker, so the benchmark queries are not optimized away */
+
+void *Worker(void *);
+
+/* random rectangle q of the benchmark, from the counter-based stream */
+static void RandomRect(long long q, int *r0, int *c0, int *r1, int *c1) {
+  uint64_t k = 4 * (uint64_t) q, key = seed ^ SPLITMIX64_GAMMA;
+  int a = counter_rng_below(key, k, rows), b = counter_rng_below(key, k + 1, rows);
+  int c = counter_rng_below(key, k + 2, cols), d = counter_rng_below(key, k + 3, cols);
+  *r0 = (a < b) ? a : b; *r1 = (a < b) ? b : a;
+  *c0 = (c < d) ? c : d; *c1 = (c < d) ? d : c;
+}
+
+/* the answer by a direct scan */
+static void ScanRect(int r0, int c0, int r1, int c1, long long *sum, MinMax *mm) {
+  int i, j;
+  *sum = 0;
+  mm->min = INT_MAX;
+  mm->max = INT_MIN;
+  for (i = r0; i <= r1; i++)
+    for (j = c0; j <= c1; j++) {
+      int v = matrix[(size_t) i * cols + j];
+      *sum += v;
+      if (v < mm->min) mm->min = v;
+      if (v > mm->max) mm->max = v;
+    }
+}
+
+static bool Answer(int r0, int c0, int r1, int c1) {
+  MinMax mm;
+  if (r0 < 0 || c0 < 0 || r1 >= rows || c1 >= cols || r0 > r1 || c0 > c1) {
+    printf("(%d, %d)-(%d, %d): outside the %dx%d matrix\n", r0, c0, r1, c1, rows, cols);
+    return false;
+  }
+  mm = rect_index_minmax(&ix, r0, c0, r1, c1);
+  printf("(%d, %d)-(%d, %d): sum %lld, min %d, max %d\n", r0, c0, r1, c1,
+         rect_index_sum(&ix, r0, c0, r1, c1), mm.min, mm.max);
+  return true;
+}
+
+int main(int argc, char *argv[]) {
+  int i, numArgs = 0, numRects = 0, rects[MAXQUERIES][4];
+  long l;
+  long long maxMB = 2048;
+  bool fromStdin = false;
+  const char *inputPath = NULL;
+  char *args[2];
+  MatrixFile input;
+  MatrixStorage storage;
+  int *generated;
+  pthread_attr_t attr;
+  pthread_t *workerid;
+  double build_time, query_time;
+  long long checksum = 0, q;
+  int failed = 0;
+
+  seed = time(NULL);
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--input=", 8) == 0)
+      inputPath = argv[i] + 8;
+    else if (strncmp(argv[i], "--query=", 8) == 0) {
+      if (numRects == MAXQUERIES ||
+          sscanf(argv[i] + 8, "%d,%d,%d,%d", &rects[numRects][0], &rects[numRects][1],
+                 &rects[numRects][2], &rects[numRects][3]) != 4) {
+        fprintf(stderr, "Bad or too many --query options: %s\n", argv[i]);
+        exit(1);
+      }
+      numRects++;
+    }
+    else if (strcmp(argv[i], "--stdin") == 0)
+      fromStdin = true;
+    else if (strncmp(argv[i], "--queries=", 10) == 0)
+      numQueries = atoll(argv[i] + 10);
+    else if (strncmp(argv[i], "--max-index-mb=", 15) == 0)
+      maxMB = atoll(argv[i] + 15);
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  rows = cols = (numArgs > 0)? atoi(args[0]) : DEFAULTSIZE;
+  numWorkers = (numArgs > 1)? atoi(args[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (rows < 1) rows = cols = 1;
+  if (inputPath != NULL) {
+    matrix = matrix_file_map(inputPath, &input);
+    rows = input.header.rows;
+    cols = input.header.cols;
+    if (input.header.elemType != MATRIX_ELEM_INT32) {
+      fprintf(stderr, "%s holds %s elements; only int32 is supported here\n",
+              inputPath, matrix_elem_name(input.header.elemType));
+      exit(1);
+    }
+  }
+  if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+  if (numWorkers > rows) numWorkers = rows;
+  if (numQueries < 0) numQueries = 0;
+  if (rect_index_bytes(rows, cols) > (size_t) maxMB << 20) {
+    fprintf(stderr, "The index of a %dx%d matrix takes %zu MB (--max-index-mb=%lld)\n",
+            rows, cols, rect_index_bytes(rows, cols) >> 20, maxMB);
+    exit(1);
+  }
+
+  if (inputPath == NULL) {
+    generated = matrix_alloc(&storage, rows, cols, PAGES_DEFAULT);
+    matrix_init_parallel(generated, rows, cols, numWorkers, false, matrix_fill_random, &seed);
+    matrix = generated;
+  }
+
+  /* build the index, worker 0 being the main thread */
+  rect_index_init(&ix, rows, cols);
+  barrier_init(&barrier, BARRIER_CENTRAL, numWorkers);
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  workerid = malloc(numWorkers * sizeof(pthread_t));
+  checksums = calloc(numWorkers, sizeof(long long));
+
+  build_time = read_timer();
+  for (l = 1; l < numWorkers; l++)
+    pthread_create(&workerid[l], &attr, Worker, (void *) l);
+  rect_index_build(&ix, matrix, 0, numWorkers, &barrier);
+  build_time = read_timer() - build_time;
+  printf("Indexed the %dx%d matrix in %g sec (%zu MB, %s)\n", rows, cols, build_time,
+         rect_index_bytes(rows, cols) >> 20, inputPath ? inputPath : "random");
+
+  if (numRects > 0 || fromStdin) {
+    int r0, c0, r1, c1;
+    for (i = 0; i < numRects; i++)
+      Answer(rects[i][0], rects[i][1], rects[i][2], rects[i][3]);
+    if (fromStdin)
+      while (scanf("%d %d %d %d", &r0, &c0, &r1, &c1) == 4)
+        Answer(r0, c0, r1, c1);
+    numQueries = 0; /* no benchmark */
+  }
+
+  /* the benchmark: the workers wait at the barrier for the go */
+  query_time = read_timer();
+  barrier_wait(&barrier, 0);
+  Worker((void *) 0);
+  for (l = 1; l < numWorkers; l++)
+    pthread_join(workerid[l], NULL);
+  query_time = read_timer() - query_time;
+
+  if (numQueries > 0) {
+    for (l = 0; l < numWorkers; l++)
+      checksum += checksums[l];
+    /* check the first queries against a direct scan, outside the timing */
+    for (q = 0; q < numQueries && q < CHECK_QUERIES; q++) {
+      int r0, c0, r1, c1;
+      long long s;
+      MinMax e, mm;
+      RandomRect(q, &r0, &c0, &r1, &c1);
+      mm = rect_index_minmax(&ix, r0, c0, r1, c1);
+      ScanRect(r0, c0, r1, c1, &s, &e);
+      if (s != rect_index_sum(&ix, r0, c0, r1, c1) || e.min != mm.min || e.max != mm.max)
+        failed++;
+    }
+    printf("Answered %lld queries in %g sec (%g queries/sec, %d workers, checksum %lld)\n",
+           numQueries, query_time, numQueries / query_time, numWorkers, checksum);
+    if (failed > 0) {
+      printf("%d of the checked queries disagree with a direct scan\n", failed);
+      return 1;
+    }
+  }
+
+  barrier_destroy(&barrier);
+  pthread_attr_destroy(&attr);
+  rect_index_destroy(&ix);
+  if (inputPath != NULL)
+    matrix_file_unmap(&input);
+  else
+    matrix_free(&storage);
+  free(workerid);
+  free(checksums);
+  return 0;
+}
+
+/* Each worker (other than 0) builds its part of the index; then, after the
+   go from main, every worker answers one strip of the benchmark queries. */
+void *Worker(void *arg) {
+  long myid = (long) arg;
+  long long q, first, last, chunk, checksum = 0;
+  int r0, c0, r1, c1;
+
+  if (myid != 0) {
+    rect_index_build(&ix, matrix, myid, numWorkers, &barrier);
+    barrier_wait(&barrier, myid);
+  }
+
+  chunk = numQueries / numWorkers;
+  first = myid * chunk;
+  last = (myid == numWorkers - 1) ? numQueries - 1 : first + chunk - 1;
+  for (q = first; q <= last; q++) {
+    MinMax mm;
+    long long sum;
+    RandomRect(q, &r0, &c0, &r1, &c1);
+    sum = rect_index_sum(&ix, r0, c0, r1, c1);
+    mm = rect_index_minmax(&ix, r0, c0, r1, c1);
+    checksum += sum + mm.min + mm.max;
+  }
+  checksums[myid] = checksum;
+  return NULL;
+}
@@ -3,42 +3,94 @@
    features: uses a barrier; the Worker[0] computes
              the total sum, min, and max from partial sums, mins, and maxs
              computed by Workers and prints the total sum, min, and max to the standard output.
-             Matrix elements are initialized to random values.
+             Matrix elements are initialized to random values from a
+             counter-based generator keyed by the seed and (row, col), so a
+             given --seed yields the same matrix for any numWorkers.
+             With --input the matrix is instead a binary matrix file (see
+             common/matrix_file.h and matrixGen.c) mapped read-only, so the
+             workers reduce it straight out of the page cache. With --text
+             it is a CSV or whitespace-separated text file of int32 values,
+             parsed in parallel by the workers (common/matrix_text.h), which
+             report the MB/s each of them parsed.
+             The matrix is mapped at the requested size (common/matrix_alloc.h)
+             and each strip is first touched by the worker that reduces it.
+             Rows are reduced by the SIMD kernel in common/reduce_kernel.h.
+             Elements are int32 by default; with --type (or the type of an
+             --input file) they can be int8/uint8/int16/int64/float/double,
+             reduced by the type-specialized kernels in common/typed_kernel.h,
+             so the 0..99 values can be stored in one byte instead of four.
+             Partial results live in one cache-line aligned slot per worker.
+             The barrier algorithm is selectable (common/barrier.h); see
+             barrierBench.c for their episode latencies.
+             With --stats each worker also gathers mean/variance, a value
+             histogram, the exact median, and the top K values over its
+             strip in the same pass (common/matrix_stats.h), and Worker[0]
+             merges those partial states too.
 
    usage under Linux:
-     gcc matrixSum_a.c -lpthread -o matrixSum_a
-     ./matrixSum_a <size> <numWorkers>
+     gcc -O2 matrixSum_a.c -lpthread -o matrixSum_a
+     ./matrixSum_a [--kernel=auto|scalar|sse4.1|avx2|avx512] <size> <numWorkers>
+
+   numWorkers defaults to the number of online CPUs; there is no upper limit.
+
+   options:
+     --barrier=B    condvar (mutex + condition variable), central (default),
+                    tree, dissemination, or tournament
+     --seed=N       seed of the random matrix (default: the current time)
+     --input=FILE   reduce the size x cols matrix in FILE instead of a
+                    random one (the size argument is then ignored)
+     --text=FILE    the same for a text matrix: one row per line, int32
+                    values separated by commas and/or blanks
+     --perf         count cycles, instructions, LLC misses, and branch
+                    misses of each worker (common/perf_counters.h)
+     --type=T       element type of the random matrix: int32 (default),
+                    int8, uint8, int16, int64, float, or double
+     --pages=P      matrix pages: default, thp (madvise(MADV_HUGEPAGE)),
+                    or hugetlb (MAP_HUGETLB, needs reserved huge pages)
+     --pin          run worker i on CPU i mod #CPUs, so the NUMA placement
+                    of the first-touch initialization matches the reduction
+     --progress=N   publish the running partial result every N rows
+     --layout=L     padded (default) or packed partial slots; packed puts
+                    neighbouring workers' slots in the same cache line
+     --bench        false-sharing micro-benchmark: time both layouts for
+                    1, 2, 4, ..., BENCH_MAXWORKERS workers (default --progress=1)
+     --stats=LIST   statistics to print, from sum, min, max, var, hist,
+                    median, and topk=K (default sum,min,max)
 
 */
 #ifndef _REENTRANT 
 #define _REENTRANT 
 #endif 
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np, MAP_HUGETLB */
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
 #include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/reduce_kernel.h"
+#include "../../common/typed_kernel.h"
+#include "../../common/matrix_alloc.h"
+#include "../../common/matrix_file.h"
+#include "../../common/matrix_text.h"
+#include "../../common/perf_counters.h"
+#include "../../common/barrier.h"
+#include "../../common/matrix_stats.h"
 
-#define MAXSIZE 10000  /* maximum matrix size */
-#define MAXWORKERS 10   /* maximum number of workers */
+#define DEFAULTSIZE 10000 /* matrix size if not given */
+#define BENCH_MAXWORKERS 64 /* largest worker count in --bench */
+#define CACHE_LINE 64   /* bytes per cache line */
+#define BENCH_RUNS 5    /* runs per configuration in --bench, median is reported */
 
-pthread_mutex_t barrier_mutex;  /* mutex lock for the barrier */
-pthread_cond_t go;        /* condition variable for leaving */
+ThreadBarrier barrier;    /* the barrier, for numWorkers workers */
+BarrierKind barrierKind = BARRIER_CENTRAL;
 int numWorkers;           /* number of workers */ 
-int numArrived = 0;       /* number who have arrived */
-
-/* a reusable counter barrier */
-void Barrier() {
-  pthread_mutex_lock(&barrier_mutex);
-  numArrived++;
-  if (numArrived == numWorkers) {
-    numArrived = 0;
-    pthread_cond_broadcast(&go);
-  } else
-    pthread_cond_wait(&go, &barrier_mutex);
-  pthread_mutex_unlock(&barrier_mutex);
+
+/* a reusable barrier; myid identifies the caller to the algorithm */
+void Barrier(long myid) {
+  barrier_wait(&barrier, myid);
 }
 
 /* timer */
@@ -57,130 +109,326 @@ double read_timer() {
 
 double start_time, end_time; /* start and end times */
 int size, stripSize;  /* assume size is multiple of numWorkers */
-int matrix[MAXSIZE][MAXSIZE]; /* matrix */
+const void *matrix; /* size x cols, row-major */
+int cols;          /* == size unless read from --input */
+uint32_t elemType = MATRIX_ELEM_INT32; /* type of the elements */
+size_t elemSize = sizeof(int);
+TypedRowFn typedRow = NULL; /* kernel of a non-int32 type; int32 uses reduce_row */
+const char *kernelLabel;    /* the kernel in use, for the report */
+MatrixStorage storage; /* where matrix is mapped */
+
+/* the partial result of one worker and how many of its rows it covers */
+typedef struct {
+  TypedReduction r;
+  int rowsDone;
+} PartialSlot;
+
+/* a slot padded to a full cache line, so a worker publishing its partial
+   result never invalidates the line holding a neighbour's slot */
+typedef struct {
+  _Alignas(CACHE_LINE) PartialSlot slot;
+} WorkerPartial;
 
 // Partial results from each worker
-int sums[MAXWORKERS];
-int mins[MAXWORKERS];
-int maxs[MAXWORKERS];
-int minRows[MAXWORKERS], minCols[MAXWORKERS];
-int maxRows[MAXWORKERS], maxCols[MAXWORKERS];
+WorkerPartial *partials;
+PartialSlot *packedPartials; /* unpadded layout, for --layout=packed */
+bool packedLayout = false;
+int progressRows = 0;     /* publish partials every progressRows rows, 0 = at end only */
+bool quiet = false;       /* worker(0) does not print results (--bench) */
+bool pin = false;         /* pin worker i to CPU i mod #CPUs (--pin) */
+StatsConfig statsConfig = { STATS_SUM | STATS_MIN | STATS_MAX, 0 };
+bool statsExtra = false;  /* statistics beyond sum, min, and max (--stats) */
+
+/* a worker's statistics state, padded like WorkerPartial */
+typedef struct {
+  _Alignas(CACHE_LINE) MatrixStats stats;
+} WorkerStats;
+
+WorkerStats *workerStats;
+PerfCounters *perfCounters = NULL; /* per worker, with --perf */
 
 void *Worker(void *);
+void Benchmark(pthread_attr_t *attr, pthread_t *workerid);
 
 /* read command line, initialize, and create threads */
 int main(int argc, char *argv[]) {
-  int i, j;
+  int i, numSlots;
   long l; /* use long in case of a 64-bit system */
   pthread_attr_t attr;
-  pthread_t workerid[MAXWORKERS];
+  pthread_t *workerid;
+  const char *kernelName = "auto";
+  PageMode pageMode = PAGES_DEFAULT;
+  const char *inputPath = NULL, *textPath = NULL;
+  MatrixFile input;
+  MatrixTextInfo textInfo;
+  void *generated;
+  MatrixTypedFill fill;
+  uint64_t seed = time(NULL);
+  double init_time;
+  char *args[2];
+  int numArgs = 0;
+  bool bench = false, perfWanted = false;
+  const char *statsList = NULL;
 
   /* set global thread attributes */
   pthread_attr_init(&attr);
   pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
 
-  /* initialize mutex and condition variable */
-  pthread_mutex_init(&barrier_mutex, NULL);
-  pthread_cond_init(&go, NULL);
+  /* read command line options, then positional args if any */
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--pages=", 8) == 0) {
+      if (!matrix_parse_pages(argv[i] + 8, &pageMode)) {
+        fprintf(stderr, "Unknown page mode: %s (use default, thp, or hugetlb)\n", argv[i] + 8);
+        exit(1);
+      }
+    }
+    else if (strncmp(argv[i], "--barrier=", 10) == 0) {
+      if (!barrier_parse(argv[i] + 10, &barrierKind)) {
+        fprintf(stderr, "Unknown barrier: %s\n", argv[i] + 10);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--pin") == 0)
+      pin = true;
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--input=", 8) == 0)
+      inputPath = argv[i] + 8;
+    else if (strncmp(argv[i], "--text=", 7) == 0)
+      textPath = argv[i] + 7;
+    else if (strcmp(argv[i], "--perf") == 0)
+      perfWanted = true;
+    else if (strncmp(argv[i], "--type=", 7) == 0) {
+      if (!matrix_parse_elem(argv[i] + 7, &elemType)) {
+        fprintf(stderr, "Unknown element type: %s\n", argv[i] + 7);
+        exit(1);
+      }
+    }
+    else if (strncmp(argv[i], "--progress=", 11) == 0)
+      progressRows = atoi(argv[i] + 11);
+    else if (strcmp(argv[i], "--layout=packed") == 0)
+      packedLayout = true;
+    else if (strcmp(argv[i], "--layout=padded") == 0)
+      packedLayout = false;
+    else if (strcmp(argv[i], "--bench") == 0)
+      bench = true;
+    else if (strncmp(argv[i], "--stats=", 8) == 0)
+      statsList = argv[i] + 8;
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  if (reduce_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+  size = (numArgs > 0)? atoi(args[0]) : DEFAULTSIZE;
+  numWorkers = (numArgs > 1)? atoi(args[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (size < 1) size = 1;
+  cols = size;
+  if (inputPath != NULL) {
+    matrix = matrix_file_map(inputPath, &input);
+    size = input.header.rows;
+    cols = input.header.cols;
+    elemType = input.header.elemType;
+  } else if (textPath != NULL)
+    elemType = MATRIX_ELEM_INT32;
+  elemSize = matrix_elem_size(elemType);
+  if (statsList != NULL && !matrix_stats_parse(statsList, elemType, &statsConfig))
+    exit(1);
+  statsExtra = matrix_stats_extra(&statsConfig);
+  kernelLabel = reduce_kernel_name;
+  if (elemType != MATRIX_ELEM_INT32) {
+    typedRow = typed_row_kernel(elemType, kernelName);
+    kernelLabel = typed_kernel_avx2(kernelName) ? "avx2" : "baseline";
+  }
+  if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+  if (perfWanted && !bench && (perfCounters = calloc(numWorkers, sizeof(PerfCounters))) == NULL) {
+    fprintf(stderr, "Out of memory for %d workers\n", numWorkers);
+    exit(1);
+  }
 
-  /* read command line args if any */
-  size = (argc > 1)? atoi(argv[1]) : MAXSIZE;
-  numWorkers = (argc > 2)? atoi(argv[2]) : MAXWORKERS;
-  if (size > MAXSIZE) size = MAXSIZE;
-  if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
-  if (numWorkers == 0) numWorkers = 1; // Ensure at least one worker
+  /* one partial slot (and thread id) per worker, up to BENCH_MAXWORKERS for --bench */
+  numSlots = (bench && numWorkers < BENCH_MAXWORKERS) ? BENCH_MAXWORKERS : numWorkers;
+  workerid = malloc(numSlots * sizeof(pthread_t));
+  partials = aligned_alloc(CACHE_LINE, numSlots * sizeof(WorkerPartial));
+  packedPartials = malloc(numSlots * sizeof(PartialSlot));
+  workerStats = aligned_alloc(CACHE_LINE, numSlots * sizeof(WorkerStats));
+  if (workerid == NULL || partials == NULL || packedPartials == NULL || workerStats == NULL) {
+    fprintf(stderr, "Out of memory for %d workers\n", numSlots);
+    exit(1);
+  }
   stripSize = size/numWorkers;
 
-  /* initialize the matrix with random values */
-  srand(time(NULL));
-  for (i = 0; i < size; i++) {
-	  for (j = 0; j < size; j++) {
-          matrix[i][j] = rand()%100; // Random values between 0 and 99
-	  }
+  if (inputPath != NULL) {
+    printf("Reducing the %dx%d %s matrix in %s\n", size, cols, matrix_elem_name(elemType), inputPath);
+  } else if (textPath != NULL) {
+    /* parsed by numWorkers threads into new storage */
+    matrix = matrix_text_load(textPath, numWorkers, pin, pageMode, &storage, &textInfo);
+    size = textInfo.rows;
+    cols = textInfo.cols;
+    stripSize = size/numWorkers;
+    matrix_text_report(&textInfo);
+    matrix_text_info_free(&textInfo);
+    printf("Reducing the %dx%d matrix in %s\n", size, cols, textPath);
+  } else {
+    /* allocate the matrix at the requested size and initialize it in
+       parallel with seeded random values, each strip first touched by
+       the worker of that index */
+    generated = matrix_alloc_elems(&storage, size, size, elemSize, pageMode);
+    fill.seed = seed;
+    fill.type = elemType;
+    init_time = read_timer();
+    matrix_init_parallel(generated, size, size, numWorkers, pin, matrix_fill_random_typed, &fill);
+    init_time = read_timer() - init_time;
+    printf("The initialization time is %g sec (seed %llu)\n", init_time, (unsigned long long) seed);
+    matrix = generated;
   }
 
-  /* do the parallel work: create the workers */
-  start_time = read_timer();
-  for (l = 0; l < numWorkers; l++)
-    pthread_create(&workerid[l], &attr, Worker, (void *) l);
-  
-  // Main thread waits for all workers to finish
+  if (bench) {
+    Benchmark(&attr, workerid);
+  } else {
+    barrier_init(&barrier, barrierKind, numWorkers);
+
+    /* do the parallel work: create the workers */
+    start_time = read_timer();
+    for (l = 0; l < numWorkers; l++) {
+      if (pin) matrix_pin_attr(&attr, l);
+      pthread_create(&workerid[l], &attr, Worker, (void *) l);
+    }
+
+    // Main thread waits for all workers to finish
+    for (l = 0; l < numWorkers; l++)
+      pthread_join(workerid[l], NULL);
+    barrier_destroy(&barrier);
+    if (perfCounters != NULL)
+      perf_counters_print(perfCounters, numWorkers, "reduction");
+  }
+
+  if (inputPath != NULL)
+    matrix_file_unmap(&input);
+  else
+    matrix_free(&storage);
+  free(partials);
+  free(packedPartials);
+  free(workerStats);
+  free(perfCounters);
+  free(workerid);
+
+  return 0; // Main thread exits gracefully
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* time one run of the workers with the current numWorkers and layout */
+static double TimedRun(pthread_attr_t *attr, pthread_t *workerid) {
+  long l;
+  double start = read_timer();
+  for (l = 0; l < numWorkers; l++) {
+    if (pin) matrix_pin_attr(attr, l);
+    pthread_create(&workerid[l], attr, Worker, (void *) l);
+  }
   for (l = 0; l < numWorkers; l++)
     pthread_join(workerid[l], NULL);
+  return read_timer() - start;
+}
 
-  // Destroy mutex and condition variable
-  pthread_mutex_destroy(&barrier_mutex);
-  pthread_cond_destroy(&go);
+/* false-sharing micro-benchmark: median time of the packed and padded
+   partial-slot layouts for 1, 2, 4, ..., BENCH_MAXWORKERS workers */
+void Benchmark(pthread_attr_t *attr, pthread_t *workerid) {
+  double packedTimes[BENCH_RUNS], paddedTimes[BENCH_RUNS];
+  int run, workers;
 
-  return 0; // Main thread exits gracefully
+  quiet = true;
+  if (progressRows <= 0) progressRows = 1;
+  printf("Partial-slot layouts, %dx%d matrix, partials published every %d rows\n",
+         size, cols, progressRows);
+  printf("%8s %14s %14s %9s\n", "workers", "packed (sec)", "padded (sec)", "speedup");
+  for (workers = 1; workers <= BENCH_MAXWORKERS && workers <= size; workers *= 2) {
+    numWorkers = workers;
+    stripSize = size/numWorkers;
+    barrier_init(&barrier, barrierKind, numWorkers);
+    for (run = 0; run < BENCH_RUNS; run++) {
+      packedLayout = true;
+      packedTimes[run] = TimedRun(attr, workerid);
+      packedLayout = false;
+      paddedTimes[run] = TimedRun(attr, workerid);
+    }
+    qsort(packedTimes, BENCH_RUNS, sizeof(double), compare_doubles);
+    qsort(paddedTimes, BENCH_RUNS, sizeof(double), compare_doubles);
+    printf("%8d %14g %14g %9.2f\n", workers, packedTimes[BENCH_RUNS/2],
+           paddedTimes[BENCH_RUNS/2], packedTimes[BENCH_RUNS/2] / paddedTimes[BENCH_RUNS/2]);
+    barrier_destroy(&barrier);
+  }
 }
 
-/* Each worker sums the values in one strip of the matrix, and finds local min/max.
-   After a barrier, worker(0) computes and prints the total sum, global min, and global max. */
+/* Each worker sums the values in one strip of the matrix, and finds local min/max
+   (and any other --stats). After a barrier, worker(0) computes and prints the
+   total sum, global min, and global max (and merges the other statistics). */
 void *Worker(void *arg) {
   long myid = (long) arg;
-  int total_sum_strip, i, j;
-  int local_min = INT_MAX, local_max = INT_MIN;
-  int local_min_row = -1, local_min_col = -1;
-  int local_max_row = -1, local_max_col = -1;
+  int i;
+  Reduction local;       /* int32 elements */
+  TypedReduction typed;  /* other types */
+  PartialSlot *mySlot = packedLayout ? &packedPartials[myid] : &partials[myid].slot;
+  MatrixStats *myStats = &workerStats[myid].stats;
 
   int first_row = myid*stripSize;
   int last_row = (myid == numWorkers - 1) ? (size - 1) : (first_row + stripSize - 1);
 
   /* sum values in my strip and find local min/max */
-  total_sum_strip = 0;
+  if (perfCounters != NULL) perf_counters_start(&perfCounters[myid]);
+  reduction_init(&local);
+  typed_reduction_init(&typed, elemType);
+  if (statsExtra) matrix_stats_init(myStats, &statsConfig, elemType);
   for (i = first_row; i <= last_row; i++) {
-    for (j = 0; j < size; j++) {
-      total_sum_strip += matrix[i][j];
-      if (matrix[i][j] < local_min) {
-        local_min = matrix[i][j];
-        local_min_row = i;
-        local_min_col = j;
-      }
-      if (matrix[i][j] > local_max) {
-        local_max = matrix[i][j];
-        local_max_row = i;
-        local_max_col = j;
-      }
+    const char *row = (const char *) matrix + (size_t) i * cols * elemSize;
+    if (typedRow != NULL)
+      typedRow(row, cols, i, &typed);
+    else
+      reduce_row((const int *) row, cols, i, &local);
+    if (statsExtra)
+      matrix_stats_row(myStats, row, cols, i); /* the row is still in cache */
+    if (progressRows > 0 && (i - first_row + 1) % progressRows == 0) {
+      if (typedRow == NULL) typed_reduction_from(&typed, &local);
+      mySlot->r = typed;
+      mySlot->rowsDone = i - first_row + 1;
     }
   }
-  sums[myid] = total_sum_strip;
-  mins[myid] = local_min;
-  maxs[myid] = local_max;
-  minRows[myid] = local_min_row;
-  minCols[myid] = local_min_col;
-  maxRows[myid] = local_max_row;
-  maxCols[myid] = local_max_col;
-
-  Barrier();
-
-  if (myid == 0) {
-    int global_total = 0;
-    int global_min = INT_MAX, global_max = INT_MIN;
-    int global_min_row = -1, global_min_col = -1;
-    int global_max_row = -1, global_max_col = -1;
+  if (typedRow == NULL) typed_reduction_from(&typed, &local);
+  mySlot->r = typed;
+  mySlot->rowsDone = last_row - first_row + 1;
+  if (perfCounters != NULL) perf_counters_stop(&perfCounters[myid]);
+
+  Barrier(myid);
 
+  if (myid == 0 && !quiet) {
+    TypedReduction global;
+    MatrixStats stats;
+
+    typed_reduction_init(&global, elemType);
+    matrix_stats_init(&stats, &statsConfig, elemType);
     for (i = 0; i < numWorkers; i++) {
-      global_total += sums[i];
-      if (mins[i] < global_min) {
-        global_min = mins[i];
-        global_min_row = minRows[i];
-        global_min_col = minCols[i];
-      }
-      if (maxs[i] > global_max) {
-        global_max = maxs[i];
-        global_max_row = maxRows[i];
-        global_max_col = maxCols[i];
-      }
+      typed_reduction_merge(&global, packedLayout ? &packedPartials[i].r : &partials[i].slot.r);
+      if (statsExtra)
+        matrix_stats_merge(&stats, &workerStats[i].stats);
     }
-    
+
     end_time = read_timer(); /* get end time */
 
     /* print results */
-    printf("The total sum is %d\n", global_total);
-    printf("The minimum element is %d at (%d, %d)\n", global_min, global_min_row, global_min_col);
-    printf("The maximum element is %d at (%d, %d)\n", global_max, global_max_row, global_max_col);
-    printf("The execution time is %g sec\n", end_time - start_time);
+    matrix_stats_print(&stats, &global);
+    matrix_stats_destroy(&stats);
+    printf("The execution time is %g sec (%s elements, %s kernel, %s barrier)\n", end_time - start_time,
+           matrix_elem_name(elemType), kernelLabel, barrier_kind_name(barrierKind));
+  }
+  if (statsExtra && myid == 0) {
+    for (i = 0; i < numWorkers; i++)
+      matrix_stats_destroy(&workerStats[i].stats);
   }
 
   return NULL;
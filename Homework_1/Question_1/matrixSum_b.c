@@ -3,26 +3,59 @@
    features: Main thread prints results. No barrier function is used.
              No arrays for partial results are used. Global mutex-protected
              variables are used for accumulating results.
-             Matrix elements are initialized to random values.
+             Matrix elements are initialized to random values from a
+             counter-based generator keyed by the seed and (row, col), so a
+             given --seed yields the same matrix for any numWorkers.
+             With --input the matrix is instead a binary matrix file (see
+             common/matrix_file.h and matrixGen.c) mapped read-only, so the
+             workers reduce it straight out of the page cache. With --text
+             it is a CSV or whitespace-separated text file of int32 values,
+             parsed in parallel by the workers (common/matrix_text.h), which
+             report the MB/s each of them parsed.
+             The matrix is mapped at the requested size (common/matrix_alloc.h)
+             and each strip is first touched by a worker of the same index.
+             Rows are reduced by the SIMD kernel in common/reduce_kernel.h.
 
    usage under Linux:
-     gcc matrixSum_b.c -lpthread -o matrixSum_b
-     ./matrixSum_b <size> <numWorkers>
+     gcc -O2 matrixSum_b.c -lpthread -o matrixSum_b
+     ./matrixSum_b [--kernel=auto|scalar|sse4.1|avx2|avx512] [--pages=P] [--pin]
+                   <size> <numWorkers>
+
+   numWorkers defaults to the number of online CPUs; there is no upper limit.
+
+   options:
+     --seed=N       seed of the random matrix (default: the current time)
+     --input=FILE   reduce the size x cols matrix in FILE instead of a
+                    random one (the size argument is then ignored)
+     --text=FILE    the same for a text matrix: one row per line, int32
+                    values separated by commas and/or blanks
+     --pages=P      matrix pages: default, thp (madvise(MADV_HUGEPAGE)),
+                    or hugetlb (MAP_HUGETLB, needs reserved huge pages)
+     --pin          run worker i on CPU i mod #CPUs, so the NUMA placement
+                    of the first-touch initialization matches the reduction
+     --perf         count cycles, instructions, LLC misses, and branch
+                    misses of each worker (common/perf_counters.h)
 
 */
 #ifndef _REENTRANT 
 #define _REENTRANT 
 #endif 
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np, MAP_HUGETLB */
 #include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
 #include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/reduce_kernel.h"
+#include "../../common/matrix_alloc.h"
+#include "../../common/matrix_file.h"
+#include "../../common/matrix_text.h"
+#include "../../common/perf_counters.h"
 
-#define MAXSIZE 10000  /* maximum matrix size */
-#define MAXWORKERS 10   /* maximum number of workers */
+#define DEFAULTSIZE 10000 /* matrix size if not given */
 
 pthread_mutex_t result_mutex; /* mutex lock for protecting global results */
 
@@ -42,13 +75,12 @@ double read_timer() {
 
 double start_time, end_time; /* start and end times */
 int size, numWorkers, stripSize;  /* assume size is multiple of numWorkers */
-int matrix[MAXSIZE][MAXSIZE]; /* matrix */
+const int *matrix; /* size x cols, row-major */
+int cols;          /* == size unless read from --input */
+MatrixStorage storage; /* where matrix is mapped */
+PerfCounters *perfCounters = NULL; /* per worker, with --perf */
 
-// Global results, protected by result_mutex
-long long global_sum = 0;
-int global_min = INT_MAX, global_max = INT_MIN;
-int global_min_row = -1, global_min_col = -1;
-int global_max_row = -1, global_max_col = -1;
+Reduction global; /* global results, protected by result_mutex */
 
 void *Worker(void *);
 
@@ -56,46 +88,22 @@ void *Worker(void *);
    Then updates global results with mutex protection. */
 void *Worker(void *arg) {
   long myid = (long) arg;
-  int i, j;
-  int local_sum_strip = 0;
-  int local_min = INT_MAX, local_max = INT_MIN;
-  int local_min_row = -1, local_min_col = -1;
-  int local_max_row = -1, local_max_col = -1;
+  int i;
+  Reduction local;
 
   int first_row = myid*stripSize;
   int last_row = (myid == numWorkers - 1) ? (size - 1) : (first_row + stripSize - 1);
 
   /* sum values in my strip and find local min/max */
-  for (i = first_row; i <= last_row; i++) {
-    for (j = 0; j < size; j++) {
-      local_sum_strip += matrix[i][j];
-      if (matrix[i][j] < local_min) {
-        local_min = matrix[i][j];
-        local_min_row = i;
-        local_min_col = j;
-      }
-      if (matrix[i][j] > local_max) {
-        local_max = matrix[i][j];
-        local_max_row = i;
-        local_max_col = j;
-      }
-    }
-  }
+  if (perfCounters != NULL) perf_counters_start(&perfCounters[myid]);
+  reduction_init(&local);
+  for (i = first_row; i <= last_row; i++)
+    reduce_row(matrix + (size_t) i * cols, cols, i, &local);
+  if (perfCounters != NULL) perf_counters_stop(&perfCounters[myid]);
 
   // Update global results with mutex protection
   pthread_mutex_lock(&result_mutex);
-  global_sum += local_sum_strip;
-  
-  if (local_min < global_min) {
-    global_min = local_min;
-    global_min_row = local_min_row;
-    global_min_col = local_min_col;
-  }
-  if (local_max > global_max) {
-    global_max = local_max;
-    global_max_row = local_max_row;
-    global_max_col = local_max_col;
-  }
+  reduction_merge(&global, &local);
   pthread_mutex_unlock(&result_mutex);
 
   return NULL;
@@ -103,10 +111,21 @@ void *Worker(void *arg) {
 
 /* read command line, initialize, and create threads */
 int main(int argc, char *argv[]) {
-  int i, j;
+  int i;
   long l; /* use long in case of a 64-bit system */
   pthread_attr_t attr;
-  pthread_t workerid[MAXWORKERS];
+  pthread_t *workerid;
+  const char *kernelName = "auto";
+  PageMode pageMode = PAGES_DEFAULT;
+  const char *inputPath = NULL, *textPath = NULL;
+  MatrixFile input;
+  MatrixTextInfo textInfo;
+  int *generated;
+  bool pin = false, perfWanted = false;
+  uint64_t seed = time(NULL);
+  double init_time;
+  char *args[2];
+  int numArgs = 0;
 
   /* set global thread attributes */
   pthread_attr_init(&attr);
@@ -115,26 +134,86 @@ int main(int argc, char *argv[]) {
   /* initialize mutex */
   pthread_mutex_init(&result_mutex, NULL);
 
-  /* read command line args if any */
-  size = (argc > 1)? atoi(argv[1]) : MAXSIZE;
-  numWorkers = (argc > 2)? atoi(argv[2]) : MAXWORKERS;
-  if (size > MAXSIZE) size = MAXSIZE;
-  if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
-  if (numWorkers == 0) numWorkers = 1; // Ensure at least one worker
+  /* read command line options, then positional args if any */
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--pages=", 8) == 0) {
+      if (!matrix_parse_pages(argv[i] + 8, &pageMode)) {
+        fprintf(stderr, "Unknown page mode: %s (use default, thp, or hugetlb)\n", argv[i] + 8);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--pin") == 0)
+      pin = true;
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--input=", 8) == 0)
+      inputPath = argv[i] + 8;
+    else if (strncmp(argv[i], "--text=", 7) == 0)
+      textPath = argv[i] + 7;
+    else if (strcmp(argv[i], "--perf") == 0)
+      perfWanted = true;
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  if (reduce_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+  size = (numArgs > 0)? atoi(args[0]) : DEFAULTSIZE;
+  numWorkers = (numArgs > 1)? atoi(args[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (size < 1) size = 1;
+  cols = size;
+  if (inputPath != NULL) {
+    matrix = matrix_file_map(inputPath, &input);
+    size = input.header.rows;
+    cols = input.header.cols;
+    if (input.header.elemType != MATRIX_ELEM_INT32) {
+      fprintf(stderr, "%s holds %s elements; only int32 is supported here (see matrixSum_a)\n",
+              inputPath, matrix_elem_name(input.header.elemType));
+      exit(1);
+    }
+  }
+  if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+  if (perfWanted && (perfCounters = calloc(numWorkers, sizeof(PerfCounters))) == NULL) {
+    fprintf(stderr, "Out of memory for %d workers\n", numWorkers);
+    exit(1);
+  }
+  workerid = malloc(numWorkers * sizeof(pthread_t));
   stripSize = size/numWorkers;
 
-  /* initialize the matrix with random values */
-  srand(time(NULL));
-  for (i = 0; i < size; i++) {
-	  for (j = 0; j < size; j++) {
-          matrix[i][j] = rand()%100; // Random values between 0 and 99
-	  }
+  if (inputPath != NULL) {
+    printf("Reducing the %dx%d matrix in %s\n", size, cols, inputPath);
+  } else if (textPath != NULL) {
+    /* parsed by numWorkers threads into new storage */
+    matrix = matrix_text_load(textPath, numWorkers, pin, pageMode, &storage, &textInfo);
+    size = textInfo.rows;
+    cols = textInfo.cols;
+    stripSize = size/numWorkers;
+    matrix_text_report(&textInfo);
+    matrix_text_info_free(&textInfo);
+    printf("Reducing the %dx%d matrix in %s\n", size, cols, textPath);
+  } else {
+    /* allocate the matrix at the requested size and initialize it in
+       parallel with seeded random values, each strip first touched by
+       the worker of that index */
+    generated = matrix_alloc(&storage, size, size, pageMode);
+    init_time = read_timer();
+    matrix_init_parallel(generated, size, size, numWorkers, pin, matrix_fill_random, &seed);
+    init_time = read_timer() - init_time;
+    printf("The initialization time is %g sec (seed %llu)\n", init_time, (unsigned long long) seed);
+    matrix = generated;
   }
 
+  reduction_init(&global);
+
   /* do the parallel work: create the workers */
   start_time = read_timer();
-  for (l = 0; l < numWorkers; l++)
+  for (l = 0; l < numWorkers; l++) {
+    if (pin) matrix_pin_attr(&attr, l);
     pthread_create(&workerid[l], &attr, Worker, (void *) l);
+  }
   
   // Main thread waits for all workers to finish
   for (l = 0; l < numWorkers; l++)
@@ -143,13 +222,21 @@ int main(int argc, char *argv[]) {
   end_time = read_timer(); /* get end time */
 
   /* print results */
-  printf("The total sum is %lld\n", global_sum);
-  printf("The minimum element is %d at (%d, %d)\n", global_min, global_min_row, global_min_col);
-  printf("The maximum element is %d at (%d, %d)\n", global_max, global_max_row, global_max_col);
-  printf("The execution time is %g sec\n", end_time - start_time);
+  printf("The total sum is %lld\n", global.sum);
+  printf("The minimum element is %d at (%d, %d)\n", global.min, global.minRow, global.minCol);
+  printf("The maximum element is %d at (%d, %d)\n", global.max, global.maxRow, global.maxCol);
+  printf("The execution time is %g sec (%s kernel)\n", end_time - start_time, reduce_kernel_name);
+  if (perfCounters != NULL)
+    perf_counters_print(perfCounters, numWorkers, "reduction");
 
   // Destroy mutex
   pthread_mutex_destroy(&result_mutex);
+  if (inputPath != NULL)
+    matrix_file_unmap(&input);
+  else
+    matrix_free(&storage);
+  free(perfCounters);
+  free(workerid);
 
   return 0; // Main thread exits gracefully
 }
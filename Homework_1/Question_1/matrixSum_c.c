@@ -1,32 +1,112 @@
 /* matrix summation, min, and max using pthreads (Version c)
 
    features: Uses a "bag of tasks" pattern with a shared row counter.
-             Workers atomically fetch rows to process. Main thread prints results.
+             Workers take chunks of rows with a C11 atomic_fetch_add on the
+             counter (no lock); the chunk size is fixed, guided (shrinking
+             with the remaining work), or adaptive (sized from the worker's
+             own measured row rate). With --sched=steal the bag is instead
+             split into row blocks seeded strip-wise into one Chase-Lev
+             deque per worker (common/ws_deque.h); a worker whose deque is
+             empty steals blocks from random victims. Main thread prints
+             results and the rows, chunks, and busy time of every worker,
+             plus steals and idle time with --sched=steal.
              Global mutex-protected variables are used for accumulating results.
-             Matrix elements are initialized to random values.
+             Matrix elements are initialized to random values from a
+             counter-based generator keyed by the seed and (row, col), so a
+             given --seed yields the same matrix for any numWorkers.
+             With --input the matrix is instead a binary matrix file (see
+             common/matrix_file.h and matrixGen.c) mapped read-only, so the
+             workers reduce it straight out of the page cache. With --text
+             it is a CSV or whitespace-separated text file of int32 values,
+             parsed in parallel by the workers (common/matrix_text.h), which
+             report the MB/s each of them parsed.
+             The matrix is mapped at the requested size (common/matrix_alloc.h)
+             and each strip is first touched by a worker of the same index.
+             Rows are reduced by the SIMD kernel in common/reduce_kernel.h.
 
    usage under Linux:
-     gcc matrixSum_c.c -lpthread -o matrixSum_c
-     ./matrixSum_c <size> <numWorkers>
+     gcc -O2 matrixSum_c.c -lpthread -o matrixSum_c
+     ./matrixSum_c [--kernel=auto|scalar|sse4.1|avx2|avx512]
+                   [--chunk=fixed|guided|adaptive] [--chunk-size=N]
+                   [--sched=counter|steal] [--block=N] [--pages=P] [--pin]
+                   <size> <numWorkers>
+
+   numWorkers defaults to the number of online CPUs; there is no upper limit.
+
+   options:
+     --seed=N           seed of the random matrix (default: the current time)
+     --input=FILE       reduce the size x cols matrix in FILE instead of a
+                        random one (the size argument is then ignored)
+     --text=FILE        the same for a text matrix: one row per line, int32
+                        values separated by commas and/or blanks
+     --chunk=fixed      every chunk has --chunk-size rows
+     --chunk=guided     remaining/numWorkers rows, at least --chunk-size (default)
+     --chunk=adaptive   rows this worker can reduce in about ADAPTIVE_QUANTUM
+                        seconds, between --chunk-size and the guided size
+     --chunk-size=N     fixed chunk size or minimum chunk size (default 1)
+     --sched=counter    take chunks from the shared row counter (default)
+     --sched=steal      per-worker work-stealing deques of row blocks
+     --block=N          rows per block for --sched=steal
+                        (default size/(8*numWorkers))
+     --pages=P          matrix pages: default, thp (madvise(MADV_HUGEPAGE)),
+                        or hugetlb (MAP_HUGETLB, needs reserved huge pages)
+     --pin              run worker i on CPU i mod #CPUs, so the NUMA placement
+                        of the first-touch initialization matches the reduction
+     --perf             count cycles, instructions, LLC misses, and branch
+                        misses of each worker (common/perf_counters.h)
 
 */
 #ifndef _REENTRANT 
 #define _REENTRANT 
 #endif 
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np, MAP_HUGETLB */
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
 #include <sys/time.h>
 #include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/reduce_kernel.h"
+#include "../../common/matrix_alloc.h"
+#include "../../common/matrix_file.h"
+#include "../../common/matrix_text.h"
+#include "../../common/perf_counters.h"
+#include "../../common/ws_deque.h"
 
-#define MAXSIZE 10000  /* maximum matrix size */
-#define MAXWORKERS 10   /* maximum number of workers */
+#define DEFAULTSIZE 10000 /* matrix size if not given */
+#define ADAPTIVE_QUANTUM 100e-6 /* target seconds per chunk for --chunk=adaptive */
 
 pthread_mutex_t result_mutex; /* mutex lock for protecting global results */
-pthread_mutex_t row_counter_mutex; /* mutex lock for protecting row counter */
-int next_row_to_process = 0; /* shared row counter */
+atomic_int next_row_to_process = 0; /* shared row counter */
+
+enum { CHUNK_FIXED, CHUNK_GUIDED, CHUNK_ADAPTIVE } chunkMode = CHUNK_GUIDED;
+int chunkSize = 1; /* fixed chunk size, or minimum chunk size */
+
+enum { SCHED_COUNTER, SCHED_STEAL } schedMode = SCHED_COUNTER;
+
+/* a task for --sched=steal: rows first .. first+count-1 */
+typedef struct {
+  int first, count;
+} RowBlock;
+
+RowBlock *blocks;           /* all row blocks, in row order */
+int numBlocks, blockRows = 0;
+WsDeque *deques;            /* one deque of RowBlock pointers per worker */
+atomic_int blocksLeft;      /* blocks not yet reduced; 0 ends the run */
+
+/* load-balance statistics of one worker, written once by that worker */
+typedef struct {
+  int rows, chunks;
+  double busy;
+  int steals, stealAttempts; /* --sched=steal only */
+  double idle;
+} WorkerStats;
+
+WorkerStats *stats; /* one per worker */
 
 /* timer */
 double read_timer() {
@@ -44,67 +124,134 @@ double read_timer() {
 
 double start_time, end_time; /* start and end times */
 int size, numWorkers;  
-int matrix[MAXSIZE][MAXSIZE]; /* matrix */
+const int *matrix; /* size x cols, row-major */
+int cols;          /* == size unless read from --input */
+MatrixStorage storage; /* where matrix is mapped */
+PerfCounters *perfCounters = NULL; /* per worker, with --perf */
 
-// Global results, protected by result_mutex
-long long global_sum = 0;
-int global_min = INT_MAX, global_max = INT_MIN;
-int global_min_row = -1, global_min_col = -1;
-int global_max_row = -1, global_max_col = -1;
+Reduction global; /* global results, protected by result_mutex */
 
 void *Worker(void *);
 
-/* Each worker fetches rows from the shared counter, processes them,
-   and updates global results with mutex protection. */
-void *Worker(void *arg) {
-  long myid = (long) arg;
-  int i, j, row;
-  int local_sum_worker = 0; // Sum for this worker across all rows it processes
-  int local_min_worker = INT_MAX, local_max_worker = INT_MIN;
-  int local_min_row_worker = -1, local_min_col_worker = -1;
-  int local_max_row_worker = -1, local_max_col_worker = -1;
+/* number of rows to ask for next; rowRate is the caller's measured rows/sec
+   (0 if unknown). The remaining count may be stale by the time the chunk is
+   taken, which only makes a guided chunk slightly larger than ideal. */
+int NextChunkSize(double rowRate) {
+  int remaining, guided, chunk;
+
+  if (chunkMode == CHUNK_FIXED)
+    return chunkSize;
+  remaining = size - atomic_load_explicit(&next_row_to_process, memory_order_relaxed);
+  guided = remaining / numWorkers;
+  if (guided < chunkSize) guided = chunkSize;
+  if (chunkMode == CHUNK_GUIDED)
+    return guided;
+  if (rowRate <= 0.0) /* adaptive: the first chunk is a probe */
+    return chunkSize;
+  chunk = (int) (rowRate * ADAPTIVE_QUANTUM);
+  if (chunk < chunkSize) chunk = chunkSize;
+  if (chunk > guided) chunk = guided;
+  return chunk;
+}
+
+/* take chunks of rows from the shared counter and reduce them into local */
+void CounterRows(long myid, Reduction *local) {
+  int row, first, chunk;
+  int rows = 0, chunks = 0;
+  double busy = 0.0, rowRate = 0.0, t0, t;
 
   while (true) {
-    // Atomically get the next row to process
-    pthread_mutex_lock(&row_counter_mutex);
-    row = next_row_to_process;
-    next_row_to_process++;
-    pthread_mutex_unlock(&row_counter_mutex);
+    // Atomically take the next chunk of rows
+    chunk = NextChunkSize(rowRate);
+    first = atomic_fetch_add_explicit(&next_row_to_process, chunk, memory_order_relaxed);
 
-    if (row >= size) { // No more rows to process
+    if (first >= size) { // No more rows to process
       break;
     }
+    if (first + chunk > size) chunk = size - first;
 
-    /* Process this row */
-    for (j = 0; j < size; j++) {
-      local_sum_worker += matrix[row][j];
-      if (matrix[row][j] < local_min_worker) {
-        local_min_worker = matrix[row][j];
-        local_min_row_worker = row;
-        local_min_col_worker = j;
-      }
-      if (matrix[row][j] > local_max_worker) {
-        local_max_worker = matrix[row][j];
-        local_max_row_worker = row;
-        local_max_col_worker = j;
+    /* Process this chunk */
+    t0 = read_timer();
+    for (row = first; row < first + chunk; row++)
+      reduce_row(matrix + (size_t) row * cols, cols, row, local);
+    t = read_timer() - t0;
+    if (t > 0.0) rowRate = chunk / t;
+    busy += t;
+    rows += chunk;
+    chunks++;
+  }
+  stats[myid].rows = rows;
+  stats[myid].chunks = chunks;
+  stats[myid].busy = busy;
+}
+
+/* seed my deque with my strip of row blocks, then reduce blocks from it,
+   stealing from random victims once it runs dry, until no blocks are left */
+void StealRows(long myid, Reduction *local) {
+  WsDeque *mine = &deques[myid];
+  RowBlock *block;
+  unsigned int seed = (unsigned int) myid + 1;
+  int k, row, victim;
+  int rows = 0, chunks = 0, stolen = 0, attempts = 0;
+  double busy = 0.0, idle = 0.0, t0;
+
+  /* pushed in reverse so that I take my blocks in ascending row order */
+  for (k = (myid + 1) * numBlocks / numWorkers - 1; k >= myid * numBlocks / numWorkers; k--)
+    ws_deque_push(mine, &blocks[k]);
+
+  while (atomic_load_explicit(&blocksLeft, memory_order_acquire) > 0) {
+    block = ws_deque_take(mine);
+    if (block == NULL) {
+      t0 = read_timer();
+      while (block == NULL && atomic_load_explicit(&blocksLeft, memory_order_acquire) > 0) {
+        victim = rand_r(&seed) % numWorkers;
+        if (victim == myid) continue;
+        attempts++;
+        block = ws_deque_steal(&deques[victim]);
+        if (block != NULL)
+          stolen++;
+        else
+          sched_yield(); /* let a preempted owner run on an oversubscribed box */
       }
+      idle += read_timer() - t0;
+      if (block == NULL) break;
     }
+
+    /* Process this block */
+    t0 = read_timer();
+    for (row = block->first; row < block->first + block->count; row++)
+      reduce_row(matrix + (size_t) row * cols, cols, row, local);
+    busy += read_timer() - t0;
+    rows += block->count;
+    chunks++;
+    atomic_fetch_sub_explicit(&blocksLeft, 1, memory_order_release);
   }
+  stats[myid].rows = rows;
+  stats[myid].chunks = chunks;
+  stats[myid].busy = busy;
+  stats[myid].steals = stolen;
+  stats[myid].stealAttempts = attempts;
+  stats[myid].idle = idle;
+}
+
+/* Each worker fetches chunks of rows (from the shared counter or from the
+   work-stealing deques), processes them, and updates global results with
+   mutex protection. */
+void *Worker(void *arg) {
+  long myid = (long) arg;
+  Reduction local; // Results for this worker across all rows it processes
+
+  reduction_init(&local);
+  if (perfCounters != NULL) perf_counters_start(&perfCounters[myid]);
+  if (schedMode == SCHED_STEAL)
+    StealRows(myid, &local);
+  else
+    CounterRows(myid, &local);
+  if (perfCounters != NULL) perf_counters_stop(&perfCounters[myid]);
 
   // Update global results with mutex protection after processing all assigned rows
   pthread_mutex_lock(&result_mutex);
-  global_sum += local_sum_worker;
-  
-  if (local_min_worker < global_min) {
-    global_min = local_min_worker;
-    global_min_row = local_min_row_worker;
-    global_min_col = local_min_col_worker;
-  }
-  if (local_max_worker > global_max) {
-    global_max = local_max_worker;
-    global_max_row = local_max_row_worker;
-    global_max_col = local_max_col_worker;
-  }
+  reduction_merge(&global, &local);
   pthread_mutex_unlock(&result_mutex);
 
   return NULL;
@@ -112,38 +259,148 @@ void *Worker(void *arg) {
 
 /* read command line, initialize, and create threads */
 int main(int argc, char *argv[]) {
-  int i, j;
+  int i;
   long l; /* use long in case of a 64-bit system */
   pthread_attr_t attr;
-  pthread_t workerid[MAXWORKERS];
+  pthread_t *workerid;
+  const char *kernelName = "auto";
+  PageMode pageMode = PAGES_DEFAULT;
+  const char *inputPath = NULL, *textPath = NULL;
+  MatrixFile input;
+  MatrixTextInfo textInfo;
+  int *generated;
+  bool pin = false, perfWanted = false;
+  uint64_t seed = time(NULL);
+  double init_time;
+  const char *chunkName = "guided";
+  const char *schedName = "counter";
+  char *args[2];
+  int numArgs = 0;
 
   /* set global thread attributes */
   pthread_attr_init(&attr);
   pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
 
-  /* initialize mutexes */
+  /* initialize mutex */
   pthread_mutex_init(&result_mutex, NULL);
-  pthread_mutex_init(&row_counter_mutex, NULL);
-
-  /* read command line args if any */
-  size = (argc > 1)? atoi(argv[1]) : MAXSIZE;
-  numWorkers = (argc > 2)? atoi(argv[2]) : MAXWORKERS;
-  if (size > MAXSIZE) size = MAXSIZE;
-  if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
-  if (numWorkers == 0) numWorkers = 1; // Ensure at least one worker
-
-  /* initialize the matrix with random values */
-  srand(time(NULL));
-  for (i = 0; i < size; i++) {
-	  for (j = 0; j < size; j++) {
-          matrix[i][j] = rand()%100; // Random values between 0 and 99
-	  }
+
+  /* read command line options, then positional args if any */
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--pages=", 8) == 0) {
+      if (!matrix_parse_pages(argv[i] + 8, &pageMode)) {
+        fprintf(stderr, "Unknown page mode: %s (use default, thp, or hugetlb)\n", argv[i] + 8);
+        exit(1);
+      }
+    }
+    else if (strcmp(argv[i], "--pin") == 0)
+      pin = true;
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--input=", 8) == 0)
+      inputPath = argv[i] + 8;
+    else if (strncmp(argv[i], "--text=", 7) == 0)
+      textPath = argv[i] + 7;
+    else if (strcmp(argv[i], "--perf") == 0)
+      perfWanted = true;
+    else if (strncmp(argv[i], "--chunk=", 8) == 0)
+      chunkName = argv[i] + 8;
+    else if (strncmp(argv[i], "--chunk-size=", 13) == 0)
+      chunkSize = atoi(argv[i] + 13);
+    else if (strncmp(argv[i], "--sched=", 8) == 0)
+      schedName = argv[i] + 8;
+    else if (strncmp(argv[i], "--block=", 8) == 0)
+      blockRows = atoi(argv[i] + 8);
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  if (reduce_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+  if (strcmp(chunkName, "fixed") == 0) chunkMode = CHUNK_FIXED;
+  else if (strcmp(chunkName, "guided") == 0) chunkMode = CHUNK_GUIDED;
+  else if (strcmp(chunkName, "adaptive") == 0) chunkMode = CHUNK_ADAPTIVE;
+  else {
+    fprintf(stderr, "Unknown chunking: %s (use fixed, guided, or adaptive)\n", chunkName);
+    exit(1);
+  }
+  if (chunkSize < 1) chunkSize = 1;
+  if (strcmp(schedName, "counter") == 0) schedMode = SCHED_COUNTER;
+  else if (strcmp(schedName, "steal") == 0) schedMode = SCHED_STEAL;
+  else {
+    fprintf(stderr, "Unknown scheduler: %s (use counter or steal)\n", schedName);
+    exit(1);
+  }
+  size = (numArgs > 0)? atoi(args[0]) : DEFAULTSIZE;
+  numWorkers = (numArgs > 1)? atoi(args[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (size < 1) size = 1;
+  cols = size;
+  if (inputPath != NULL) {
+    matrix = matrix_file_map(inputPath, &input);
+    size = input.header.rows;
+    cols = input.header.cols;
+    if (input.header.elemType != MATRIX_ELEM_INT32) {
+      fprintf(stderr, "%s holds %s elements; only int32 is supported here (see matrixSum_a)\n",
+              inputPath, matrix_elem_name(input.header.elemType));
+      exit(1);
+    }
+  }
+  if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+  if (perfWanted && (perfCounters = calloc(numWorkers, sizeof(PerfCounters))) == NULL) {
+    fprintf(stderr, "Out of memory for %d workers\n", numWorkers);
+    exit(1);
+  }
+  workerid = malloc(numWorkers * sizeof(pthread_t));
+  stats = calloc(numWorkers, sizeof(WorkerStats));
+
+  if (inputPath != NULL) {
+    printf("Reducing the %dx%d matrix in %s\n", size, cols, inputPath);
+  } else if (textPath != NULL) {
+    /* parsed by numWorkers threads into new storage */
+    matrix = matrix_text_load(textPath, numWorkers, pin, pageMode, &storage, &textInfo);
+    size = textInfo.rows;
+    cols = textInfo.cols;
+    matrix_text_report(&textInfo);
+    matrix_text_info_free(&textInfo);
+    printf("Reducing the %dx%d matrix in %s\n", size, cols, textPath);
+  } else {
+    /* allocate the matrix at the requested size and initialize it in
+       parallel with seeded random values, each strip first touched by
+       the worker of that index */
+    generated = matrix_alloc(&storage, size, size, pageMode);
+    init_time = read_timer();
+    matrix_init_parallel(generated, size, size, numWorkers, pin, matrix_fill_random, &seed);
+    init_time = read_timer() - init_time;
+    printf("The initialization time is %g sec (seed %llu)\n", init_time, (unsigned long long) seed);
+    matrix = generated;
+  }
+
+  reduction_init(&global);
+
+  /* cut the matrix into row blocks for the work-stealing scheduler */
+  if (schedMode == SCHED_STEAL) {
+    if (blockRows <= 0) blockRows = size / (8 * numWorkers);
+    if (blockRows <= 0) blockRows = 1;
+    numBlocks = (size + blockRows - 1) / blockRows;
+    blocks = malloc(numBlocks * sizeof(RowBlock));
+    for (i = 0; i < numBlocks; i++) {
+      blocks[i].first = i * blockRows;
+      blocks[i].count = (i == numBlocks - 1) ? size - blocks[i].first : blockRows;
+    }
+    deques = malloc(numWorkers * sizeof(WsDeque));
+    for (i = 0; i < numWorkers; i++)
+      ws_deque_init(&deques[i], numBlocks / numWorkers + 1);
+    atomic_store(&blocksLeft, numBlocks);
   }
 
   /* do the parallel work: create the workers */
   start_time = read_timer();
-  for (l = 0; l < numWorkers; l++)
+  for (l = 0; l < numWorkers; l++) {
+    if (pin) matrix_pin_attr(&attr, l);
     pthread_create(&workerid[l], &attr, Worker, (void *) l);
+  }
   
   // Main thread waits for all workers to finish
   for (l = 0; l < numWorkers; l++)
@@ -152,14 +409,39 @@ int main(int argc, char *argv[]) {
   end_time = read_timer(); /* get end time */
 
   /* print results */
-  printf("The total sum is %%lld\n", global_sum);
-  printf("The minimum element is %%d at (%%d, %%d)\n", global_min, global_min_row, global_min_col);
-  printf("The maximum element is %%d at (%%d, %%d)\n", global_max, global_max_row, global_max_col);
-  printf("The execution time is %%g sec\n", end_time - start_time);
+  printf("The total sum is %lld\n", global.sum);
+  printf("The minimum element is %d at (%d, %d)\n", global.min, global.minRow, global.minCol);
+  printf("The maximum element is %d at (%d, %d)\n", global.max, global.maxRow, global.maxCol);
+  printf("The execution time is %g sec (%s kernel)\n", end_time - start_time, reduce_kernel_name);
+
+  /* print the load balance */
+  if (schedMode == SCHED_STEAL) {
+    printf("%6s %10s %8s %12s %8s %9s %12s\n",
+           "worker", "rows", "blocks", "busy (sec)", "steals", "attempts", "idle (sec)");
+    for (i = 0; i < numWorkers; i++)
+      printf("%6d %10d %8d %12g %8d %9d %12g\n", i, stats[i].rows, stats[i].chunks,
+             stats[i].busy, stats[i].steals, stats[i].stealAttempts, stats[i].idle);
+    for (i = 0; i < numWorkers; i++)
+      ws_deque_destroy(&deques[i]);
+    free(deques);
+    free(blocks);
+  } else {
+    printf("%6s %10s %8s %12s\n", "worker", "rows", "chunks", "busy (sec)");
+    for (i = 0; i < numWorkers; i++)
+      printf("%6d %10d %8d %12g\n", i, stats[i].rows, stats[i].chunks, stats[i].busy);
+  }
+  if (perfCounters != NULL)
+    perf_counters_print(perfCounters, numWorkers, "reduction");
 
-  // Destroy mutexes
+  // Destroy mutex
   pthread_mutex_destroy(&result_mutex);
-  pthread_mutex_destroy(&row_counter_mutex);
+  if (inputPath != NULL)
+    matrix_file_unmap(&input);
+  else
+    matrix_free(&storage);
+  free(stats);
+  free(perfCounters);
+  free(workerid);
 
   return 0; // Main thread exits gracefully
 }
@@ -0,0 +1,237 @@
+/* incremental matrix summation, min, and max using pthreads
+
+   features: builds the summary tree of common/summary_tree.h over a random
+             matrix once, each worker building the row trees of its strip,
+             then applies batches of random (row, col, value) updates. For a
+             batch, each worker applies the updates that fall in its strip
+             (so no two workers touch the same rows), and after a barrier
+             worker 0 refreshes the tree over the rows. The new total sum,
+             min, and max are then at the root, at O(block + log n) per
+             update instead of a full pass over the matrix per query.
+             The workers persist across batches and meet at the barrier of
+             common/barrier.h. At the end the result is checked against a
+             full reduction of the updated matrix.
+
+   usage under Linux:
+     gcc -O2 matrixSum_incremental.c -lpthread -o matrixSum_incremental
+     ./matrixSum_incremental [--kernel=auto|scalar|sse4.1|avx2|avx512] [--seed=N]
+                             [--updates=U] [--batch=K] [--block=B] <size> <numWorkers>
+
+   options:
+     --updates=U    total updates (default 1000000)
+     --batch=K      updates per batch (default 1000)
+     --block=B      columns per leaf block of the row trees (default 256)
+
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np in matrix_alloc.h */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/reduce_kernel.h"
+#include "../../common/matrix_alloc.h"
+#include "../../common/barrier.h"
+#include "../../common/summary_tree.h"
+
+#define DEFAULTSIZE 10000 /* matrix size if not given */
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+int size, numWorkers;
+int *matrix;
+MatrixStorage storage;
+SummaryTree tree;
+ThreadBarrier barrier;
+
+MatrixUpdate *batch;     /* the batch being applied */
+int batchCount;
+bool done = false;       /* no more batches */
+int **dirtyRows;         /* per worker: rows changed by the batch */
+int *numDirty;
+
+void *Worker(void *);
+
+/* apply this worker's share of the current batch */
+static void ApplyStrip(long myid) {
+  int first, last;
+  matrix_strip(myid, numWorkers, size, &first, &last);
+  numDirty[myid] = summary_tree_update_rows(&tree, batch, batchCount, first, last, dirtyRows[myid]);
+}
+
+static void PrintResult(const char *label, const Reduction *r) {
+  printf("%s: sum %lld, min %d at (%d, %d), max %d at (%d, %d)\n", label, r->sum,
+         r->min, r->minRow, r->minCol, r->max, r->maxRow, r->maxCol);
+}
+
+int main(int argc, char *argv[]) {
+  int i, k, numArgs = 0, block = 256, batchSize = 1000, total;
+  long l;
+  long long numUpdates = 1000000, applied;
+  uint64_t seed = time(NULL);
+  pthread_attr_t attr;
+  pthread_t *workerid;
+  char *args[2];
+  const char *kernelName = "auto";
+  double start_time, build_time, update_time, full_time, maxBatch = 0.0, t0;
+  Reduction full;
+  int *allDirty;
+
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--updates=", 10) == 0)
+      numUpdates = atoll(argv[i] + 10);
+    else if (strncmp(argv[i], "--batch=", 8) == 0)
+      batchSize = atoi(argv[i] + 8);
+    else if (strncmp(argv[i], "--block=", 8) == 0)
+      block = atoi(argv[i] + 8);
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  if (reduce_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+  size = (numArgs > 0)? atoi(args[0]) : DEFAULTSIZE;
+  numWorkers = (numArgs > 1)? atoi(args[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (size < 1) size = 1;
+  if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+  if (numWorkers > size) numWorkers = size;
+  if (batchSize <= 0) batchSize = 1;
+  if (numUpdates < 0) numUpdates = 0;
+
+  /* the matrix, then the tree over it, both in parallel by strips */
+  matrix = matrix_alloc(&storage, size, size, PAGES_DEFAULT);
+  matrix_init_parallel(matrix, size, size, numWorkers, false, matrix_fill_random, &seed);
+  summary_tree_init(&tree, matrix, size, size, block);
+
+  batch = malloc(batchSize * sizeof(MatrixUpdate));
+  dirtyRows = malloc(numWorkers * sizeof(int *));
+  numDirty = calloc(numWorkers, sizeof(int));
+  allDirty = malloc((batchSize < size ? batchSize : size) * sizeof(int));
+  workerid = malloc(numWorkers * sizeof(pthread_t));
+  for (l = 0; l < numWorkers; l++)
+    dirtyRows[l] = malloc((batchSize < size ? batchSize : size) * sizeof(int));
+
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  barrier_init(&barrier, BARRIER_CENTRAL, numWorkers);
+
+  /* worker 0 is the main thread */
+  start_time = read_timer();
+  for (l = 1; l < numWorkers; l++)
+    pthread_create(&workerid[l], &attr, Worker, (void *) l);
+  {
+    int first, last;
+    matrix_strip(0, numWorkers, size, &first, &last);
+    summary_tree_build_rows(&tree, first, last);
+  }
+  barrier_wait(&barrier, 0);
+  summary_tree_build_top(&tree);
+  build_time = read_timer() - start_time;
+  printf("Built the summary tree of the %dx%d matrix in %g sec (seed %llu, blocks of %d columns)\n",
+         size, size, build_time, (unsigned long long) seed, tree.block);
+  PrintResult("Initial", summary_tree_result(&tree));
+
+  /* the update batches: element (row, col) of update u comes from the
+     counter-based stream, so a seed gives the same updates */
+  start_time = read_timer();
+  for (applied = 0; applied < numUpdates; applied += batchCount) {
+    batchCount = (numUpdates - applied < batchSize) ? (int) (numUpdates - applied) : batchSize;
+    for (k = 0; k < batchCount; k++) {
+      uint64_t u = 3 * (uint64_t) (applied + k);
+      batch[k].row = (int) counter_rng_below(seed ^ SPLITMIX64_GAMMA, u, size);
+      batch[k].col = (int) counter_rng_below(seed ^ SPLITMIX64_GAMMA, u + 1, size);
+      batch[k].value = (int) counter_rng_below(seed ^ SPLITMIX64_GAMMA, u + 2, 1000) - 450;
+    }
+
+    t0 = read_timer();
+    summary_tree_begin_batch(&tree);
+    barrier_wait(&barrier, 0);   /* the batch is ready */
+    ApplyStrip(0);
+    barrier_wait(&barrier, 0);   /* all strips are applied */
+    for (l = 0, total = 0; l < numWorkers; l++) {
+      memcpy(allDirty + total, dirtyRows[l], numDirty[l] * sizeof(int));
+      total += numDirty[l];
+    }
+    summary_tree_propagate(&tree, allDirty, total);
+    t0 = read_timer() - t0;
+    if (t0 > maxBatch) maxBatch = t0;
+  }
+  update_time = read_timer() - start_time;
+
+  done = true;
+  barrier_wait(&barrier, 0);
+  for (l = 1; l < numWorkers; l++)
+    pthread_join(workerid[l], NULL);
+
+  /* check against a full pass over the updated matrix */
+  full_time = read_timer();
+  reduction_init(&full);
+  for (i = 0; i < size; i++)
+    reduce_row(matrix + (size_t) i * size, size, i, &full);
+  full_time = read_timer() - full_time;
+
+  PrintResult("Updated", summary_tree_result(&tree));
+  printf("Applied %lld updates in batches of %d in %g sec (%g updates/sec, slowest batch %g sec)\n",
+         numUpdates, batchSize, update_time, update_time > 0 ? numUpdates / update_time : 0.0, maxBatch);
+  printf("A full sequential pass takes %g sec (%s kernel)\n", full_time, reduce_kernel_name);
+  if (memcmp(&full, summary_tree_result(&tree), sizeof(Reduction)) != 0) {
+    PrintResult("Full pass", &full);
+    printf("The summary tree disagrees with the full pass\n");
+    return 1;
+  }
+
+  barrier_destroy(&barrier);
+  pthread_attr_destroy(&attr);
+  summary_tree_destroy(&tree);
+  matrix_free(&storage);
+  for (l = 0; l < numWorkers; l++)
+    free(dirtyRows[l]);
+  free(dirtyRows);
+  free(numDirty);
+  free(allDirty);
+  free(batch);
+  free(workerid);
+  return 0;
+}
+
+/* Each worker builds the row trees of its strip, then applies its share of
+   every batch between two barriers until main says done. */
+void *Worker(void *arg) {
+  long myid = (long) arg;
+  int first, last;
+
+  matrix_strip(myid, numWorkers, size, &first, &last);
+  summary_tree_build_rows(&tree, first, last);
+  barrier_wait(&barrier, myid);
+
+  for (;;) {
+    barrier_wait(&barrier, myid);   /* a batch is ready, or done */
+    if (done) break;
+    ApplyStrip(myid);
+    barrier_wait(&barrier, myid);
+  }
+  return NULL;
+}
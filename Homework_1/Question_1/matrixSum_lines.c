@@ -0,0 +1,411 @@
+/* per-row and per-column sum, min, and max using pthreads
+
+   features: computes one Reduction (sum, min, max with positions) per row
+             and per column of the matrix instead of one for the whole
+             matrix. Rows are reduced by the SIMD kernel of
+             common/reduce_kernel.h, each worker taking a strip of rows.
+             Columns are reduced by one of three paths (--path):
+               naive       each worker walks down its own columns, one
+                           element per row: a cache line is used for one
+                           int before the next row evicts it
+               tiled       each worker streams its strip of rows a band of
+                           TILE_COLS columns at a time, updating per-column
+                           accumulators that stay in L1; after a barrier each
+                           worker merges all workers' accumulators for its
+                           own columns
+               transposed  the workers transpose their strips with the
+                           cache-oblivious transpose of common/transpose.h
+                           and, after a barrier, reduce the rows of the
+                           transpose with the SIMD kernel
+             All paths keep the first (topmost) position of a column's min
+             and max, so they give identical vectors; --bench times them
+             (median of BENCH_RUNS) and checks that they agree.
+
+   usage under Linux:
+     gcc -O2 matrixSum_lines.c -lpthread -o matrixSum_lines
+     ./matrixSum_lines [--kernel=auto|scalar|sse4.1|avx2|avx512] [--seed=N] [--input=FILE]
+                       [--path=naive|tiled|transposed] [--show=K] [--bench] <size> <numWorkers>
+
+   options:
+     --path=P       how columns are reduced (default tiled)
+     --show=K       print the results of the first K rows and columns
+     --bench        time the row pass and each column path
+     --input=FILE   reduce the int32 matrix in FILE (the size argument is then ignored)
+
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np in matrix_alloc.h */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/reduce_kernel.h"
+#include "../../common/typed_kernel.h"
+#include "../../common/matrix_alloc.h"
+#include "../../common/matrix_file.h"
+#include "../../common/barrier.h"
+#include "../../common/transpose.h"
+
+#define DEFAULTSIZE 10000 /* matrix size if not given */
+#define TILE_COLS 1024    /* columns per band of the tiled path: 20 KB of accumulators */
+#define BENCH_RUNS 5      /* runs per pass in --bench, median is reported */
+
+typedef enum { PATH_NONE, PATH_NAIVE, PATH_TILED, PATH_TRANSPOSED } ColumnPath;
+static const char *pathNames[] = { "none", "naive", "tiled", "transposed" };
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+/* per-column accumulators of one worker for the tiled path */
+typedef struct {
+  long long *sum;
+  int *min, *minRow, *max, *maxRow;
+  bool empty;      /* the worker has no rows */
+} ColumnAcc;
+
+int rows, cols, numWorkers;
+const int *matrix;
+Reduction *rowStats;     /* rows entries */
+Reduction *colStats;     /* cols entries */
+ColumnAcc *accs;         /* per worker, for the tiled path */
+int *transposed;         /* cols x rows, for the transposed path */
+MatrixStorage transposedStorage;
+ThreadBarrier barrier;
+bool doRows;             /* the current run reduces the rows */
+ColumnPath path;         /* how the current run reduces the columns */
+double transposeTime;    /* of the last transposed run, measured by worker 0 */
+
+void *Worker(void *);
+
+/* update the accumulators of columns 0..n-1 with row i; written without
+   branches, and with restrict so gcc knows the arrays are distinct, so it
+   vectorizes (in chunks of TYPED_CHUNK indexed j + k, k from 0: gcc at -O2
+   needs the constant trip count). Compiled for the baseline ISA and with target("avx2") (the
+   baseline has no vector sign extension for the 64-bit sums), picked at
+   runtime as in typed_kernel.h. */
+#define ACCUMULATE_ELEMENT(j)                                                 \
+  {                                                                           \
+    int v = row[j];                                                           \
+    sum[j] += v;                                                              \
+    mnRow[j] = (v < mn[j]) ? i : mnRow[j];                                    \
+    mn[j] = (v < mn[j]) ? v : mn[j];                                          \
+    mxRow[j] = (v > mx[j]) ? i : mxRow[j];                                    \
+    mx[j] = (v > mx[j]) ? v : mx[j];                                          \
+  }
+#define ACCUMULATE_ROW_BODY                                                   \
+  int j, k;                                                                   \
+  for (j = 0; j + TYPED_CHUNK <= n; j += TYPED_CHUNK)                         \
+    for (k = 0; k < TYPED_CHUNK; k++)                                         \
+      ACCUMULATE_ELEMENT(j + k)                                               \
+  for (; j < n; j++)                                                          \
+    ACCUMULATE_ELEMENT(j)
+
+typedef void (*AccumulateFn)(const int *restrict row, int i, int n, long long *restrict sum,
+                             int *restrict mn, int *restrict mnRow, int *restrict mx, int *restrict mxRow);
+
+static void AccumulateRowBaseline(const int *restrict row, int i, int n, long long *restrict sum,
+                                  int *restrict mn, int *restrict mnRow, int *restrict mx, int *restrict mxRow) {
+  ACCUMULATE_ROW_BODY
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("avx2")))
+static void AccumulateRowAvx2(const int *restrict row, int i, int n, long long *restrict sum,
+                              int *restrict mn, int *restrict mnRow, int *restrict mx, int *restrict mxRow) {
+  ACCUMULATE_ROW_BODY
+}
+#endif
+
+AccumulateFn AccumulateRow = AccumulateRowBaseline;
+
+/* run the workers once; returns the time */
+static double Run(bool rowsToo, ColumnPath columns) {
+  pthread_attr_t attr;
+  pthread_t *workerid = malloc(numWorkers * sizeof(pthread_t));
+  double start_time;
+  long l;
+
+  doRows = rowsToo;
+  path = columns;
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  start_time = read_timer();
+  for (l = 0; l < numWorkers; l++)
+    pthread_create(&workerid[l], &attr, Worker, (void *) l);
+  for (l = 0; l < numWorkers; l++)
+    pthread_join(workerid[l], NULL);
+  start_time = read_timer() - start_time;
+  pthread_attr_destroy(&attr);
+  free(workerid);
+  return start_time;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* median time of BENCH_RUNS runs */
+static double MedianRun(bool rowsToo, ColumnPath columns, double *medianTranspose) {
+  double times[BENCH_RUNS], transposes[BENCH_RUNS];
+  int run;
+  for (run = 0; run < BENCH_RUNS; run++) {
+    times[run] = Run(rowsToo, columns);
+    transposes[run] = transposeTime;
+  }
+  qsort(times, BENCH_RUNS, sizeof(double), compare_doubles);
+  qsort(transposes, BENCH_RUNS, sizeof(double), compare_doubles);
+  if (medianTranspose != NULL) *medianTranspose = transposes[BENCH_RUNS/2];
+  return times[BENCH_RUNS/2];
+}
+
+static void PrintLine(const char *kind, int index, const Reduction *r) {
+  printf("%s %d: sum %lld, min %d at (%d, %d), max %d at (%d, %d)\n", kind, index, r->sum,
+         r->min, r->minRow, r->minCol, r->max, r->maxRow, r->maxCol);
+}
+
+int main(int argc, char *argv[]) {
+  int i, numArgs = 0, show = 0;
+  long l;
+  const char *kernelName = "auto", *inputPath = NULL;
+  uint64_t seed = time(NULL);
+  char *args[2];
+  bool bench = false;
+  ColumnPath columns = PATH_TILED;
+  MatrixFile input;
+  MatrixStorage storage;
+  int *generated;
+  long long rowTotal = 0, colTotal = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--input=", 8) == 0)
+      inputPath = argv[i] + 8;
+    else if (strncmp(argv[i], "--path=", 7) == 0) {
+      for (columns = PATH_NAIVE; columns <= PATH_TRANSPOSED; columns++)
+        if (strcmp(argv[i] + 7, pathNames[columns]) == 0) break;
+      if (columns > PATH_TRANSPOSED) {
+        fprintf(stderr, "Unknown path: %s (use naive, tiled, or transposed)\n", argv[i] + 7);
+        exit(1);
+      }
+    }
+    else if (strncmp(argv[i], "--show=", 7) == 0)
+      show = atoi(argv[i] + 7);
+    else if (strcmp(argv[i], "--bench") == 0)
+      bench = true;
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  if (reduce_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+#if defined(__x86_64__) || defined(__i386__)
+  if (typed_kernel_avx2(kernelName))
+    AccumulateRow = AccumulateRowAvx2;
+#endif
+  rows = cols = (numArgs > 0)? atoi(args[0]) : DEFAULTSIZE;
+  numWorkers = (numArgs > 1)? atoi(args[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+  if (rows < 1) rows = cols = 1;
+  if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+
+  if (inputPath != NULL) {
+    matrix = matrix_file_map(inputPath, &input);
+    rows = input.header.rows;
+    cols = input.header.cols;
+    if (input.header.elemType != MATRIX_ELEM_INT32) {
+      fprintf(stderr, "%s holds %s elements; only int32 is supported here\n",
+              inputPath, matrix_elem_name(input.header.elemType));
+      exit(1);
+    }
+  } else {
+    generated = matrix_alloc(&storage, rows, cols, PAGES_DEFAULT);
+    matrix_init_parallel(generated, rows, cols, numWorkers, false, matrix_fill_random, &seed);
+    matrix = generated;
+  }
+
+  rowStats = malloc(rows * sizeof(Reduction));
+  colStats = malloc(cols * sizeof(Reduction));
+  accs = malloc(numWorkers * sizeof(ColumnAcc));
+  if (rowStats == NULL || colStats == NULL || accs == NULL) {
+    fprintf(stderr, "Out of memory for the result vectors\n");
+    exit(1);
+  }
+  for (l = 0; l < numWorkers; l++) {
+    accs[l].sum = malloc(cols * sizeof(long long));
+    accs[l].min = malloc(cols * sizeof(int));
+    accs[l].minRow = malloc(cols * sizeof(int));
+    accs[l].max = malloc(cols * sizeof(int));
+    accs[l].maxRow = malloc(cols * sizeof(int));
+    if (accs[l].sum == NULL || accs[l].min == NULL || accs[l].minRow == NULL ||
+        accs[l].max == NULL || accs[l].maxRow == NULL) {
+      fprintf(stderr, "Out of memory for the column accumulators\n");
+      exit(1);
+    }
+  }
+  transposed = matrix_alloc(&transposedStorage, cols, rows, PAGES_DEFAULT);
+  barrier_init(&barrier, BARRIER_CENTRAL, numWorkers);
+
+  if (bench) {
+    Reduction *reference = malloc(cols * sizeof(Reduction));
+    double t, tt;
+    ColumnPath p;
+    bool agree = true;
+
+    printf("Row and column reductions, %dx%d matrix, %d workers (median of %d runs, %s kernel)\n",
+           rows, cols, numWorkers, BENCH_RUNS, reduce_kernel_name);
+    printf("%-22s %12s %10s\n", "pass", "time (sec)", "GB/s");
+    t = MedianRun(true, PATH_NONE, NULL);
+    printf("%-22s %12g %10.2f\n", "rows", t, (double) rows * cols * sizeof(int) / t / 1e9);
+    for (p = PATH_NAIVE; p <= PATH_TRANSPOSED; p++) {
+      char label[64];
+      t = MedianRun(false, p, &tt);
+      snprintf(label, sizeof(label), "columns, %s", pathNames[p]);
+      printf("%-22s %12g %10.2f", label, t, (double) rows * cols * sizeof(int) / t / 1e9);
+      if (p == PATH_TRANSPOSED)
+        printf("   (transpose %g sec)", tt);
+      printf("\n");
+      if (p == PATH_NAIVE)
+        memcpy(reference, colStats, cols * sizeof(Reduction));
+      else if (memcmp(reference, colStats, cols * sizeof(Reduction)) != 0) {
+        printf("The %s column results differ from the naive ones\n", pathNames[p]);
+        agree = false;
+      }
+    }
+    free(reference);
+    if (!agree) return 1;
+  } else {
+    double t = Run(true, columns);
+    for (i = 0; i < rows; i++) rowTotal += rowStats[i].sum;
+    for (i = 0; i < cols; i++) colTotal += colStats[i].sum;
+    for (i = 0; i < show && i < rows; i++) PrintLine("Row", i, &rowStats[i]);
+    for (i = 0; i < show && i < cols; i++) PrintLine("Column", i, &colStats[i]);
+    printf("Reduced %d rows and %d columns in %g sec (%s columns, %s kernel)\n", rows, cols, t,
+           pathNames[columns], reduce_kernel_name);
+    printf("The total sum is %lld by rows and %lld by columns\n", rowTotal, colTotal);
+    if (rowTotal != colTotal) return 1;
+  }
+
+  barrier_destroy(&barrier);
+  matrix_free(&transposedStorage);
+  for (l = 0; l < numWorkers; l++) {
+    free(accs[l].sum);
+    free(accs[l].min);
+    free(accs[l].minRow);
+    free(accs[l].max);
+    free(accs[l].maxRow);
+  }
+  free(accs);
+  free(rowStats);
+  free(colStats);
+  if (inputPath != NULL)
+    matrix_file_unmap(&input);
+  else
+    matrix_free(&storage);
+  return 0;
+}
+
+/* Each worker reduces the rows of its strip (if asked), then its share of
+   the columns by the current path. */
+void *Worker(void *arg) {
+  long myid = (long) arg;
+  int first, last, c0, c1, i, j, w, b;
+
+  matrix_strip(myid, numWorkers, rows, &first, &last);
+  matrix_strip(myid, numWorkers, cols, &c0, &c1);
+  if (c0 > c1) c0 = c1 + 1; /* more workers than columns */
+
+  if (doRows)
+    for (i = first; i <= last; i++) {
+      reduction_init(&rowStats[i]);
+      reduce_row(matrix + (size_t) i * cols, cols, i, &rowStats[i]);
+    }
+
+  switch (path) {
+  case PATH_NONE:
+    break;
+
+  case PATH_NAIVE:
+    for (j = c0; j <= c1; j++) {
+      Reduction r;
+      reduction_init(&r);
+      for (i = 0; i < rows; i++) {
+        int v = matrix[(size_t) i * cols + j];
+        r.sum += v;
+        if (v < r.min) { r.min = v; r.minRow = i; r.minCol = j; }
+        if (v > r.max) { r.max = v; r.maxRow = i; r.maxCol = j; }
+      }
+      colStats[j] = r;
+    }
+    break;
+
+  case PATH_TILED: {
+    ColumnAcc *acc = &accs[myid];
+    acc->empty = first > last;
+    for (b = 0; b < cols && !acc->empty; b += TILE_COLS) {
+      int n = (cols - b < TILE_COLS) ? cols - b : TILE_COLS;
+      for (j = b; j < b + n; j++) {
+        acc->sum[j] = 0;
+        acc->min[j] = acc->max[j] = matrix[(size_t) first * cols + j];
+        acc->minRow[j] = acc->maxRow[j] = first;
+      }
+      for (i = first; i <= last; i++)
+        AccumulateRow(matrix + (size_t) i * cols + b, i, n, acc->sum + b, acc->min + b,
+                      acc->minRow + b, acc->max + b, acc->maxRow + b);
+    }
+    barrier_wait(&barrier, myid);
+    /* merge in worker order, so a tie keeps the upper strip's row */
+    for (j = c0; j <= c1; j++) {
+      Reduction r;
+      reduction_init(&r);
+      for (w = 0; w < numWorkers; w++) {
+        const ColumnAcc *a = &accs[w];
+        if (a->empty) continue;
+        r.sum += a->sum[j];
+        if (r.minRow < 0 || a->min[j] < r.min) { r.min = a->min[j]; r.minRow = a->minRow[j]; r.minCol = j; }
+        if (r.maxRow < 0 || a->max[j] > r.max) { r.max = a->max[j]; r.maxRow = a->maxRow[j]; r.maxCol = j; }
+      }
+      colStats[j] = r;
+    }
+    break;
+  }
+
+  case PATH_TRANSPOSED: {
+    double t = read_timer();
+    transpose_rows(matrix, rows, cols, transposed, first, last);
+    barrier_wait(&barrier, myid);
+    if (myid == 0) transposeTime = read_timer() - t;
+    /* row j of the transpose is column j; swap the positions back */
+    for (j = c0; j <= c1; j++) {
+      Reduction r;
+      reduction_init(&r);
+      reduce_row(transposed + (size_t) j * rows, rows, j, &r);
+      colStats[j].sum = r.sum;
+      colStats[j].min = r.min; colStats[j].minRow = r.minCol; colStats[j].minCol = j;
+      colStats[j].max = r.max; colStats[j].maxRow = r.maxCol; colStats[j].maxCol = j;
+    }
+    break;
+  }
+  }
+  return NULL;
+}
@@ -0,0 +1,251 @@
+/* throughput of repeated matrix reductions using pthreads
+
+   features: reduces a stream of small and medium matrices two ways and
+             reports matrices per second and the median and 99th percentile
+             latency of each:
+               spawn  one matrix at a time, creating and joining numWorkers
+                      threads per matrix over strips of rows, the way one
+                      run of matrixSum_a works
+               pool   the persistent worker pool of common/matrix_pool.h,
+                      with up to --inflight matrices submitted and not yet
+                      waited on
+             The stream cycles over DISTINCT small and DISTINCT medium random
+             matrices (every --medium-every-th matrix is a medium one), and
+             every result is checked against a sequential reduction.
+             Both modes reduce rows with the SIMD kernel of
+             common/reduce_kernel.h picked by --kernel, as in matrixSum_a.
+             Pool latency runs from submission to completion, so it includes
+             the time a matrix waits behind the others in flight.
+
+   usage under Linux:
+     gcc -O2 matrixSum_pool.c -lpthread -o matrixSum_pool
+     ./matrixSum_pool [--kernel=auto|scalar|sse4.1|avx2|avx512] [--matrices=N] [--small=S]
+                      [--medium=M] [--medium-every=K] [--inflight=W] [--seed=N] [numWorkers]
+
+   options:
+     --kernel=K         the row reduction kernel (default auto: the widest supported)
+     --matrices=N       matrices in the stream (default 20000)
+     --small=S          small matrices are S x S (default 32)
+     --medium=M         medium matrices are M x M (default 512)
+     --medium-every=K   every K-th matrix is medium (default 10)
+     --inflight=W       pool: matrices submitted ahead of the oldest wait (default 64)
+
+   numWorkers defaults to the number of online CPUs.
+
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np in matrix_alloc.h */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include "../../common/reduce_kernel.h"
+#include "../../common/matrix_alloc.h"
+#include "../../common/matrix_pool.h"
+
+#define DISTINCT 8 /* distinct matrices of each size in the stream */
+
+int numWorkers, numMatrices = 20000, smallSize = 32, mediumSize = 512, mediumEvery = 10;
+int inflight = 64;
+int *smallMatrices[DISTINCT], *mediumMatrices[DISTINCT];
+Reduction smallExpected[DISTINCT], mediumExpected[DISTINCT];
+double *latencies;
+int mismatches = 0;
+
+/* matrix j of the stream, its size, and its sequentially computed result */
+static const int *StreamMatrix(int j, int *n, const Reduction **expected) {
+  if (j % mediumEvery == 0) {
+    *n = mediumSize;
+    *expected = &mediumExpected[(j / mediumEvery) % DISTINCT];
+    return mediumMatrices[(j / mediumEvery) % DISTINCT];
+  }
+  *n = smallSize;
+  *expected = &smallExpected[j % DISTINCT];
+  return smallMatrices[j % DISTINCT];
+}
+
+static void Check(const Reduction *got, const Reduction *expected) {
+  if (got->sum != expected->sum || got->min != expected->min || got->max != expected->max ||
+      got->minRow != expected->minRow || got->minCol != expected->minCol ||
+      got->maxRow != expected->maxRow || got->maxCol != expected->maxCol)
+    mismatches++;
+}
+
+/* spawn mode: the strips of one matrix, as in matrixSum_a's Worker */
+typedef struct {
+  const int *m;
+  int size;
+  long id;
+  Reduction r;
+} SpawnTask;
+
+void *SpawnWorker(void *arg) {
+  SpawnTask *t = arg;
+  int i, first_row, last_row;
+
+  matrix_strip(t->id, numWorkers, t->size, &first_row, &last_row);
+  reduction_init(&t->r);
+  for (i = first_row; i <= last_row; i++)
+    reduce_row(t->m + (size_t) i * t->size, t->size, i, &t->r);
+  return NULL;
+}
+
+static double RunSpawn(void) {
+  pthread_t *workerid = malloc(numWorkers * sizeof(pthread_t));
+  SpawnTask *tasks = malloc(numWorkers * sizeof(SpawnTask));
+  pthread_attr_t attr;
+  const Reduction *expected;
+  Reduction global;
+  double start, t0;
+  int j, n;
+  long l;
+
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  start = matrix_pool_now();
+  for (j = 0; j < numMatrices; j++) {
+    const int *m = StreamMatrix(j, &n, &expected);
+    t0 = matrix_pool_now();
+    for (l = 0; l < numWorkers; l++) {
+      tasks[l].m = m;
+      tasks[l].size = n;
+      tasks[l].id = l;
+      pthread_create(&workerid[l], &attr, SpawnWorker, &tasks[l]);
+    }
+    reduction_init(&global);
+    for (l = 0; l < numWorkers; l++) {
+      pthread_join(workerid[l], NULL);
+      reduction_merge(&global, &tasks[l].r);
+    }
+    latencies[j] = matrix_pool_now() - t0;
+    Check(&global, expected);
+  }
+  start = matrix_pool_now() - start;
+  pthread_attr_destroy(&attr);
+  free(tasks);
+  free(workerid);
+  return start;
+}
+
+/* pool mode: keep up to inflight futures outstanding, oldest first */
+static double RunPool(void) {
+  MatrixFuture **window = malloc(inflight * sizeof(MatrixFuture *));
+  const Reduction **expected = malloc(inflight * sizeof(Reduction *));
+  MatrixPool *pool = matrix_pool_create(numWorkers);
+  Reduction r;
+  double start;
+  int j, n;
+
+  start = matrix_pool_now();
+  for (j = 0; j < numMatrices + inflight; j++) {
+    int w = j % inflight;
+    if (j >= inflight) { /* retire matrix j - inflight */
+      MatrixFuture *f = window[w];
+      r = matrix_pool_wait(f);
+      latencies[j - inflight] = f->completeTime - f->submitTime;
+      Check(&r, expected[w]);
+      matrix_future_free(f);
+    }
+    if (j < numMatrices) {
+      const int *m = StreamMatrix(j, &n, &expected[w]);
+      window[w] = matrix_pool_submit(pool, m, n, n);
+    }
+  }
+  start = matrix_pool_now() - start;
+  matrix_pool_destroy(pool);
+  free(expected);
+  free(window);
+  return start;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static void Report(const char *mode, double elapsed) {
+  qsort(latencies, numMatrices, sizeof(double), compare_doubles);
+  printf("%-6s %12.0f %12.1f %12.1f %12.1f\n", mode, numMatrices / elapsed,
+         latencies[numMatrices / 2] * 1e6, latencies[(int) (numMatrices * 0.99)] * 1e6,
+         latencies[numMatrices - 1] * 1e6);
+}
+
+int main(int argc, char *argv[]) {
+  int i, k;
+  uint64_t seed = time(NULL), s;
+  const char *kernelName = "auto";
+
+  numWorkers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--matrices=", 11) == 0)
+      numMatrices = atoi(argv[i] + 11);
+    else if (strncmp(argv[i], "--small=", 8) == 0)
+      smallSize = atoi(argv[i] + 8);
+    else if (strncmp(argv[i], "--medium=", 9) == 0)
+      mediumSize = atoi(argv[i] + 9);
+    else if (strncmp(argv[i], "--medium-every=", 15) == 0)
+      mediumEvery = atoi(argv[i] + 15);
+    else if (strncmp(argv[i], "--inflight=", 11) == 0)
+      inflight = atoi(argv[i] + 11);
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else
+      numWorkers = atoi(argv[i]);
+  }
+  if (numWorkers <= 0) numWorkers = 1;
+  if (numMatrices <= 0) numMatrices = 1;
+  if (smallSize <= 0) smallSize = 1;
+  if (mediumSize <= 0) mediumSize = 1;
+  if (mediumEvery <= 0) mediumEvery = 1;
+  if (inflight <= 0) inflight = 1;
+  if (reduce_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+
+  /* the distinct matrices and their sequential results */
+  for (k = 0; k < DISTINCT; k++) {
+    smallMatrices[k] = malloc((size_t) smallSize * smallSize * sizeof(int));
+    mediumMatrices[k] = malloc((size_t) mediumSize * mediumSize * sizeof(int));
+    if (smallMatrices[k] == NULL || mediumMatrices[k] == NULL) {
+      fprintf(stderr, "Out of memory for the matrices\n");
+      exit(1);
+    }
+    s = seed + 2 * k;
+    matrix_fill_random(smallMatrices[k], smallSize, 0, smallSize - 1, &s);
+    s = seed + 2 * k + 1;
+    matrix_fill_random(mediumMatrices[k], mediumSize, 0, mediumSize - 1, &s);
+    reduction_init(&smallExpected[k]);
+    for (i = 0; i < smallSize; i++)
+      reduce_row(smallMatrices[k] + (size_t) i * smallSize, smallSize, i, &smallExpected[k]);
+    reduction_init(&mediumExpected[k]);
+    for (i = 0; i < mediumSize; i++)
+      reduce_row(mediumMatrices[k] + (size_t) i * mediumSize, mediumSize, i, &mediumExpected[k]);
+  }
+  latencies = malloc(numMatrices * sizeof(double));
+
+  printf("%d matrices (%dx%d, every %d-th %dx%d), %d workers, %d in flight, %s kernel, seed %llu\n",
+         numMatrices, smallSize, smallSize, mediumEvery, mediumSize, mediumSize, numWorkers,
+         inflight, reduce_kernel_name, (unsigned long long) seed);
+  printf("%-6s %12s %12s %12s %12s\n", "mode", "matrices/s", "p50 (us)", "p99 (us)", "max (us)");
+  Report("spawn", RunSpawn());
+  Report("pool", RunPool());
+  if (mismatches > 0) {
+    printf("%d results differ from the sequential reduction\n", mismatches);
+    return 1;
+  }
+
+  for (k = 0; k < DISTINCT; k++) {
+    free(smallMatrices[k]);
+    free(mediumMatrices[k]);
+  }
+  free(latencies);
+  return 0;
+}
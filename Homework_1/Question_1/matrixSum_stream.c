@@ -0,0 +1,333 @@
+/* out-of-core matrix summation, min, and max using pthreads
+
+   features: reduces a binary matrix file (common/matrix_file.h) that may be
+             larger than memory. An I/O thread reads the matrix in blocks of
+             rows with pread into a ring of 2 (double buffering) or 3 (triple
+             buffering) buffers while the workers reduce the previous block;
+             each worker takes one strip of every block. A buffer is handed
+             back to the I/O thread once all workers are done with it.
+             With --direct the file is opened with O_DIRECT and bypasses the
+             page cache; otherwise the pages of each consumed block are
+             dropped with posix_fadvise(POSIX_FADV_DONTNEED), so a pass over
+             a huge file does not evict everything else.
+             Prints the results, then the I/O and compute throughput, each
+             from the time its side was busy, and how long each side waited
+             for the other, which shows which one is the bottleneck.
+
+   usage under Linux:
+     gcc -O2 matrixSum_stream.c -lpthread -o matrixSum_stream
+     ./matrixSum_stream [--kernel=auto|scalar|sse4.1|avx2|avx512] [--buffers=2|3]
+                        [--block-mb=N] [--direct] <file> <numWorkers>
+
+   options:
+     --buffers=N    number of block buffers, 2 or 3 (default 3)
+     --block-mb=N   approximate block size in MB (default 64)
+     --direct       read with O_DIRECT
+
+*/
+#ifndef _REENTRANT
+#define _REENTRANT
+#endif
+#define _GNU_SOURCE /* O_DIRECT */
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <sys/time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/reduce_kernel.h"
+#include "../../common/matrix_file.h"
+
+#define DIRECT_ALIGN 4096 /* O_DIRECT offset, length, and buffer alignment */
+
+/* one slot of the buffer ring */
+typedef struct {
+  char *memory;      /* DIRECT_ALIGN-aligned allocation */
+  const int *rows;   /* first row of the block inside memory */
+  long long block;   /* block held, -1 if the buffer is free */
+  int numRows;       /* rows in the block */
+  int workersDone;   /* workers finished with the block */
+} Buffer;
+
+pthread_mutex_t ring_mutex; /* protects the ring and the wait times */
+pthread_cond_t filled;      /* signalled when a block has been read */
+pthread_cond_t freed;       /* signalled when a buffer is free again */
+Buffer *ring;
+int numBuffers = 3;
+
+pthread_mutex_t result_mutex; /* mutex lock for protecting global results */
+Reduction global;
+
+/* timer */
+double read_timer() {
+    static bool initialized = false;
+    static struct timeval start;
+    struct timeval end;
+    if( !initialized )
+    {
+        gettimeofday( &start, NULL );
+        initialized = true;
+    }
+    gettimeofday( &end, NULL );
+    return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+}
+
+double start_time, end_time; /* start and end times */
+int numWorkers;
+int fd;                      /* the matrix file */
+bool direct = false;
+MatrixFileHeader header;
+int cols, blockRows;
+long long numBlocks;
+size_t rowBytes;
+
+double ioBusy = 0.0, ioWait = 0.0; /* I/O thread: reading, waiting for a free buffer */
+double *computeBusy, *computeWait; /* per worker: reducing, waiting for a block */
+
+void *Reader(void *);
+void *Worker(void *);
+
+int main(int argc, char *argv[]) {
+  int i;
+  long l; /* use long in case of a 64-bit system */
+  pthread_attr_t attr;
+  pthread_t *workerid, readerid;
+  const char *kernelName = "auto";
+  char *args[2];
+  int numArgs = 0;
+  long blockMB = 64;
+  double maxBusy = 0.0, maxWait = 0.0, bytes;
+
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--buffers=", 10) == 0)
+      numBuffers = atoi(argv[i] + 10);
+    else if (strncmp(argv[i], "--block-mb=", 11) == 0)
+      blockMB = atol(argv[i] + 11);
+    else if (strcmp(argv[i], "--direct") == 0)
+      direct = true;
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  if (numArgs < 2) {
+    fprintf(stderr, "Usage: %s [--kernel=K] [--buffers=2|3] [--block-mb=N] [--direct] <file> <numWorkers>\n",
+            argv[0]);
+    exit(1);
+  }
+  if (reduce_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+  if (numBuffers < 2 || numBuffers > 3) {
+    fprintf(stderr, "--buffers must be 2 or 3\n");
+    exit(1);
+  }
+  numWorkers = atoi(args[1]);
+  if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+  if (blockMB <= 0) blockMB = 1;
+
+  /* check the header through the page cache (an O_DIRECT read of it would
+     have to be aligned), then reopen the file for streaming */
+  fd = open(args[0], O_RDONLY);
+  if (fd < 0) {
+    perror(args[0]);
+    exit(1);
+  }
+  matrix_file_read_header(fd, args[0], &header);
+  if (direct) {
+    close(fd);
+    fd = open(args[0], O_RDONLY | O_DIRECT);
+    if (fd < 0) {
+      perror("open(O_DIRECT)");
+      exit(1);
+    }
+  }
+  if (header.elemType != MATRIX_ELEM_INT32) {
+    fprintf(stderr, "%s: only int32 matrices can be streamed\n", args[0]);
+    exit(1);
+  }
+  cols = header.cols;
+  rowBytes = (size_t) cols * sizeof(int);
+  blockRows = (blockMB << 20) / (rowBytes ? rowBytes : 1);
+  if (blockRows < 1) blockRows = 1;
+  if (blockRows > (long long) header.rows) blockRows = header.rows;
+  numBlocks = (header.rows + blockRows - 1) / (blockRows ? blockRows : 1);
+  if (!direct)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+  /* the ring: room for a block plus alignment slack at both ends for O_DIRECT */
+  ring = malloc(numBuffers * sizeof(Buffer));
+  for (i = 0; i < numBuffers; i++) {
+    if (posix_memalign((void **) &ring[i].memory, DIRECT_ALIGN,
+                       blockRows * rowBytes + 2 * DIRECT_ALIGN) != 0) {
+      fprintf(stderr, "Out of memory for %d buffers of %d rows\n", numBuffers, blockRows);
+      exit(1);
+    }
+    ring[i].block = -1;
+  }
+  workerid = malloc(numWorkers * sizeof(pthread_t));
+  computeBusy = calloc(numWorkers, sizeof(double));
+  computeWait = calloc(numWorkers, sizeof(double));
+
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  pthread_mutex_init(&ring_mutex, NULL);
+  pthread_mutex_init(&result_mutex, NULL);
+  pthread_cond_init(&filled, NULL);
+  pthread_cond_init(&freed, NULL);
+  reduction_init(&global);
+
+  printf("Streaming the %llux%llu matrix in %s: %lld blocks of %d rows, %d buffers%s\n",
+         (unsigned long long) header.rows, (unsigned long long) header.cols, args[0],
+         numBlocks, blockRows, numBuffers, direct ? ", O_DIRECT" : "");
+
+  /* do the parallel work: create the reader and the workers */
+  start_time = read_timer();
+  pthread_create(&readerid, &attr, Reader, NULL);
+  for (l = 0; l < numWorkers; l++)
+    pthread_create(&workerid[l], &attr, Worker, (void *) l);
+
+  pthread_join(readerid, NULL);
+  for (l = 0; l < numWorkers; l++)
+    pthread_join(workerid[l], NULL);
+  end_time = read_timer();
+
+  /* print results */
+  bytes = (double) header.rows * rowBytes;
+  for (i = 0; i < numWorkers; i++) {
+    if (computeBusy[i] > maxBusy) maxBusy = computeBusy[i];
+    if (computeWait[i] > maxWait) maxWait = computeWait[i];
+  }
+  printf("The total sum is %lld\n", global.sum);
+  printf("The minimum element is %d at (%d, %d)\n", global.min, global.minRow, global.minCol);
+  printf("The maximum element is %d at (%d, %d)\n", global.max, global.maxRow, global.maxCol);
+  printf("The execution time is %g sec (%g GB/s overall, %s kernel)\n", end_time - start_time,
+         bytes / 1e9 / (end_time - start_time), reduce_kernel_name);
+  printf("I/O:     %8.3f GB/s while reading (%g sec busy, %g sec waiting for a free buffer)\n",
+         ioBusy > 0 ? bytes / 1e9 / ioBusy : 0.0, ioBusy, ioWait);
+  printf("Compute: %8.3f GB/s while reducing (%g sec busy, %g sec waiting for data, slowest worker)\n",
+         maxBusy > 0 ? bytes / 1e9 / maxBusy : 0.0, maxBusy, maxWait);
+  printf("The bottleneck is %s\n", (ioBusy > maxBusy) ? "I/O" : "compute");
+
+  pthread_mutex_destroy(&ring_mutex);
+  pthread_mutex_destroy(&result_mutex);
+  pthread_cond_destroy(&filled);
+  pthread_cond_destroy(&freed);
+  for (i = 0; i < numBuffers; i++)
+    free(ring[i].memory);
+  free(ring);
+  free(workerid);
+  free(computeBusy);
+  free(computeWait);
+  close(fd);
+  return 0;
+}
+
+/* read len bytes at offset into buf, retrying short reads; exits on error */
+static void read_fully(char *buf, size_t len, off_t offset) {
+  while (len > 0) {
+    ssize_t n = pread(fd, buf, len, offset);
+    if (n < 0) {
+      perror("pread");
+      exit(1);
+    }
+    if (n == 0) break; /* end of file: only the O_DIRECT round-up is missing */
+    buf += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+/* The I/O thread reads block k into buffer k mod numBuffers as soon as the
+   workers have released that buffer. */
+void *Reader(void *arg) {
+  long long k;
+  double t0;
+  (void) arg;
+
+  for (k = 0; k < numBlocks; k++) {
+    Buffer *buf = &ring[k % numBuffers];
+    int numRows = (k == numBlocks - 1) ? (int) (header.rows - k * blockRows) : blockRows;
+    off_t offset = header.dataOffset + (off_t) k * blockRows * rowBytes;
+    size_t len = numRows * rowBytes;
+    off_t start = offset, skip = 0;
+
+    t0 = read_timer();
+    pthread_mutex_lock(&ring_mutex);
+    while (buf->block != -1)
+      pthread_cond_wait(&freed, &ring_mutex);
+    pthread_mutex_unlock(&ring_mutex);
+    ioWait += read_timer() - t0;
+
+    t0 = read_timer();
+    if (direct) { /* widen the read to aligned offsets and lengths */
+      start = offset & ~(off_t) (DIRECT_ALIGN - 1);
+      skip = offset - start;
+      len = (skip + len + DIRECT_ALIGN - 1) & ~(size_t) (DIRECT_ALIGN - 1);
+    }
+    read_fully(buf->memory, len, start);
+    ioBusy += read_timer() - t0;
+
+    pthread_mutex_lock(&ring_mutex);
+    buf->rows = (const int *) (buf->memory + skip);
+    buf->numRows = numRows;
+    buf->workersDone = 0;
+    buf->block = k;
+    pthread_cond_broadcast(&filled);
+    pthread_mutex_unlock(&ring_mutex);
+  }
+  return NULL;
+}
+
+/* Each worker reduces its strip of every block as the blocks arrive; the
+   last worker done with a block frees its buffer (and its cached pages). */
+void *Worker(void *arg) {
+  long myid = (long) arg;
+  long long k;
+  int i, first, last, stripSize;
+  double t0, busy = 0.0, wait = 0.0;
+  Reduction local;
+
+  reduction_init(&local);
+  for (k = 0; k < numBlocks; k++) {
+    Buffer *buf = &ring[k % numBuffers];
+
+    t0 = read_timer();
+    pthread_mutex_lock(&ring_mutex);
+    while (buf->block != k)
+      pthread_cond_wait(&filled, &ring_mutex);
+    pthread_mutex_unlock(&ring_mutex);
+    wait += read_timer() - t0;
+
+    /* my strip of this block */
+    t0 = read_timer();
+    stripSize = buf->numRows / numWorkers;
+    first = myid * stripSize;
+    last = (myid == numWorkers - 1) ? buf->numRows - 1 : first + stripSize - 1;
+    for (i = first; i <= last; i++)
+      reduce_row(buf->rows + (size_t) i * cols, cols, (int) (k * blockRows + i), &local);
+    busy += read_timer() - t0;
+
+    pthread_mutex_lock(&ring_mutex);
+    if (++buf->workersDone == numWorkers) {
+      if (!direct)
+        posix_fadvise(fd, header.dataOffset + (off_t) k * blockRows * rowBytes,
+                      (off_t) buf->numRows * rowBytes, POSIX_FADV_DONTNEED);
+      buf->block = -1;
+      pthread_cond_signal(&freed);
+    }
+    pthread_mutex_unlock(&ring_mutex);
+  }
+  computeBusy[myid] = busy;
+  computeWait[myid] = wait;
+
+  pthread_mutex_lock(&result_mutex);
+  reduction_merge(&global, &local);
+  pthread_mutex_unlock(&result_mutex);
+  return NULL;
+}
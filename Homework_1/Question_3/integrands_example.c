@@ -0,0 +1,32 @@
+/* example integrands for the pi program, loaded at run time
+
+   features: each function double name(double x) can be named on the command
+             line of compute_pi as ./integrands.so:name, with --f or in a
+             batch file. Loaded integrands have no antiderivative, so only
+             their value is printed, not the error.
+
+   usage under Linux:
+     gcc -O2 -shared -fPIC integrands_example.c -o integrands.so -lm
+     ./compute_pi --tol=1e-10 --f=./integrands.so:bump --interval=-1,1 <numWorkers>
+     printf './integrands.so:sinc 0 100\n./integrands.so:peak 0 1 1e-12\n' > jobs.txt
+     ./compute_pi --batch=jobs.txt <numWorkers>
+
+*/
+#include <math.h>
+
+/* smooth with compact support on [-1, 1]; all derivatives vanish at the ends */
+double bump(double x) {
+    return (fabs(x) < 1.0) ? exp(-1.0 / (1.0 - x * x)) : 0.0;
+}
+
+/* sin(x) / x; the integral over [0, inf) is pi / 2 */
+double sinc(double x) {
+    return (x == 0.0) ? 1.0 : sin(x) / x;
+}
+
+/* a narrow peak at x = 0.3 on a flat background: adaptive quadrature
+   spends its evaluations around the peak */
+double peak(double x) {
+    double d = (x - 0.3) / 1e-3;
+    return 1.0 + 1.0 / (1.0 + d * d);
+}
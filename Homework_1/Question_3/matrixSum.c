@@ -1,27 +1,188 @@
-/* pi computation using pthreads */
+/* pi computation (and other integrals) using pthreads
+
+   features: pi is 4 times the area under f(x) = sqrt(1 - x*x) on [0, 1],
+             the upper-right quadrant of the unit circle.
+             Uniform (the default): the midpoint rule over num_steps steps
+             split evenly among the workers. Each worker sums its steps with
+             a kernel of common/midpoint_kernel.h: several independent (SIMD)
+             accumulators so the adds and square roots overlap, with
+             compensated summation of blocks so the result stays accurate at
+             10^10 steps and more. The naive kernel is the original loop, for
+             comparison. Each worker times its own steps; the steps per
+             second of every worker are printed.
+             Adaptive (--tol): the interval [0, 1] is bisected only where the
+             error estimate of an interval exceeds its share of the
+             tolerance, which is near x = 1, where f has an infinite slope;
+             the flat part is covered by a few wide intervals. The error
+             estimate is Simpson's rule on the interval against its two
+             halves (adaptive Simpson), or the 15-point Gauss-Kronrod rule
+             against its embedded 7-point Gauss rule (--rule=gk15).
+             Intervals are tasks of per-worker work-stealing deques
+             (common/ws_deque.h): a worker splitting an interval pushes the
+             right half and goes on with the left one, and a worker whose
+             deque runs dry steals the oldest (widest) interval of a random
+             victim. A count of unfinished intervals tells the workers when
+             to stop. --compare also finds the number of uniform steps that
+             reaches the same tolerance, doubling it from 1024, and prints
+             the function evaluations and time of both.
+             Other integrands (--f, --interval) come from the registry of
+             common/integrand.h: built-ins, or functions loaded from a shared
+             object (see integrands_example.c). The SIMD kernels are for the
+             quarter circle only; other integrands use a scalar midpoint loop
+             with the same compensated summation of blocks.
+             Batch (--batch): every line of the file is a job, an integral
+             to its own tolerance. All jobs share the deques: each job starts
+             as one interval (or a few, when there are fewer jobs than
+             initial intervals), so the workers take, split, and steal the
+             intervals of many jobs at once, and a job of a hard integrand
+             spreads over idle workers. Each worker adds the accepted
+             intervals into its own sums per job, merged after the join.
+             Per-job results and the jobs and function evaluations per
+             second are printed.
+             Extrapolated (--digits): the parallel midpoint sum is run with
+             1, 2, 4, ... steps. The trapezoid rule with 2n steps is the
+             mean of the trapezoid rule with n steps and the midpoint rule
+             with n steps, so every level reuses all earlier points and only
+             evaluates the new midpoints. Richardson extrapolation of the
+             trapezoid sequence (a Romberg table) removes one power of the
+             step width h from the error per column: h^2, h^4, h^6, ... for
+             a smooth integrand (Romberg), but the quarter circle behaves
+             like sqrt(1 - x) at x = 1, which adds h^1.5, h^2.5, h^3.5, ...,
+             so pi mode eliminates 1.5, 2, 2.5, 3.5, 4, 4.5, ... in turn;
+             plain Romberg would gain little there. The levels stop when
+             two successive diagonal values agree to D significant digits
+             (decimal places for an integral below 1). Every level prints
+             the digits of the midpoint rule alone at that step count (the
+             brute-force result) next to those of the extrapolation, with
+             the wall time so far. The integrand must be finite at both ends.
+             Monte Carlo (--samples): pi is 4 times the fraction of random
+             points of the unit square inside the quarter circle. Sample k
+             comes from a counter-based generator (common/counter_rng.h via
+             common/monte_carlo_kernel.h), so each worker starts at the first
+             sample of its range without generating the ones before it, and
+             the hit count, an integer, is the same for a given seed with
+             any number of workers. The AVX2 and AVX-512 kernels generate
+             and test 4 or 8 samples per instruction. The standard error
+             4 sqrt(p (1 - p) / N) of the hit rate p and the samples per
+             second of every worker are printed.
+             Partial sums are combined with compensated summation.
+
+   usage under Linux:
+     gcc -O2 matrixSum.c -lpthread -lm -ldl -o compute_pi
+     ./compute_pi [--kernel=auto|naive|scalar|avx2|avx512] [--f=NAME] [--interval=A,B] <num_steps> <numWorkers>
+     ./compute_pi --tol=EPS [--rule=simpson|gk15] [--compare] [--f=NAME] [--interval=A,B] <numWorkers>
+     ./compute_pi --batch=FILE [--tol=EPS] [--rule=simpson|gk15] <numWorkers>
+     ./compute_pi --digits=D [--kernel=...] [--f=NAME] [--interval=A,B] <numWorkers>
+     ./compute_pi --samples=N [--seed=S] [--kernel=auto|scalar|avx2|avx512] <numWorkers>
+
+   numWorkers defaults to the number of online CPUs; there is no upper limit.
+
+   options:
+     --tol=EPS      adaptive quadrature to an absolute error of about EPS in pi
+                    (in the integral with --f or --interval; the default
+                    tolerance of the jobs with --batch, else 1e-10)
+     --rule=R       simpson (default) or gk15, the rule of --tol and --batch
+     --compare      with --tol: also run the uniform midpoint rule with as many
+                    steps as it needs to be within EPS of pi (or of the exact
+                    integral, if the integrand has an antiderivative)
+     --f=NAME       integrate a built-in (see --list) or path.so:symbol, a
+                    function double symbol(double) of a shared object, instead
+                    of computing pi
+     --interval=A,B integrate over [A, B] instead of the integrand's default
+     --batch=FILE   integrate the jobs of FILE, one per line: NAME [A B [EPS]]
+                    (NAME as for --f; A, B, EPS default to the integrand's
+                    interval and the tolerance); '#' starts a comment
+     --digits=D     extrapolate the midpoint rule at doubled step counts until
+                    D digits (1 to 15) are stable
+     --samples=N    estimate pi from N Monte Carlo samples
+     --seed=S       the seed of --samples (default 1)
+     --list         list the built-in integrands and exit
+
+*/
 #ifndef _REENTRANT
 #define _REENTRANT
 #endif
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 #include <sys/time.h>
 #include <math.h> // For sqrt
+#include <stdatomic.h>
+#include "../../common/integrand.h"
+#include "../../common/midpoint_kernel.h"
+#include "../../common/monte_carlo_kernel.h"
+#include "../../common/ws_deque.h"
+
+#define CACHE_LINE 64           // bytes per cache line
+#define ADAPTIVE_PIECES 4       // initial intervals per worker
+#define ADAPTIVE_MAX_DEPTH 50   // intervals this many halvings deep are accepted as they are
+#define UNIFORM_FIRST_STEPS 1024 // first step count of the --compare search
+#define BATCH_DEFAULT_TOL 1e-10 // tolerance of the jobs without EPS or --tol
+#define BATCH_LINE_MAX 1024     // longest line of a batch file
+#define ROMBERG_MAX_LEVELS 36   // --digits gives up after 2^35 midpoint steps
+#define MAX_DIGITS 15           // what a double holds
 
-#define MAXWORKERS 10 // maximum number of workers
+typedef enum { RULE_SIMPSON, RULE_GK15 } Rule;
 
 // Global variables for timing and worker management
 double start_time, end_time;     // start and end times
 int numWorkers;                  // number of workers
-long long total_num_steps;       // total number of integration steps
-double partial_sums[MAXWORKERS]; // partial sums of areas
+bool adaptive = false;           // --tol or --batch given
+long long total_num_steps;       // total number of integration steps (uniform)
+double *partial_sums;            // per worker: sum of f at its midpoints (uniform)
+double *worker_times;            // per worker: seconds spent on its steps (uniform)
+Rule rule = RULE_SIMPSON;        // the rule of the adaptive quadrature
+bool monte_carlo = false;        // --samples given; total_num_steps is the number of samples
+uint64_t seed = 1;               // the seed of the Monte Carlo samples
+uint64_t *worker_hits;           // per worker: samples inside the quarter circle (Monte Carlo)
 
-// Function to integrate: f(x) = sqrt(1 - x*x) for a unit circle
-double f(double x) {
-    return sqrt(1.0 - x * x);
-}
+// The integral of the uniform rule and of --tol: the quarter circle on [0, 1] by default
+const Integrand *integrand;
+double lo = 0.0, hi = 1.0;
+bool pi_mode;                    // the quarter circle on [0, 1]: print 4 times it as pi
+
+/* one integral of the adaptive quadrature; --tol is a single job */
+typedef struct {
+    const Integrand *integrand;
+    double a, b, tol;
+    double value;                // after the run: the integral
+    long long evals, intervals;  // after the run: evaluations and accepted intervals
+} Job;
+
+Job *jobs;
+int numJobs;
+
+/* one interval of the adaptive quadrature: a task of the deques */
+typedef struct {
+    double a, b;
+    double fa, fm, fb;  // Simpson: f at a, (a + b) / 2, and b
+    double whole;       // Simpson: the estimate over [a, b]
+    double tol;         // the error allowed on this interval
+    int depth;          // halvings from the initial interval
+    int job;            // index into jobs
+} Interval;
+
+/* what one worker has added to one job */
+typedef struct {
+    MidpointSum area;
+    long long evals, intervals;
+} JobPart;
+
+/* the deque and results of one adaptive worker, on its own cache lines */
+typedef struct {
+    _Alignas(CACHE_LINE) WsDeque deque;
+    JobPart *parts;     // per job
+    long long evals, accepted, steals;
+    double time;
+} AdaptiveWorker;
+
+AdaptiveWorker *adaptive_workers;
+atomic_long intervals_left;      // intervals pushed but not yet accepted
 
 /* timer */
 double read_timer() {
@@ -39,92 +200,681 @@ double read_timer() {
 // Worker function prototype
 void *Worker(void *);
 
-int main(int argc, char *argv[]) {
+/* the steps first..last-1 of worker id */
+static void worker_steps(long id, long long *first, long long *last) {
+    long long steps_per_worker = total_num_steps / numWorkers;
+    *first = id * steps_per_worker;
+    *last = (id == numWorkers - 1) ? total_num_steps : *first + steps_per_worker;
+}
+
+/* create the workers and wait for them; returns the elapsed time */
+static double run_workers(pthread_attr_t *attr, pthread_t *workerid) {
     long l; // use long in case of a 64-bit system
-    pthread_attr_t attr;
-    pthread_t workerid[MAXWORKERS];
 
-    /* set global thread attributes */
-    pthread_attr_init(&attr);
-    pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+    /* do the parallel work: create the workers */
+    start_time = read_timer(); // Start timer after initialization and before thread creation
+    for (l = 0; l < numWorkers; l++) {
+        pthread_create(&workerid[l], attr, Worker, (void *)l);
+    }
 
-    /* read command line args */
-    if (argc < 3) {
-        fprintf(stderr, "Usage: %s <num_steps> <numWorkers>\n", argv[0]);
-        exit(1);
+    // Wait for all workers to finish
+    for (l = 0; l < numWorkers; l++) {
+        pthread_join(workerid[l], NULL);
+    }
+    end_time = read_timer();
+    return end_time - start_time;
+}
+
+/* the sum of fn(a + (i + 0.5) * dx) for first <= i < last, in compensated
+   blocks as in midpoint_blocks() */
+static double generic_midpoint_sum(IntegrandFn fn, double a, double dx, long long first, long long last) {
+    MidpointSum total = { 0, 0 };
+    long long i = first, end;
+
+    while (i < last) {
+        double block = 0.0;
+        end = (last - i < MIDPOINT_BLOCK) ? last : i + MIDPOINT_BLOCK;
+        for (; i < end; i++) {
+            block += fn(a + (i + 0.5) * dx);
+        }
+        midpoint_sum_add(&total, block);
     }
+    return midpoint_sum_value(&total);
+}
 
-    total_num_steps = atoll(argv[1]); // Using atoll for long long
-    numWorkers = atoi(argv[2]);
+/* the uniform midpoint rule with total_num_steps steps; returns the
+   integral over [lo, hi] (pi in pi mode) */
+static double uniform_integral(pthread_attr_t *attr, pthread_t *workerid, double *seconds) {
+    MidpointSum total = { 0, 0 };
+
+    adaptive = false;
+    *seconds = run_workers(attr, workerid);
+    // Main thread collects results and calculates the integral
+    for (int i = 0; i < numWorkers; ++i) {
+        midpoint_sum_add(&total, partial_sums[i]);
+    }
+    if (pi_mode)
+        return midpoint_sum_value(&total) / total_num_steps * 4.0; // Multiply by 4 for full circle area
+    return midpoint_sum_value(&total) * ((hi - lo) / total_num_steps);
+}
 
-    if (numWorkers <= 0 || numWorkers > MAXWORKERS) {
-        fprintf(stderr, "Number of workers must be between 1 and %d (MAXWORKERS).\n", MAXWORKERS);
+static Interval *new_interval(double a, double b, double tol, int depth) {
+    Interval *iv = malloc(sizeof(Interval));
+    if (iv == NULL) {
+        fprintf(stderr, "Out of memory for intervals\n");
         exit(1);
     }
-    if (total_num_steps <= 0) {
-        fprintf(stderr, "Number of steps must be positive.\n");
+    iv->a = a;
+    iv->b = b;
+    iv->tol = tol;
+    iv->depth = depth;
+    return iv;
+}
+
+/* adaptive quadrature of all jobs; sets their value, evals, and intervals */
+static void adaptive_run(pthread_attr_t *attr, pthread_t *workerid, double *seconds) {
+    int per_job = (numJobs >= ADAPTIVE_PIECES * numWorkers)
+                      ? 1 : (ADAPTIVE_PIECES * numWorkers + numJobs - 1) / numJobs;
+    long pieces = (long) numJobs * per_job;
+    JobPart *parts = calloc((size_t) numWorkers * numJobs, sizeof(JobPart));
+
+    if (parts == NULL) {
+        fprintf(stderr, "Out of memory for %d jobs\n", numJobs);
         exit(1);
     }
-    
-    // Initialize partial_sums to zero
+    adaptive = true;
+    memset(adaptive_workers, 0, numWorkers * sizeof(AdaptiveWorker));
     for (int i = 0; i < numWorkers; ++i) {
-        partial_sums[i] = 0.0;
+        ws_deque_init(&adaptive_workers[i].deque, 64);
+        adaptive_workers[i].parts = parts + (size_t) i * numJobs;
     }
 
-    printf("Computing Pi with %lld steps and %d workers...\n", total_num_steps, numWorkers);
+    /* equal initial intervals of every job, dealt round-robin */
+    atomic_store(&intervals_left, pieces);
+    for (long k = pieces - 1; k >= 0; k--) {
+        int j = (int) (k / per_job), p = (int) (k % per_job);
+        Job *job = &jobs[j];
+        Interval *iv = new_interval(job->a + (job->b - job->a) * p / per_job,
+                                    (p == per_job - 1) ? job->b : job->a + (job->b - job->a) * (p + 1) / per_job,
+                                    job->tol / per_job, 0);
+        AdaptiveWorker *w = &adaptive_workers[k % numWorkers];
+        iv->job = j;
+        if (rule == RULE_SIMPSON) {
+            IntegrandFn fn = job->integrand->fn;
+            iv->fa = fn(iv->a);
+            iv->fm = fn((iv->a + iv->b) / 2);
+            iv->fb = fn(iv->b);
+            iv->whole = (iv->b - iv->a) / 6 * (iv->fa + 4 * iv->fm + iv->fb);
+            w->evals += 3;
+            w->parts[j].evals += 3;
+        }
+        ws_deque_push(&w->deque, iv);
+    }
 
-    /* do the parallel work: create the workers */
-    start_time = read_timer(); // Start timer after initialization and before thread creation
+    *seconds = run_workers(attr, workerid);
+    for (int j = 0; j < numJobs; ++j) {
+        MidpointSum total = { 0, 0 };
+        jobs[j].evals = jobs[j].intervals = 0;
+        for (int i = 0; i < numWorkers; ++i) {
+            JobPart *part = &adaptive_workers[i].parts[j];
+            midpoint_sum_add(&total, midpoint_sum_value(&part->area));
+            jobs[j].evals += part->evals;
+            jobs[j].intervals += part->intervals;
+        }
+        jobs[j].value = midpoint_sum_value(&total);
+    }
+    for (int i = 0; i < numWorkers; ++i) {
+        ws_deque_destroy(&adaptive_workers[i].deque);
+    }
+    free(parts);
+}
 
-    for (l = 0; l < numWorkers; l++) {
-        pthread_create(&workerid[l], &attr, Worker, (void *)l);
+static long long adaptive_evals(void) {
+    long long evals = 0;
+    for (int i = 0; i < numWorkers; ++i) {
+        evals += adaptive_workers[i].evals;
     }
+    return evals;
+}
 
-    // Wait for all workers to finish
-    for (l = 0; l < numWorkers; l++) {
-        pthread_join(workerid[l], NULL);
+/* read the jobs of a batch file; exits on an error */
+static void read_batch(const char *path, double default_tol) {
+    char line[BATCH_LINE_MAX], name[INTEGRAND_NAME_MAX];
+    int capacity = 256, lineno = 0;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        perror(path);
+        exit(1);
     }
+    jobs = malloc(capacity * sizeof(Job));
+    numJobs = 0;
+    while (jobs != NULL && fgets(line, sizeof(line), file) != NULL) {
+        Job *job;
+        int fields;
 
-    // Main thread collects results and calculates final Pi
-    double final_area_quadrant = 0.0;
-    for (int i = 0; i < numWorkers; ++i) {
-        final_area_quadrant += partial_sums[i];
+        lineno++;
+        line[strcspn(line, "#\r\n")] = '\0';
+        if (strspn(line, " \t") == strlen(line))
+            continue;
+        if (numJobs == capacity) {
+            capacity *= 2;
+            jobs = realloc(jobs, capacity * sizeof(Job));
+            if (jobs == NULL)
+                break;
+        }
+        job = &jobs[numJobs];
+        fields = sscanf(line, "%255s %lf %lf %lf", name, &job->a, &job->b, &job->tol);
+        if (fields == 2) {
+            fprintf(stderr, "%s:%d: expected NAME [A B [EPS]]\n", path, lineno);
+            exit(1);
+        }
+        if ((job->integrand = integrand_lookup(name)) == NULL) {
+            fprintf(stderr, "%s:%d: in this job\n", path, lineno);
+            exit(1);
+        }
+        if (fields < 3) {
+            job->a = job->integrand->a;
+            job->b = job->integrand->b;
+        }
+        if (fields < 4)
+            job->tol = default_tol;
+        if (!(job->tol > 0)) {
+            fprintf(stderr, "%s:%d: the tolerance must be positive\n", path, lineno);
+            exit(1);
+        }
+        numJobs++;
+    }
+    fclose(file);
+    if (jobs == NULL) {
+        fprintf(stderr, "Out of memory for the jobs of %s\n", path);
+        exit(1);
+    }
+    if (numJobs == 0) {
+        fprintf(stderr, "%s: no jobs\n", path);
+        exit(1);
     }
-    double pi_estimate = final_area_quadrant * 4.0; // Multiply by 4 for full circle area
+}
 
-    end_time = read_timer(); // End timer after all workers complete and main collected results
+/* print the result of a single integral against the exact value, if known */
+static void print_result(double value) {
+    double exact = pi_mode ? M_PI : integrand_exact(integrand, lo, hi);
+
+    if (pi_mode)
+        printf("Estimated Pi = %.15lf (error %.3e)\n", value, value - M_PI);
+    else if (isnan(exact))
+        printf("Integral of %s over [%g, %g] = %.15g (no exact value)\n", integrand->name, lo, hi, value);
+    else
+        printf("Integral of %s over [%g, %g] = %.15g (error %.3e)\n", integrand->name, lo, hi, value,
+               value - exact);
+}
 
-    printf("Estimated Pi = %.10lf\n", pi_estimate);
-    printf("Execution time = %g sec\n", end_time - start_time);
+/* the per-job and total results of a batch */
+static void print_batch(double seconds) {
+    long long evals = 0;
+
+    printf("%5s %-24s %10s %10s %22s %11s %12s %10s\n", "job", "integrand", "a", "b", "integral", "error",
+           "evaluations", "intervals");
+    for (int j = 0; j < numJobs; ++j) {
+        Job *job = &jobs[j];
+        double exact = integrand_exact(job->integrand, job->a, job->b);
+        char error[32];
+
+        if (isnan(exact))
+            snprintf(error, sizeof(error), "n/a");
+        else
+            snprintf(error, sizeof(error), "%.3e", job->value - exact);
+        printf("%5d %-24s %10g %10g %22.15g %11s %12lld %10lld\n", j, job->integrand->name, job->a, job->b,
+               job->value, error, job->evals, job->intervals);
+        evals += job->evals;
+    }
+    printf("%d jobs in %g sec: %.1f jobs/sec, %lld function evaluations, %.2f Mevals/sec\n", numJobs, seconds,
+           numJobs / seconds, evals, evals / seconds / 1e6);
+}
+
+/* the power of h that column k >= 1 of the Romberg table removes */
+static double romberg_power(int k) {
+    if (!pi_mode)
+        return 2.0 * k;
+    return 2 * ((k - 1) / 3) + 1.5 + 0.5 * ((k - 1) % 3); // 1.5, 2, 2.5, 3.5, 4, 4.5, ...
+}
+
+/* the digits to which estimate agrees with reference: significant digits,
+   or decimal places below 1; 0 to MAX_DIGITS + 1 (equal) */
+static double digits_of(double estimate, double reference) {
+    double diff = fabs(estimate - reference) / fmax(fabs(reference), 1.0);
+    return (diff == 0) ? MAX_DIGITS + 1 : fmax(0.0, fmin(-log10(diff), MAX_DIGITS + 1));
+}
+
+/* a table cell of digits, or n/a without an exact value */
+static void print_digits(double estimate, double exact) {
+    if (isnan(exact))
+        printf(" %8s", "n/a");
+    else
+        printf(" %8.1f", digits_of(estimate, exact));
+}
+
+/* Richardson extrapolation of the trapezoid rule at 2, 4, 8, ... steps,
+   built from the parallel midpoint sums at 1, 2, 4, ... steps, until the
+   diagonal of the table is stable to digits digits; returns the estimate
+   (pi in pi mode) */
+static double romberg(pthread_attr_t *attr, pthread_t *workerid, int digits) {
+    double prev[ROMBERG_MAX_LEVELS], row[ROMBERG_MAX_LEVELS];
+    double scale = pi_mode ? 4.0 : 1.0, exact = pi_mode ? M_PI : integrand_exact(integrand, lo, hi);
+    double tolerance = 0.5 * pow(10.0, -digits), seconds, total_seconds = 0;
+    long long evals = 2;
+    int level;
+
+    prev[0] = (integrand->fn(lo) + integrand->fn(hi)) / 2 * (hi - lo) * scale; // the trapezoid rule, one step
+    printf("digits of the midpoint rule alone and of the extrapolation (stable: agreeing with the previous\n"
+           "level, correct: with the exact value)\n");
+    printf("%5s %14s %14s %12s %8s %22s %8s %8s\n", "level", "midpoints", "evaluations", "time (sec)",
+           "midpoint", "extrapolated", "stable", "correct");
+    for (level = 1; level < ROMBERG_MAX_LEVELS; level++) {
+        double midpoint, change;
+
+        total_num_steps = 1LL << (level - 1);
+        midpoint = uniform_integral(attr, workerid, &seconds);
+        total_seconds += seconds;
+        evals += total_num_steps;
+        row[0] = (prev[0] + midpoint) / 2; // the trapezoid rule with 2^level steps
+        for (int k = 1; k <= level; k++) {
+            row[k] = row[k - 1] + (row[k - 1] - prev[k - 1]) / (pow(2.0, romberg_power(k)) - 1);
+        }
+        change = fabs(row[level] - prev[level - 1]) / fmax(fabs(row[level]), 1.0);
+
+        printf("%5d %14lld %14lld %12g", level, total_num_steps, evals, total_seconds);
+        print_digits(midpoint, exact);
+        printf(" %22.15f %8.1f", row[level], digits_of(row[level], prev[level - 1]));
+        print_digits(row[level], exact);
+        printf("\n");
+        memcpy(prev, row, (level + 1) * sizeof(double));
+        if (level >= 2 && change <= tolerance)
+            break;
+    }
+    if (level == ROMBERG_MAX_LEVELS) {
+        level--;
+        printf("%d digits are not stable after %d levels\n", digits, ROMBERG_MAX_LEVELS - 1);
+    } else {
+        printf("%d digits stable after %lld function evaluations in %g sec\n", digits, evals, total_seconds);
+    }
+    return prev[level];
+}
+
+int main(int argc, char *argv[]) {
+    pthread_attr_t attr;
+    pthread_t *workerid;
+    const char *kernelName = "auto", *fName = NULL, *batchPath = NULL;
+    char *args[2];
+    int numArgs = 0, digits = 0;
+    double tol = 0, seconds, estimate;
+    bool compare = false, interval = false;
+
+    /* set global thread attributes */
+    pthread_attr_init(&attr);
+    pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+
+    /* read command line options, then positional args */
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "--kernel=", 9) == 0)
+            kernelName = argv[i] + 9;
+        else if (strncmp(argv[i], "--tol=", 6) == 0)
+            tol = atof(argv[i] + 6);
+        else if (strcmp(argv[i], "--rule=simpson") == 0)
+            rule = RULE_SIMPSON;
+        else if (strcmp(argv[i], "--rule=gk15") == 0)
+            rule = RULE_GK15;
+        else if (strcmp(argv[i], "--compare") == 0)
+            compare = true;
+        else if (strncmp(argv[i], "--f=", 4) == 0)
+            fName = argv[i] + 4;
+        else if (strncmp(argv[i], "--interval=", 11) == 0) {
+            if (sscanf(argv[i] + 11, "%lf,%lf", &lo, &hi) != 2 || lo == hi) {
+                fprintf(stderr, "Bad interval %s (use A,B with A != B)\n", argv[i] + 11);
+                exit(1);
+            }
+            interval = true;
+        } else if (strncmp(argv[i], "--batch=", 8) == 0)
+            batchPath = argv[i] + 8;
+        else if (strncmp(argv[i], "--samples=", 10) == 0) {
+            total_num_steps = atoll(argv[i] + 10);
+            monte_carlo = true;
+            if (total_num_steps <= 0) {
+                fprintf(stderr, "Number of samples must be positive.\n");
+                exit(1);
+            }
+        } else if (strncmp(argv[i], "--seed=", 7) == 0)
+            seed = strtoull(argv[i] + 7, NULL, 0);
+        else if (strncmp(argv[i], "--digits=", 9) == 0) {
+            digits = atoi(argv[i] + 9);
+            if (digits < 1 || digits > MAX_DIGITS) {
+                fprintf(stderr, "--digits must be 1 to %d\n", MAX_DIGITS);
+                exit(1);
+            }
+        }
+        else if (strcmp(argv[i], "--list") == 0) {
+            printf("Built-in integrands (name, default interval):\n");
+            integrand_list();
+            return 0;
+        } else if (numArgs < 2)
+            args[numArgs++] = argv[i];
+    }
+    if (numArgs < 1 && tol <= 0 && batchPath == NULL && digits == 0 && !monte_carlo) {
+        fprintf(stderr, "Usage: %s [--kernel=auto|naive|scalar|avx2|avx512] [--f=NAME] [--interval=A,B] <num_steps> <numWorkers>\n"
+                        "       %s --tol=EPS [--rule=simpson|gk15] [--compare] [--f=NAME] [--interval=A,B] <numWorkers>\n"
+                        "       %s --batch=FILE [--tol=EPS] [--rule=simpson|gk15] <numWorkers>\n"
+                        "       %s --digits=D [--kernel=...] [--f=NAME] [--interval=A,B] <numWorkers>\n"
+                        "       %s --samples=N [--seed=S] [--kernel=auto|scalar|avx2|avx512] <numWorkers>\n",
+                argv[0], argv[0], argv[0], argv[0], argv[0]);
+        exit(1);
+    }
+    if (monte_carlo) {
+        if (fName != NULL || interval || tol > 0 || batchPath != NULL || digits > 0) {
+            fprintf(stderr, "--samples estimates pi only, by itself\n");
+            exit(1);
+        }
+        if (monte_carlo_kernel_select(kernelName) == NULL) {
+            fprintf(stderr, "Unknown or unsupported Monte Carlo kernel: %s\n", kernelName);
+            exit(1);
+        }
+    } else if (midpoint_kernel_select(kernelName) == NULL) {
+        fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+        exit(1);
+    }
+
+    if (batchPath != NULL) {
+        read_batch(batchPath, (tol > 0) ? tol : BATCH_DEFAULT_TOL);
+    } else {
+        integrand = integrand_lookup(fName ? fName : "circle");
+        if (integrand == NULL)
+            exit(1);
+        if (!interval) {
+            lo = integrand->a;
+            hi = integrand->b;
+        }
+        pi_mode = strcmp(integrand->name, "circle") == 0 && lo == 0.0 && hi == 1.0;
+    }
+
+    if (tol > 0 || batchPath != NULL || digits > 0 || monte_carlo) {
+        numWorkers = (numArgs > 0) ? atoi(args[0]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+    } else {
+        total_num_steps = atoll(args[0]); // Using atoll for long long
+        numWorkers = (numArgs > 1) ? atoi(args[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN);
+        if (total_num_steps <= 0) {
+            fprintf(stderr, "Number of steps must be positive.\n");
+            exit(1);
+        }
+    }
+    if (numWorkers <= 0) numWorkers = 1; // Ensure at least one worker
+
+    workerid = malloc(numWorkers * sizeof(pthread_t));
+    partial_sums = calloc(numWorkers, sizeof(double));
+    worker_times = calloc(numWorkers, sizeof(double));
+    worker_hits = calloc(numWorkers, sizeof(uint64_t));
+    adaptive_workers = aligned_alloc(CACHE_LINE, numWorkers * sizeof(AdaptiveWorker));
+    if (workerid == NULL || partial_sums == NULL || worker_times == NULL || worker_hits == NULL ||
+        adaptive_workers == NULL) {
+        fprintf(stderr, "Out of memory for %d workers\n", numWorkers);
+        exit(1);
+    }
+
+    if (monte_carlo) {
+        uint64_t hits = 0;
+        double p, std_error;
+
+        printf("Computing Pi from %lld samples with %d workers (%s kernel, seed %llu)...\n", total_num_steps,
+               numWorkers, monte_carlo_kernel_name, (unsigned long long) seed);
+        seconds = run_workers(&attr, workerid);
+        for (int i = 0; i < numWorkers; ++i) {
+            hits += worker_hits[i];
+        }
+        p = (double) hits / total_num_steps;
+        estimate = 4.0 * p;
+        std_error = 4.0 * sqrt(p * (1.0 - p) / total_num_steps);
+        printf("Estimated Pi = %.15lf (error %.3e, standard error %.3e)\n", estimate, estimate - M_PI, std_error);
+        printf("Hits = %llu of %lld samples\n", (unsigned long long) hits, total_num_steps);
+        printf("Execution time = %g sec, %.1f Msamples/sec\n", seconds, total_num_steps / seconds / 1e6);
+        printf("%6s %14s %14s %12s %14s\n", "worker", "samples", "hits", "time (sec)", "Msamples/sec");
+        for (int i = 0; i < numWorkers; ++i) {
+            long long first, last;
+            worker_steps(i, &first, &last);
+            printf("%6d %14lld %14llu %12g %14.1f\n", i, last - first, (unsigned long long) worker_hits[i],
+                   worker_times[i], (worker_times[i] > 0) ? (last - first) / worker_times[i] / 1e6 : 0.0);
+        }
+    } else if (digits > 0 && batchPath == NULL) {
+        if (pi_mode)
+            printf("Computing Pi to %d digits with %d workers (%s kernel, extrapolated)...\n", digits, numWorkers,
+                   midpoint_kernel_name);
+        else
+            printf("Integrating %s over [%g, %g] to %d digits with %d workers (extrapolated)...\n",
+                   integrand->name, lo, hi, digits, numWorkers);
+        estimate = romberg(&attr, workerid, digits);
+        print_result(estimate);
+    } else if (batchPath != NULL) {
+        printf("Integrating %d jobs of %s with %d workers (adaptive %s)...\n", numJobs, batchPath, numWorkers,
+               (rule == RULE_SIMPSON) ? "Simpson" : "Gauss-Kronrod 7-15");
+        adaptive_run(&attr, workerid, &seconds);
+        print_batch(seconds);
+        printf("%6s %14s %12s %10s %12s\n", "worker", "evaluations", "intervals", "steals", "time (sec)");
+        for (int i = 0; i < numWorkers; ++i) {
+            AdaptiveWorker *w = &adaptive_workers[i];
+            printf("%6d %14lld %12lld %10lld %12g\n", i, w->evals, w->accepted, w->steals, w->time);
+        }
+    } else if (tol > 0) {
+        Job job = { integrand, lo, hi, pi_mode ? tol / 4 : tol, 0, 0, 0 }; // the quadrant is pi / 4
+
+        if (pi_mode)
+            printf("Computing Pi to %g with %d workers (adaptive %s)...\n", tol, numWorkers,
+                   (rule == RULE_SIMPSON) ? "Simpson" : "Gauss-Kronrod 7-15");
+        else
+            printf("Integrating %s over [%g, %g] to %g with %d workers (adaptive %s)...\n", integrand->name, lo,
+                   hi, tol, numWorkers, (rule == RULE_SIMPSON) ? "Simpson" : "Gauss-Kronrod 7-15");
+        jobs = &job;
+        numJobs = 1;
+        adaptive_run(&attr, workerid, &seconds);
+        estimate = pi_mode ? job.value * 4.0 : job.value;
+        print_result(estimate);
+        printf("Execution time = %g sec, %lld function evaluations\n", seconds, adaptive_evals());
+        printf("%6s %14s %12s %10s %12s\n", "worker", "evaluations", "intervals", "steals", "time (sec)");
+        for (int i = 0; i < numWorkers; ++i) {
+            AdaptiveWorker *w = &adaptive_workers[i];
+            printf("%6d %14lld %12lld %10lld %12g\n", i, w->evals, w->accepted, w->steals, w->time);
+        }
+
+        if (compare) {
+            long long evals = adaptive_evals();
+            double exact = pi_mode ? M_PI : integrand_exact(integrand, lo, hi);
+            double adaptive_seconds = seconds, adaptive_error = estimate - exact, uniform_error;
+
+            if (isnan(exact)) {
+                fprintf(stderr, "--compare needs the exact integral, and %s has no antiderivative\n",
+                        integrand->name);
+                exit(1);
+            }
+            /* double the steps until the uniform rule is as close */
+            total_num_steps = UNIFORM_FIRST_STEPS;
+            for (;;) {
+                estimate = uniform_integral(&attr, workerid, &seconds);
+                uniform_error = estimate - exact;
+                if (fabs(uniform_error) <= tol || total_num_steps > (1LL << 40))
+                    break;
+                total_num_steps *= 2;
+            }
+            printf("%-22s %16s %12s %12s\n", "to reach the tolerance", "evaluations", "time (sec)", "error");
+            printf("%-22s %16lld %12g %12.3e\n", "adaptive", evals, adaptive_seconds, fabs(adaptive_error));
+            printf("%-22s %16lld %12g %12.3e\n", "uniform midpoint", total_num_steps, seconds,
+                   fabs(uniform_error));
+        }
+        jobs = NULL;
+    } else {
+        if (pi_mode)
+            printf("Computing Pi with %lld steps and %d workers (%s kernel)...\n", total_num_steps, numWorkers,
+                   midpoint_kernel_name);
+        else
+            printf("Integrating %s over [%g, %g] with %lld steps and %d workers...\n", integrand->name, lo, hi,
+                   total_num_steps, numWorkers);
+        estimate = uniform_integral(&attr, workerid, &seconds);
+        print_result(estimate);
+        printf("Execution time = %g sec, %.1f Msteps/sec\n", seconds, total_num_steps / seconds / 1e6);
+        printf("%6s %14s %12s %14s\n", "worker", "steps", "time (sec)", "Msteps/sec");
+        for (int i = 0; i < numWorkers; ++i) {
+            long long first, last;
+            worker_steps(i, &first, &last);
+            printf("%6d %14lld %12g %14.1f\n", i, last - first, worker_times[i],
+                   (worker_times[i] > 0) ? (last - first) / worker_times[i] / 1e6 : 0.0);
+        }
+    }
 
     pthread_attr_destroy(&attr); // Destroy attributes
+    free(workerid);
+    free(partial_sums);
+    free(worker_times);
+    free(worker_hits);
+    free(adaptive_workers);
+    if (batchPath != NULL) free(jobs);
+    integrand_registry_close();
 
     return 0; // Exit main thread cleanly
 }
 
-/* Each worker computes a part of the integral for pi. */
+/* the 15-point Kronrod rule for fn on [a, b] in *kronrod and its embedded
+   7-point Gauss rule in *gauss */
+static void gauss_kronrod15(IntegrandFn fn, double a, double b, double *kronrod, double *gauss) {
+    static const double xgk[8] = {
+        0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+        0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+        0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+        0.207784955007898467600689403773245, 0.000000000000000000000000000000000 };
+    static const double wgk[8] = {
+        0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+        0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+        0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+        0.204432940075298892414161999234649, 0.209482141084727828012999174891714 };
+    static const double wg[4] = {  // at xgk[1], xgk[3], xgk[5], xgk[7]
+        0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+        0.381830050505118944950369775488975, 0.417959183673469387755102040816327 };
+    double c = (a + b) / 2, h = (b - a) / 2, fc = fn(c);
+    double k = wgk[7] * fc, g = wg[3] * fc;
+
+    for (int j = 0; j < 7; j++) {
+        double pair = fn(c - h * xgk[j]) + fn(c + h * xgk[j]);
+        k += wgk[j] * pair;
+        if (j % 2 == 1)
+            g += wg[j / 2] * pair;
+    }
+    *kronrod = k * h;
+    *gauss = g * h;
+}
+
+/* refine one interval: while its error estimate is too large, push its
+   right half (with half the tolerance) and go on with the left half */
+static void refine(AdaptiveWorker *w, Interval *iv) {
+    IntegrandFn fn = jobs[iv->job].integrand->fn;
+    JobPart *part = &w->parts[iv->job];
+
+    for (;;) {
+        double estimate, error;
+        Interval *right;
+
+        if (rule == RULE_SIMPSON) {
+            double m = (iv->a + iv->b) / 2;
+            double fd = fn((iv->a + m) / 2), fe = fn((m + iv->b) / 2);
+            double left = (m - iv->a) / 6 * (iv->fa + 4 * fd + iv->fm);
+            double right_half = (iv->b - m) / 6 * (iv->fm + 4 * fe + iv->fb);
+            w->evals += 2;
+            part->evals += 2;
+            error = (left + right_half - iv->whole) / 15;  // Richardson: Simpson's error is 1/15 of the difference
+            estimate = left + right_half + error;
+            if (fabs(error) > iv->tol && iv->depth < ADAPTIVE_MAX_DEPTH) {
+                right = new_interval(m, iv->b, iv->tol / 2, iv->depth + 1);
+                right->job = iv->job;
+                right->fa = iv->fm; right->fm = fe; right->fb = iv->fb; right->whole = right_half;
+                iv->b = m; iv->fb = iv->fm; iv->fm = fd; iv->whole = left;
+                iv->tol /= 2;
+                iv->depth++;
+                atomic_fetch_add_explicit(&intervals_left, 1, memory_order_relaxed);
+                ws_deque_push(&w->deque, right);
+                continue;
+            }
+        } else {
+            double gauss;
+            gauss_kronrod15(fn, iv->a, iv->b, &estimate, &gauss);
+            w->evals += 15;
+            part->evals += 15;
+            error = estimate - gauss;
+            if (fabs(error) > iv->tol && iv->depth < ADAPTIVE_MAX_DEPTH) {
+                double m = (iv->a + iv->b) / 2;
+                right = new_interval(m, iv->b, iv->tol / 2, iv->depth + 1);
+                right->job = iv->job;
+                iv->b = m;
+                iv->tol /= 2;
+                iv->depth++;
+                atomic_fetch_add_explicit(&intervals_left, 1, memory_order_relaxed);
+                ws_deque_push(&w->deque, right);
+                continue;
+            }
+        }
+        midpoint_sum_add(&part->area, estimate);
+        part->intervals++;
+        w->accepted++;
+        free(iv);
+        atomic_fetch_sub_explicit(&intervals_left, 1, memory_order_release);
+        return;
+    }
+}
+
+/* take intervals from my deque, steal from random victims once it runs
+   dry, until every interval is accepted */
+static void adaptive_worker(long myid) {
+    AdaptiveWorker *w = &adaptive_workers[myid];
+    unsigned int seed = (unsigned int) myid + 1;
+    double t0 = read_timer();
+    Interval *iv;
+
+    while (atomic_load_explicit(&intervals_left, memory_order_acquire) > 0) {
+        iv = ws_deque_take(&w->deque);
+        if (iv == NULL && numWorkers > 1) {
+            int victim = rand_r(&seed) % numWorkers;
+            if (victim == myid) continue;
+            iv = ws_deque_steal(&adaptive_workers[victim].deque);
+            if (iv == NULL) {
+                sched_yield(); /* let a preempted owner run on an oversubscribed box */
+                continue;
+            }
+            w->steals++;
+        }
+        if (iv != NULL)
+            refine(w, iv);
+    }
+    w->time = read_timer() - t0;
+}
+
+/* Each worker computes a part of the integral. */
 void *Worker(void *arg) {
     long myid = (long)arg;
-    double my_local_sum = 0.0; // Sum of f(x) values for this worker's strip
-    long long steps_per_worker = total_num_steps / numWorkers;
-    long long my_start_step = myid * steps_per_worker;
-    long long my_end_step;
+    long long my_start_step, my_end_step;
+    double t0 = read_timer();
 
-    if (myid == numWorkers - 1) {
-        my_end_step = total_num_steps; // Last worker takes any remaining steps
-    } else {
-        my_end_step = my_start_step + steps_per_worker;
+    if (adaptive) {
+        adaptive_worker(myid);
+        return NULL;
     }
 
-    double dx = 1.0 / total_num_steps;
+    worker_steps(myid, &my_start_step, &my_end_step);
 
-    // Use midpoint rule for integration
-    for (long long i = my_start_step; i < my_end_step; ++i) {
-        double x = (i + 0.5) * dx; // Midpoint of the interval
-        my_local_sum += f(x);
+    if (monte_carlo) {
+        worker_hits[myid] = monte_carlo_hits(seed, my_start_step, my_end_step);
+        worker_times[myid] = read_timer() - t0;
+        return NULL;
     }
 
-    partial_sums[myid] = my_local_sum * dx; // Store partial area (sum of f(x) * dx)
+    // Sum of f at the midpoints of my steps; the caller multiplies by dx
+    if (pi_mode)
+        partial_sums[myid] = midpoint_sum(my_start_step, my_end_step, 1.0 / total_num_steps);
+    else
+        partial_sums[myid] = generic_midpoint_sum(integrand->fn, lo, (hi - lo) / total_num_steps,
+                                                  my_start_step, my_end_step);
+    worker_times[myid] = read_timer() - t0;
 
     return NULL;
-}
\ No newline at end of file
+}
@@ -0,0 +1,180 @@
+/* distributed matrix summation, min, and max using MPI and OpenMP
+
+   features: the size x size matrix is sharded by strips of rows across the
+             MPI ranks; each rank generates its strip (the same counter-based
+             values as matrixSum-openmp for a given --seed, so the results
+             can be compared) or maps it from an --input file, and reduces it
+             with the OpenMP reduction of matrixSum-openmp
+             (common/omp_reduce.h) on its own threads.
+             The ranks then combine their results at rank 0:
+               sum       MPI_Reduce with MPI_SUM
+               min, max  MPI_Allreduce with MPI_MINLOC / MPI_MAXLOC over
+                         (value, row) pairs, which also picks the smaller row
+                         on ties; the one rank that owns the winning row then
+                         supplies its column with an MPI_Reduce (MPI_MAX)
+             Compute time (the slowest and fastest rank), the time waiting
+             for the slowest rank, and the communication time of the
+             combining collectives are reported separately.
+
+   usage under Linux (Open MPI; --bind-to none lets each rank's threads use
+   every core, --oversubscribe allows more ranks than cores on one box):
+     mpicc -O2 -fopenmp -o matrixSum-mpi matrixSum-mpi.c
+     mpiexec --oversubscribe --bind-to none -n 4 ./matrixSum-mpi [--threads=T]
+             [--kernel=omp|auto|scalar|sse4.1|avx2|avx512] [--seed=N] [--input=FILE] size
+
+   options:
+     --threads=T    OpenMP threads per rank (default: OMP_NUM_THREADS or all cores)
+     --input=FILE   reduce the int32 matrix in FILE (see matrixGen.c) instead
+                    of a random one; the size argument is then ignored
+
+*/
+
+#include <mpi.h>
+#include <omp.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+#include <string.h>
+#include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/reduce_kernel.h"
+#include "../../common/omp_reduce.h"
+#include "../../common/counter_rng.h"
+#include "../../common/matrix_file.h"
+
+#define DEFAULTSIZE 10000 /* matrix size if not given */
+#define ROOT_RANK 0
+
+/* an MPI_2INT pair for MPI_MINLOC and MPI_MAXLOC */
+typedef struct {
+  int value, index;
+} ValueIndex;
+
+/* the rows of rank r: like matrix_strip() in common/matrix_alloc.h */
+static void Strip(int r, int numRanks, int rows, int *first, int *last) {
+  int stripSize = rows / numRanks;
+  *first = r * stripSize;
+  *last = (r == numRanks - 1) ? (rows - 1) : (*first + stripSize - 1);
+}
+
+int main(int argc, char *argv[]) {
+  int rank, numRanks, i, j, rows, cols, first, last, threads = 0;
+  const char *kernelName = "omp", *inputPath = NULL;
+  const char *sizeArg = NULL;
+  unsigned long long seed = time(NULL);
+  bool useKernel;
+  MatrixFile input;
+  const int *shard;
+  int *generated = NULL;
+  long long localSum, totalSum;
+  Located mn, mx;
+  ValueIndex localMin, localMax, globalMin, globalMax;
+  int localCols[2], globalCols[2];
+  double t0, t1, t2, t3, load_time, compute, times[2], maxTimes[2], minCompute;
+
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+  /* read command line options, then positional args if any */
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--threads=", 10) == 0)
+      threads = atoi(argv[i] + 10);
+    else if (strncmp(argv[i], "--input=", 8) == 0)
+      inputPath = argv[i] + 8;
+    else if (sizeArg == NULL)
+      sizeArg = argv[i];
+  }
+  useKernel = strcmp(kernelName, "omp") != 0;
+  if (useKernel && reduce_kernel_select(kernelName) == NULL) {
+    if (rank == ROOT_RANK)
+      fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  if (threads > 0)
+    omp_set_num_threads(threads);
+  /* every rank must generate the same matrix */
+  MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG_LONG, ROOT_RANK, MPI_COMM_WORLD);
+
+  /* load or generate this rank's strip */
+  t0 = MPI_Wtime();
+  if (inputPath != NULL) {
+    const int *m = matrix_file_map(inputPath, &input);
+    if (input.header.elemType != MATRIX_ELEM_INT32 || input.header.rows > INT_MAX ||
+        input.header.cols > INT_MAX) {
+      if (rank == ROOT_RANK)
+        fprintf(stderr, "%s: only int32 matrices of up to INT_MAX rows and columns are supported\n",
+                inputPath);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    rows = (int) input.header.rows;
+    cols = (int) input.header.cols;
+    Strip(rank, numRanks, rows, &first, &last);
+    shard = m + (size_t) first * cols;
+  } else {
+    rows = cols = (sizeArg != NULL)? atoi(sizeArg) : DEFAULTSIZE;
+    if (rows < 1) rows = cols = 1;
+    Strip(rank, numRanks, rows, &first, &last);
+    generated = malloc(((size_t) (last - first + 1) * cols + 1) * sizeof(int));
+    if (generated == NULL) {
+      fprintf(stderr, "Rank %d: out of memory for %d rows\n", rank, last - first + 1);
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    #pragma omp parallel for private(j)
+    for (i = first; i <= last; i++)
+      for (j = 0; j < cols; j++)
+        generated[(size_t) (i - first) * cols + j] =
+          (int) counter_rng_below(seed, (uint64_t) i * cols + j, 100); // Random values between 0 and 99
+    shard = generated;
+  }
+  load_time = MPI_Wtime() - t0;
+
+  /* reduce the strip; ranks without rows (more ranks than rows) get nothing */
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  omp_reduce_rows(shard, last - first + 1, cols, cols, first, useKernel, &localSum, &mn, &mx);
+  t1 = MPI_Wtime();
+  MPI_Barrier(MPI_COMM_WORLD); /* the wait for the slowest rank, kept out of the communication time */
+  t2 = MPI_Wtime();
+
+  /* combine: the sum, then (value, row) with MINLOC/MAXLOC, then the column
+     from the rank owning the winning row */
+  MPI_Reduce(&localSum, &totalSum, 1, MPI_LONG_LONG, MPI_SUM, ROOT_RANK, MPI_COMM_WORLD);
+  localMin.value = mn.value;
+  localMin.index = (mn.row >= 0) ? mn.row : INT_MAX;
+  localMax.value = mx.value;
+  localMax.index = (mx.row >= 0) ? mx.row : INT_MAX;
+  MPI_Allreduce(&localMin, &globalMin, 1, MPI_2INT, MPI_MINLOC, MPI_COMM_WORLD);
+  MPI_Allreduce(&localMax, &globalMax, 1, MPI_2INT, MPI_MAXLOC, MPI_COMM_WORLD);
+  localCols[0] = (globalMin.index == mn.row) ? mn.col : -1;
+  localCols[1] = (globalMax.index == mx.row) ? mx.col : -1;
+  MPI_Reduce(localCols, globalCols, 2, MPI_INT, MPI_MAX, ROOT_RANK, MPI_COMM_WORLD);
+  t3 = MPI_Wtime();
+
+  /* timing summary: slowest compute and communication, fastest compute */
+  compute = t1 - t0;
+  times[0] = compute;
+  times[1] = t3 - t2;
+  MPI_Reduce(times, maxTimes, 2, MPI_DOUBLE, MPI_MAX, ROOT_RANK, MPI_COMM_WORLD);
+  MPI_Reduce(&compute, &minCompute, 1, MPI_DOUBLE, MPI_MIN, ROOT_RANK, MPI_COMM_WORLD);
+
+  if (rank == ROOT_RANK) {
+    printf("The %dx%d matrix over %d ranks of %d threads (%s, %g sec to load)\n", rows, cols,
+           numRanks, omp_get_max_threads(), inputPath ? inputPath : "random", load_time);
+    printf("The total sum is %lld\n", totalSum);
+    printf("The minimum element is %d at (%d, %d)\n", globalMin.value, globalMin.index, globalCols[0]);
+    printf("The maximum element is %d at (%d, %d)\n", globalMax.value, globalMax.index, globalCols[1]);
+    printf("Compute %g sec (fastest rank %g), waiting %g sec, communication %g sec (%s kernel)\n",
+           maxTimes[0], minCompute, t2 - t1, maxTimes[1], useKernel ? reduce_kernel_name : "omp simd");
+  }
+
+  if (inputPath != NULL)
+    matrix_file_unmap(&input);
+  free(generated);
+  MPI_Finalize();
+  return 0;
+}
@@ -1,122 +1,186 @@
 /* matrix summation using OpenMP
 
    usage with gcc (version 4.2 or higher required):
-     gcc -O -fopenmp -o matrixSum-openmp matrixSum-openmp.c 
+     gcc -O -fopenmp -o matrixSum-openmp matrixSum-openmp.c
      ./matrixSum-openmp size numWorkers
 
 */
 
 /* matrix summation, min, and max using OpenMP
 
-   usage with gcc (version 4.2 or higher required):
-     gcc -O -fopenmp -o matrixSum-openmp matrixSum-openmp.c 
-     ./matrixSum-openmp size numWorkers
+   The whole reduction is one parallel for (common/omp_reduce.h): the sum
+   uses the + reduction, and the min and max with their positions use the
+   user-defined reductions minloc and maxloc over (value, row, col), so
+   there is no critical section and no cap on the number of threads. Ties go
+   to the earlier position, so the result does not depend on the number of
+   threads or the schedule. Each row is reduced by an omp simd loop, or with
+   --kernel by the SIMD kernel in common/reduce_kernel.h.
+   matrixSum-mpi.c runs the same reduction on each rank's shard of rows.
+   The loop schedule is schedule(runtime), set by --schedule (or
+   OMP_SCHEDULE); --bench times static, dynamic, and guided with a range of
+   chunk sizes.
+   The matrix is initialized in parallel from a counter-based generator
+   keyed by the seed and (row, col), so a given --seed yields the same
+   matrix for any numWorkers.
+
+   usage with gcc (version 4.9 or higher required, for declare reduction and simd):
+     gcc -O2 -fopenmp -o matrixSum-openmp matrixSum-openmp.c
+     ./matrixSum-openmp [--kernel=omp|auto|scalar|sse4.1|avx2|avx512] [--seed=N]
+                        [--schedule=static|dynamic|guided[,chunk]] [--bench] size numWorkers
+
+   numWorkers defaults to the number of processors OpenMP uses.
 
 */
 
 #include <omp.h>
 #include <stdio.h>
+#include <stdbool.h>
 #include <stdlib.h> // For atoi, rand, srand
 #include <time.h>   // For time
+#include <string.h> // For strncmp
 #include <limits.h> // For INT_MAX, INT_MIN
+#include "../../common/reduce_kernel.h"
+#include "../../common/omp_reduce.h"
+#include "../../common/counter_rng.h"
 
 #define MAXSIZE 10000  /* maximum matrix size */
-#define MAXWORKERS 8   /* maximum number of workers */
+#define BENCH_RUNS 5   /* runs per schedule in --bench, median is reported */
 
 double start_time, end_time;
 
 int numWorkers;
-int size; 
+int size;
 int matrix[MAXSIZE][MAXSIZE];
+bool useKernel = false; /* rows by reduce_row instead of the omp simd loop */
+
+/* sum, min, and max of the matrix with the current schedule */
+static void Reduce(long long *sum, Located *minLoc, Located *maxLoc) {
+  omp_reduce_rows(&matrix[0][0], size, size, MAXSIZE, 0, useKernel, sum, minLoc, maxLoc);
+}
 
-// Global variables for min/max and their positions, updated by critical sections
-int global_min_val = INT_MAX;
-int global_max_val = INT_MIN;
-int global_min_row = -1, global_min_col = -1;
-int global_max_row = -1, global_max_col = -1;
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+/* median time of Reduce() for each schedule kind and chunk size */
+static void Benchmark(void) {
+  static const struct { omp_sched_t kind; const char *name; } kinds[] = {
+    { omp_sched_static, "static" }, { omp_sched_dynamic, "dynamic" }, { omp_sched_guided, "guided" }
+  };
+  static const int chunks[] = { 0, 1, 4, 16, 64, 256 }; /* 0: the default chunk */
+  double times[BENCH_RUNS];
+  long long sum;
+  Located mn, mx;
+  int k, c, run;
+
+  printf("Schedules, %dx%d matrix, %d threads (median of %d runs)\n", size, size, numWorkers, BENCH_RUNS);
+  printf("%8s %7s %12s %14s\n", "schedule", "chunk", "time (sec)", "rows/sec");
+  for (k = 0; k < 3; k++)
+    for (c = 0; c < (int) (sizeof(chunks) / sizeof(chunks[0])); c++) {
+      omp_set_schedule(kinds[k].kind, chunks[c]);
+      for (run = 0; run < BENCH_RUNS; run++) {
+        double t = omp_get_wtime();
+        Reduce(&sum, &mn, &mx);
+        times[run] = omp_get_wtime() - t;
+      }
+      qsort(times, BENCH_RUNS, sizeof(double), compare_doubles);
+      if (chunks[c] == 0)
+        printf("%8s %7s %12g %14g\n", kinds[k].name, "default", times[BENCH_RUNS/2], size / times[BENCH_RUNS/2]);
+      else
+        printf("%8s %7d %12g %14g\n", kinds[k].name, chunks[c], times[BENCH_RUNS/2], size / times[BENCH_RUNS/2]);
+    }
+}
 
+/* parse static|dynamic|guided[,chunk] */
+static bool ParseSchedule(const char *s, omp_sched_t *kind, int *chunk) {
+  size_t len = strcspn(s, ",");
+  if (strncmp(s, "static", len) == 0 && len == 6) *kind = omp_sched_static;
+  else if (strncmp(s, "dynamic", len) == 0 && len == 7) *kind = omp_sched_dynamic;
+  else if (strncmp(s, "guided", len) == 0 && len == 6) *kind = omp_sched_guided;
+  else return false;
+  *chunk = (s[len] == ',') ? atoi(s + len + 1) : 0;
+  return true;
+}
 
 /* read command line, initialize, and create threads */
 int main(int argc, char *argv[]) {
-  int i, j;
-  long long total_sum = 0; // Use long long for sum to prevent overflow on large matrices
-
-  /* read command line args if any */
-  size = (argc > 1)? atoi(argv[1]) : MAXSIZE;
-  numWorkers = (argc > 2)? atoi(argv[2]) : MAXWORKERS;
+  int i, j, chunk = 0;
+  long long total_sum; // Use long long for sum to prevent overflow on large matrices
+  Located minLoc, maxLoc;
+  const char *kernelName = "omp";
+  uint64_t seed = time(NULL);
+  omp_sched_t kind = omp_sched_static;
+  bool scheduleSet = false, bench = false;
+  double init_time;
+  char *args[2];
+  int numArgs = 0;
+
+  /* read command line options, then positional args if any */
+  for (i = 1; i < argc; i++) {
+    if (strncmp(argv[i], "--kernel=", 9) == 0)
+      kernelName = argv[i] + 9;
+    else if (strncmp(argv[i], "--seed=", 7) == 0)
+      seed = strtoull(argv[i] + 7, NULL, 10);
+    else if (strncmp(argv[i], "--schedule=", 11) == 0) {
+      if (!ParseSchedule(argv[i] + 11, &kind, &chunk)) {
+        fprintf(stderr, "Unknown schedule: %s (use static, dynamic, or guided[,chunk])\n", argv[i] + 11);
+        exit(1);
+      }
+      scheduleSet = true;
+    }
+    else if (strcmp(argv[i], "--bench") == 0)
+      bench = true;
+    else if (numArgs < 2)
+      args[numArgs++] = argv[i];
+  }
+  useKernel = strcmp(kernelName, "omp") != 0;
+  if (useKernel && reduce_kernel_select(kernelName) == NULL) {
+    fprintf(stderr, "Unknown or unsupported kernel: %s\n", kernelName);
+    exit(1);
+  }
+  size = (numArgs > 0)? atoi(args[0]) : MAXSIZE;
+  numWorkers = (numArgs > 1)? atoi(args[1]) : omp_get_num_procs();
   if (size > MAXSIZE) size = MAXSIZE;
-  if (numWorkers > MAXWORKERS) numWorkers = MAXWORKERS;
+  if (size < 1) size = 1;
 
   // Ensure numWorkers is at least 1
   if (numWorkers <= 0) numWorkers = 1;
 
   omp_set_num_threads(numWorkers);
-
-  /* initialize the matrix with random values */
-  srand(time(NULL)); // Seed random number generator once for varied results
+  if (scheduleSet)
+    omp_set_schedule(kind, chunk);
+  else if (getenv("OMP_SCHEDULE") == NULL)
+    omp_set_schedule(omp_sched_static, 0); /* the default of a plain omp for */
+
+  /* initialize the matrix with seeded random values, in parallel */
+  init_time = omp_get_wtime();
+  #pragma omp parallel for private(j)
   for (i = 0; i < size; i++) {
-	  for (j = 0; j < size; j++) {
-      matrix[i][j] = rand()%100; // Random values between 0 and 99
-	  }
-  }
-
-  start_time = omp_get_wtime();
-
-  // OpenMP parallel region to compute sum, min, and max
-  #pragma omp parallel reduction(+:total_sum)
-  {
-    // Thread-private variables for min/max and their positions
-    int thread_local_min_val = INT_MAX;
-    int thread_local_max_val = INT_MIN;
-    int thread_local_min_row = -1, thread_local_min_col = -1;
-    int thread_local_max_row = -1, thread_local_max_col = -1;
-
-    // Use OpenMP for-loop. 'private(j)' is implicitly handled if 'j' is declared
-    // within the loop, but explicitly stating it is safer for older standards or complex cases.
-    #pragma omp for private(j)
-    for (i = 0; i < size; i++) {
-      for (j = 0; j < size; j++) {
-        int current_val = matrix[i][j];
-        total_sum += current_val; // Sum reduction is handled by OpenMP
-
-        // Update thread-local min/max
-        if (current_val < thread_local_min_val) {
-          thread_local_min_val = current_val;
-          thread_local_min_row = i;
-          thread_local_min_col = j;
-        }
-        if (current_val > thread_local_max_val) {
-          thread_local_max_val = current_val;
-          thread_local_max_row = i;
-          thread_local_max_col = j;
-        }
-      }
+    for (j = 0; j < size; j++) {
+      matrix[i][j] = (int) counter_rng_below(seed, (uint64_t) i * size + j, 100); // Random values between 0 and 99
     }
+  }
+  init_time = omp_get_wtime() - init_time;
+  printf("The initialization time is %g seconds (seed %llu)\n", init_time, (unsigned long long) seed);
 
-    // Combine thread-local min/max results into global min/max using a critical section.
-    // This ensures only one thread updates the global variables at a time, preventing race conditions.
-    #pragma omp critical
-    {
-      if (thread_local_min_val < global_min_val) {
-        global_min_val = thread_local_min_val;
-        global_min_row = thread_local_min_row;
-        global_min_col = thread_local_min_col;
-      }
-      if (thread_local_max_val > global_max_val) {
-        global_max_val = thread_local_max_val;
-        global_max_row = thread_local_max_row;
-        global_max_col = thread_local_max_col;
-      }
-    }
-  } // Implicit barrier here ensures all threads complete before proceeding
+  if (bench) {
+    Benchmark();
+    return 0;
+  }
 
+  start_time = omp_get_wtime();
+  Reduce(&total_sum, &minLoc, &maxLoc);
   end_time = omp_get_wtime();
 
+  omp_get_schedule(&kind, &chunk);
   printf("The total sum is %lld\n", total_sum);
-  printf("The minimum element is %d at (%d, %d)\n", global_min_val, global_min_row, global_min_col);
-  printf("The maximum element is %d at (%d, %d)\n", global_max_val, global_max_row, global_max_col);
-  printf("It took %g seconds\n", end_time - start_time);
+  printf("The minimum element is %d at (%d, %d)\n", minLoc.value, minLoc.row, minLoc.col);
+  printf("The maximum element is %d at (%d, %d)\n", maxLoc.value, maxLoc.row, maxLoc.col);
+  printf("It took %g seconds (%s kernel, %s schedule, chunk %d, %d threads)\n", end_time - start_time,
+         useKernel ? reduce_kernel_name : "omp simd",
+         kind == omp_sched_static ? "static" : kind == omp_sched_dynamic ? "dynamic" :
+         kind == omp_sched_guided ? "guided" : "auto", chunk, numWorkers);
 
   return 0;
 }
-
@@ -8,14 +8,16 @@
  * independent tasks, allowing for parallel exploration of the sort tree.
  *
  * The program measures the execution time of the parallel sort and can be
- * used to evaluate speedup by varying the number of threads.
+ * used to evaluate speedup by varying the number of threads. With --perf,
+ * each thread also counts cycles, instructions, LLC misses, and branch
+ * misses over the sort (common/perf_counters.h), printed per thread.
  *
  * To compile:
  *   gcc -o quicksort_openmp quicksort_openmp.c -fopenmp
  *
  * To run:
  *   export OMP_NUM_THREADS=<number_of_threads>
- *   ./quicksort_openmp <array_size>
+ *   ./quicksort_openmp [--perf] <array_size>
  *   Example:
  *   export OMP_NUM_THREADS=4
  *   ./quicksort_openmp 1000000
@@ -27,7 +29,9 @@
 #include <omp.h> 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include "../../common/perf_counters.h"
 
 // Function prototypes
 void swap(int* a, int* b);
@@ -87,12 +91,25 @@ void quicksort_omp(int* array, int low, int high) {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <array_size>\n", argv[0]);
+    const char* size_arg = NULL;
+    int perf = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--perf") == 0) {
+            perf = 1;
+        } else if (size_arg == NULL) {
+            size_arg = argv[i];
+        } else {
+            size_arg = NULL;
+            break;
+        }
+    }
+    if (size_arg == NULL) {
+        fprintf(stderr, "Usage: %s [--perf] <array_size>\n", argv[0]);
         return 1;
     }
 
-    int n = atoi(argv[1]);
+    int n = atoi(size_arg);
     if (n <= 0) {
         fprintf(stderr, "Array size must be positive.\n");
         return 1;
@@ -116,22 +133,35 @@ int main(int argc, char* argv[]) {
     // omp_set_num_threads(4); 
 
     double start_time, end_time;
+    int num_threads = omp_get_max_threads();
+    PerfCounters* counters = perf ? calloc(num_threads, sizeof(PerfCounters)) : NULL;
 
     start_time = omp_get_wtime();
 
     // The parallel region is created once.
     #pragma omp parallel
     {
+        PerfCounters* my_counters = counters ? &counters[omp_get_thread_num()] : NULL;
+        if (my_counters) perf_counters_start(my_counters);
+
         // One thread (the first one to reach this directive) creates the initial tasks.
         #pragma omp single nowait
         {
             quicksort_omp(array, 0, n - 1);
         }
-    } // Implicit barrier here ensures all tasks are completed before proceeding.
+
+        // All tasks are completed at this barrier, so they are counted.
+        #pragma omp barrier
+        if (my_counters) perf_counters_stop(my_counters);
+    }
 
     end_time = omp_get_wtime();
 
     printf("Execution time: %f seconds\n", end_time - start_time);
+    if (counters) {
+        perf_counters_print(counters, num_threads, "sort");
+        free(counters);
+    }
 
     // Verification
     int sorted = 1;
@@ -12,14 +12,16 @@
  * hash set of all words. The main parallel loop then iterates through each
  * word. Each thread collects its own findings in a private list to avoid
  * synchronization overhead. These lists are then merged sequentially after the
- * parallel section.
+ * parallel section. With --perf, each thread also counts cycles, instructions,
+ * LLC misses, and branch misses over its share of the search
+ * (common/perf_counters.h), printed per thread.
  *
  * To compile:
  *   gcc -o palindromes palindromes.c -fopenmp
  *
  * To run:
  *   export OMP_NUM_THREADS=<number_of_threads>
- *   ./palindromes <dictionary_file> <output_file>
+ *   ./palindromes [--perf] <dictionary_file> <output_file>
  *   Example:
  *   export OMP_NUM_THREADS=4
  *   ./palindromes /usr/share/dict/words results.txt
@@ -29,6 +31,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include "../../common/perf_counters.h"
 
 #define MAX_WORD_LEN 100
 #define MAX_WORDS 500000
@@ -157,15 +160,28 @@ void cleanup() {
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        fprintf(stderr, "Usage: %s <dictionary_file> <output_file>\n", argv[0]);
+    const char* files[2];
+    int num_files = 0, perf = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--perf") == 0) {
+            perf = 1;
+        } else if (num_files < 2) {
+            files[num_files++] = argv[i];
+        } else {
+            num_files = 0;
+            break;
+        }
+    }
+    if (num_files != 2) {
+        fprintf(stderr, "Usage: %s [--perf] <dictionary_file> <output_file>\n", argv[0]);
         return 1;
     }
     
     atexit(cleanup);
 
     // --- Sequential Part: Input ---
-    if (!read_dictionary(argv[1])) {
+    if (!read_dictionary(files[0])) {
         perror("fopen dictionary");
         return 1;
     }
@@ -179,6 +195,7 @@ int main(int argc, char* argv[]) {
     // Per-thread result lists
     WordList per_thread_palindromes[MAX_THREADS];
     WordList per_thread_semordnilaps[MAX_THREADS];
+    PerfCounters* counters = perf ? calloc(omp_get_max_threads(), sizeof(PerfCounters)) : NULL;
 
     // --- Parallel Part: Computation ---
     printf("Finding palindromes and semordnilaps...\n");
@@ -189,8 +206,10 @@ int main(int argc, char* argv[]) {
         int tid = omp_get_thread_num();
         list_init(&per_thread_palindromes[tid], 100);
         list_init(&per_thread_semordnilaps[tid], 100);
+        if (counters) perf_counters_start(&counters[tid]);
 
-        #pragma omp for schedule(dynamic, 100)
+        // nowait: the counters stop before the barrier at the end of the region
+        #pragma omp for schedule(dynamic, 100) nowait
         for (int i = 0; i < all_words_count; i++) {
             char reversed_word[MAX_WORD_LEN];
             reverse_string(all_words[i], reversed_word);
@@ -201,13 +220,18 @@ int main(int argc, char* argv[]) {
                 list_add(&per_thread_semordnilaps[tid], all_words[i]);
             }
         }
+        if (counters) perf_counters_stop(&counters[tid]);
     }
 
     double end_time = omp_get_wtime();
     printf("Computation finished in %f seconds.\n", end_time - start_time);
+    if (counters) {
+        perf_counters_print(counters, omp_get_max_threads(), "search");
+        free(counters);
+    }
 
     // --- Sequential Part: Output ---
-    FILE* outfile = fopen(argv[2], "w");
+    FILE* outfile = fopen(files[1], "w");
     if (!outfile) {
         perror("fopen output");
         return 1;
@@ -239,7 +263,7 @@ int main(int argc, char* argv[]) {
     }
     
     fclose(outfile);
-    printf("Done. Wrote %d palindromes and %d semordnilap pairs to %s.\n", total_palindromes, total_semordnilaps, argv[2]);
+    printf("Done. Wrote %d palindromes and %d semordnilap pairs to %s.\n", total_palindromes, total_semordnilaps, files[1]);
 
     // --- Local Cleanup ---
     for(int i = 0; i < max_threads; i++) {
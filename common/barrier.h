@@ -0,0 +1,300 @@
+/* reusable barriers for a fixed number of threads
+
+   features: one interface over several algorithms, chosen at run time:
+               condvar        the classic counter under a mutex, released
+                              with pthread_cond_broadcast
+               central        sense-reversing counter barrier (an atomic
+                              counter and one global release flag)
+               tree           software combining tree with fan-in 4; the
+                              last thread to reach the root flips the
+                              global release flag
+               dissemination  ceil(log2 n) rounds, in round r thread i
+                              signals thread (i + 2^r) mod n
+               tournament     winners wait for losers up a binary tree,
+                              then wake them back down the same tree
+             The algorithms are those of Mellor-Crummey & Scott, "Algorithms
+             for Scalable Synchronization on Shared-Memory Multiprocessors"
+             (TOCS 1991). Every flag is waited on by spinning for a while and
+             then sleeping on a futex, so threads do not burn a CPU when there
+             are more threads than CPUs (then no spinning is done at all), and
+             a setter only calls futex_wake when someone is asleep.
+             Threads are identified by an id in [0, n).
+
+   usage:
+     #include "../../common/barrier.h"
+
+     ThreadBarrier b;
+     BarrierKind kind;
+     barrier_parse("dissemination", &kind);
+     barrier_init(&b, kind, numWorkers);
+     barrier_wait(&b, myid);           // in each worker, any number of times
+     barrier_destroy(&b);
+
+*/
+#ifndef BARRIER_H
+#define BARRIER_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#define BARRIER_CACHE_LINE 64
+#define BARRIER_SPINS 4000 /* polls of a flag before sleeping on it */
+#define BARRIER_FANIN 4    /* children per combining-tree node */
+
+typedef enum {
+  BARRIER_CONDVAR, BARRIER_CENTRAL, BARRIER_TREE, BARRIER_DISSEMINATION, BARRIER_TOURNAMENT
+} BarrierKind;
+
+#define BARRIER_KINDS 5
+
+static const char *const barrier_kind_names[BARRIER_KINDS] = {
+  "condvar", "central", "tree", "dissemination", "tournament"
+};
+
+/* a word to wait on, alone in its cache line */
+typedef struct {
+  _Alignas(BARRIER_CACHE_LINE) atomic_int value;
+  atomic_int sleepers; /* threads in (or about to enter) futex_wait */
+} BarrierFlag;
+
+/* one combining-tree node */
+typedef struct {
+  _Alignas(BARRIER_CACHE_LINE) atomic_int count;
+  int threshold;        /* children that arrive here */
+  int parent;           /* index of the parent node, -1 at the root */
+} BarrierNode;
+
+/* per-thread state */
+typedef struct {
+  _Alignas(BARRIER_CACHE_LINE) int sense;
+  int parity;           /* dissemination: which of the two flag sets */
+  int leaf;             /* tree: the node this thread arrives at */
+} BarrierThread;
+
+typedef struct {
+  BarrierKind kind;
+  int n, rounds, spins;
+  BarrierThread *threads;
+  /* condvar */
+  pthread_mutex_t mutex;
+  pthread_cond_t go;
+  int arrived;
+  long long episode;
+  /* central and tree */
+  BarrierFlag release;
+  atomic_int count;
+  BarrierNode *nodes;
+  /* dissemination: flags[(parity * rounds + r) * n + i]; tournament:
+     flags[r * n + i] are arrivals and flags[rounds * n + i] wakeups */
+  BarrierFlag *flags;
+} ThreadBarrier;
+
+/* parse an algorithm name; returns false if unknown */
+static inline bool barrier_parse(const char *name, BarrierKind *kind) {
+  int k;
+  for (k = 0; k < BARRIER_KINDS; k++)
+    if (strcmp(name, barrier_kind_names[k]) == 0) {
+      *kind = (BarrierKind) k;
+      return true;
+    }
+  return false;
+}
+
+static inline const char *barrier_kind_name(BarrierKind kind) {
+  return barrier_kind_names[kind];
+}
+
+static inline void barrier_flag_set(BarrierFlag *f, int v) {
+  atomic_store(&f->value, v);
+  if (atomic_load(&f->sleepers) > 0)
+    syscall(SYS_futex, &f->value, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+/* spin, then sleep, until the flag holds v */
+static inline void barrier_flag_wait(BarrierFlag *f, int v, int spins) {
+  int i, seen;
+  for (i = 0; i < spins; i++) {
+    if (atomic_load_explicit(&f->value, memory_order_acquire) == v)
+      return;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+  }
+  atomic_fetch_add(&f->sleepers, 1);
+  /* futex_wait returns at once if the value is no longer seen, so a set
+     between the load and the call is not missed */
+  while ((seen = atomic_load(&f->value)) != v)
+    syscall(SYS_futex, &f->value, FUTEX_WAIT_PRIVATE, seen, NULL, NULL, 0);
+  atomic_fetch_sub(&f->sleepers, 1);
+}
+
+static inline void *barrier_calloc(size_t count, size_t size) {
+  void *p = aligned_alloc(BARRIER_CACHE_LINE, count * size);
+  if (p == NULL) {
+    fprintf(stderr, "Out of memory for a barrier\n");
+    exit(1);
+  }
+  memset(p, 0, count * size);
+  return p;
+}
+
+/* build the combining tree bottom-up: level 0 groups the threads by
+   BARRIER_FANIN, each next level groups the nodes of the one below */
+static inline void barrier_build_tree(ThreadBarrier *b) {
+  int width = (b->n + BARRIER_FANIN - 1) / BARRIER_FANIN, total = 0, w, first, i;
+
+  for (w = width; ; w = (w + BARRIER_FANIN - 1) / BARRIER_FANIN) {
+    total += w;
+    if (w == 1) break;
+  }
+  b->nodes = barrier_calloc(total, sizeof(BarrierNode));
+  for (i = 0; i < b->n; i++) {
+    b->threads[i].leaf = i / BARRIER_FANIN;
+    b->nodes[i / BARRIER_FANIN].threshold++;
+  }
+  for (first = 0, w = width; w > 1; first += w, w = (w + BARRIER_FANIN - 1) / BARRIER_FANIN) {
+    for (i = 0; i < w; i++) {
+      b->nodes[first + i].parent = first + w + i / BARRIER_FANIN;
+      b->nodes[first + w + i / BARRIER_FANIN].threshold++;
+    }
+  }
+  b->nodes[first].parent = -1;
+}
+
+static inline void barrier_init(ThreadBarrier *b, BarrierKind kind, int n) {
+  long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int i;
+
+  memset(b, 0, sizeof(*b));
+  b->kind = kind;
+  b->n = (n > 0) ? n : 1;
+  b->spins = (ncpus > 0 && b->n <= ncpus) ? BARRIER_SPINS : 0;
+  for (b->rounds = 0; (1 << b->rounds) < b->n; b->rounds++)
+    ;
+  b->threads = barrier_calloc(b->n, sizeof(BarrierThread));
+  for (i = 0; i < b->n; i++)
+    b->threads[i].sense = 1;
+
+  switch (kind) {
+  case BARRIER_CONDVAR:
+    pthread_mutex_init(&b->mutex, NULL);
+    pthread_cond_init(&b->go, NULL);
+    break;
+  case BARRIER_CENTRAL:
+    break;
+  case BARRIER_TREE:
+    barrier_build_tree(b);
+    break;
+  case BARRIER_DISSEMINATION:
+    b->flags = barrier_calloc(2 * b->rounds * b->n + 1, sizeof(BarrierFlag));
+    break;
+  case BARRIER_TOURNAMENT:
+    b->flags = barrier_calloc((b->rounds + 1) * b->n, sizeof(BarrierFlag));
+    break;
+  }
+}
+
+static inline void barrier_destroy(ThreadBarrier *b) {
+  if (b->kind == BARRIER_CONDVAR) {
+    pthread_mutex_destroy(&b->mutex);
+    pthread_cond_destroy(&b->go);
+  }
+  free(b->threads);
+  free(b->nodes);
+  free(b->flags);
+}
+
+/* arrive at node, and at its parent if this thread completes it */
+static inline void barrier_tree_arrive(ThreadBarrier *b, int node, int sense) {
+  BarrierNode *nd = &b->nodes[node];
+  if (atomic_fetch_add(&nd->count, 1) + 1 == nd->threshold) {
+    atomic_store(&nd->count, 0);
+    if (nd->parent >= 0)
+      barrier_tree_arrive(b, nd->parent, sense);
+    else
+      barrier_flag_set(&b->release, sense);
+  }
+}
+
+/* wait until all n threads have called barrier_wait for this episode */
+static inline void barrier_wait(ThreadBarrier *b, long id) {
+  BarrierThread *me = &b->threads[id];
+  int sense = me->sense, r, n = b->n;
+
+  switch (b->kind) {
+  case BARRIER_CONDVAR: {
+    long long episode;
+    pthread_mutex_lock(&b->mutex);
+    episode = b->episode;
+    if (++b->arrived == n) {
+      b->arrived = 0;
+      b->episode++;
+      pthread_cond_broadcast(&b->go);
+    } else
+      while (b->episode == episode) /* guard against spurious wakeups */
+        pthread_cond_wait(&b->go, &b->mutex);
+    pthread_mutex_unlock(&b->mutex);
+    return;
+  }
+
+  case BARRIER_CENTRAL:
+    if (atomic_fetch_add(&b->count, 1) + 1 == n) {
+      atomic_store(&b->count, 0);
+      barrier_flag_set(&b->release, sense);
+    } else
+      barrier_flag_wait(&b->release, sense, b->spins);
+    break;
+
+  case BARRIER_TREE:
+    barrier_tree_arrive(b, me->leaf, sense);
+    barrier_flag_wait(&b->release, sense, b->spins);
+    break;
+
+  case BARRIER_DISSEMINATION: {
+    BarrierFlag *flags = b->flags + (size_t) me->parity * b->rounds * n;
+    for (r = 0; r < b->rounds; r++) {
+      barrier_flag_set(&flags[(size_t) r * n + (id + (1L << r)) % n], sense);
+      barrier_flag_wait(&flags[(size_t) r * n + id], sense, b->spins);
+    }
+    /* the flags of parity p are reused every other episode, with the
+       sense flipped, so no flag has to be reset */
+    if (me->parity == 1)
+      me->sense = !sense;
+    me->parity = 1 - me->parity;
+    return;
+  }
+
+  case BARRIER_TOURNAMENT: {
+    BarrierFlag *wakeup = b->flags + (size_t) b->rounds * n;
+    /* arrive: in round r, id is a winner if its low r+1 bits are zero;
+       a winner waits for its loser id + 2^r, a loser signals its winner
+       and waits to be woken */
+    for (r = 0; r < b->rounds; r++) {
+      long step = 1L << r;
+      if (id & step) {
+        barrier_flag_set(&b->flags[(size_t) r * n + id - step], sense);
+        barrier_flag_wait(&wakeup[id], sense, b->spins);
+        break;
+      }
+      if (id + step < n)
+        barrier_flag_wait(&b->flags[(size_t) r * n + id], sense, b->spins);
+    }
+    /* wake the losers of rounds below the one this thread left at */
+    for (r = r - 1; r >= 0; r--)
+      if (id + (1L << r) < n)
+        barrier_flag_set(&wakeup[id + (1L << r)], sense);
+    break;
+  }
+  }
+  me->sense = !sense;
+}
+
+#endif /* BARRIER_H */
@@ -0,0 +1,41 @@
+/* counter-based random numbers
+
+   features: value k of a stream is computed directly from (seed, k) as the
+             k-th output of SplitMix64 started at seed (Steele, Lea & Flood,
+             "Fast Splittable Pseudorandom Number Generators", OOPSLA 2014),
+             so any thread can produce any part of the stream without shared
+             state, and the result does not depend on how the counters are
+             split among threads.
+
+   usage:
+     #include "../../common/counter_rng.h"
+
+     uint64_t x = splitmix64_at(seed, k);          // 64 random bits
+     int v = (int) counter_rng_below(seed, k, 100); // uniform in [0, 100)
+
+*/
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <stdint.h>
+
+#define SPLITMIX64_GAMMA 0x9E3779B97F4A7C15ULL
+
+/* the SplitMix64 output function (a variant of the MurmurHash3 finalizer) */
+static inline uint64_t splitmix64_mix(uint64_t z) {
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+/* the k-th (from 0) output of SplitMix64 seeded with seed */
+static inline uint64_t splitmix64_at(uint64_t seed, uint64_t k) {
+  return splitmix64_mix(seed + (k + 1) * SPLITMIX64_GAMMA);
+}
+
+/* uniform in [0, n), by Lemire's multiply-shift on the high 32 bits */
+static inline uint32_t counter_rng_below(uint64_t seed, uint64_t k, uint32_t n) {
+  return (uint32_t) (((splitmix64_at(seed, k) >> 32) * n) >> 32);
+}
+
+#endif /* COUNTER_RNG_H */
@@ -0,0 +1,90 @@
+/* matrix element types for the matrixSum programs
+
+   features: the element types a matrix can be stored in, as one X-macro
+             list, so that code specialized per type (the reduction kernels
+             in typed_kernel.h, the random fill in matrix_alloc.h) is
+             generated from a single table. Narrow types cut the memory
+             traffic of a reduction: the values 0..99 of the random matrices
+             fit in one byte instead of four.
+             The codes are the elemType field of common/matrix_file.h.
+
+   usage:
+     #include "../../common/elem_type.h"
+
+     uint32_t type;
+     if (matrix_parse_elem("int8", &type))
+       ... matrix_elem_size(type), matrix_elem_name(type) ...
+
+*/
+#ifndef ELEM_TYPE_H
+#define ELEM_TYPE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/* X(ID, code, name, C type, block accumulator, elements per block, lanes)
+
+   The accumulator is the narrowest type that cannot overflow over a block
+   of that many elements; block sums are then added into 64 bits (long long
+   or double). Lanes is the number of independent accumulators per kernel
+   loop: the integer reductions are vectorized by the compiler as they are,
+   the floating-point ones only when split into lanes, since reassociating a
+   single floating-point sum changes its rounding. */
+#define MATRIX_ELEM_TYPES(X)                                   \
+  X(INT32,  1, int32,  int32_t,  int64_t,  1 << 29, 1)         \
+  X(INT8,   2, int8,   int8_t,   int32_t,  1 << 23, 1)         \
+  X(UINT8,  3, uint8,  uint8_t,  uint32_t, 1 << 24, 1)         \
+  X(INT16,  4, int16,  int16_t,  int32_t,  1 << 15, 1)         \
+  X(INT64,  5, int64,  int64_t,  int64_t,  1 << 29, 1)         \
+  X(FLOAT,  6, float,  float,    double,   1 << 29, 16)        \
+  X(DOUBLE, 7, double, double,   double,   1 << 29, 16)
+
+#define MATRIX_ELEM_ENUM(ID, code, name, T, ACC, BLOCK, LANES) MATRIX_ELEM_##ID = code,
+enum { MATRIX_ELEM_TYPES(MATRIX_ELEM_ENUM) };
+#undef MATRIX_ELEM_ENUM
+
+/* bytes per element, 0 for an unknown type */
+static inline size_t matrix_elem_size(uint32_t type) {
+  switch (type) {
+#define MATRIX_ELEM_SIZE(ID, code, name, T, ACC, BLOCK, LANES) case code: return sizeof(T);
+  MATRIX_ELEM_TYPES(MATRIX_ELEM_SIZE)
+#undef MATRIX_ELEM_SIZE
+  }
+  return 0;
+}
+
+static inline const char *matrix_elem_name(uint32_t type) {
+  switch (type) {
+#define MATRIX_ELEM_NAME(ID, code, name, T, ACC, BLOCK, LANES) case code: return #name;
+  MATRIX_ELEM_TYPES(MATRIX_ELEM_NAME)
+#undef MATRIX_ELEM_NAME
+  }
+  return "unknown";
+}
+
+static inline bool matrix_elem_is_float(uint32_t type) {
+  return type == MATRIX_ELEM_FLOAT || type == MATRIX_ELEM_DOUBLE;
+}
+
+/* parse a type name ("int8", "float", ...); returns false if unknown */
+static inline bool matrix_parse_elem(const char *s, uint32_t *type) {
+#define MATRIX_ELEM_PARSE(ID, code, name, T, ACC, BLOCK, LANES) \
+  if (strcmp(s, #name) == 0) { *type = code; return true; }
+  MATRIX_ELEM_TYPES(MATRIX_ELEM_PARSE)
+#undef MATRIX_ELEM_PARSE
+  return false;
+}
+
+/* store the small integer v as element idx of an array of the given type */
+static inline void matrix_elem_store(void *m, size_t idx, uint32_t type, int v) {
+  switch (type) {
+#define MATRIX_ELEM_STORE(ID, code, name, T, ACC, BLOCK, LANES) \
+  case code: ((T *) m)[idx] = (T) v; break;
+  MATRIX_ELEM_TYPES(MATRIX_ELEM_STORE)
+#undef MATRIX_ELEM_STORE
+  }
+}
+
+#endif /* ELEM_TYPE_H */
@@ -0,0 +1,250 @@
+/* cache-blocked double-precision matrix multiplication for the matrixSum programs
+
+   features: C = A * B for row-major A (m x k), B (k x n), C (m x n), in the
+             loop structure of Goto's algorithm:
+               jc: panels of GEMM_NC columns of B and C          (L3)
+               pc: blocks of GEMM_KC of the inner dimension      B panel packed
+               ic: blocks of GEMM_MC rows of A and C             (L2) A block packed
+               jr, ir: GEMM_MR x GEMM_NR tiles of C              (registers)
+             Packing copies a block of A into GEMM_MR-row slivers and a panel
+             of B into GEMM_NR-column slivers, each stored p-major, so the
+             micro-kernel streams both with unit stride; the edges are padded
+             with zeros and their tiles go through a scratch tile.
+             The micro-kernel keeps the GEMM_MR x GEMM_NR tile of C in
+             registers over the whole GEMM_KC loop. A scalar and an AVX2+FMA
+             kernel (12 ymm accumulators) are compiled with per-function
+             target attributes and picked at runtime via cpuid, as in
+             reduce_kernel.h.
+             gemm_tile() multiplies one rectangle of C, so threads can split C
+             two-dimensionally (gemm_grid() picks the grid and gemm_part() the
+             rows or columns of a worker); each worker packs into its own
+             buffers (gemm_buffers_alloc()).
+
+   usage:
+     #include "../../common/gemm.h"
+
+     gemm_kernel_select("auto");        // or "scalar", "avx2"
+     GemmBuffers buf;
+     gemm_buffers_alloc(&buf);
+     gemm_tile(A, B, C, m0, m1, n0, n1, k, lda, ldb, ldc, &buf);  // rows m0..m1-1, cols n0..n1-1
+     gemm_buffers_free(&buf);
+
+*/
+#ifndef GEMM_H
+#define GEMM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define GEMM_X86 1
+#include <immintrin.h>
+#endif
+
+#define GEMM_MR 6      /* rows of the register tile */
+#define GEMM_NR 8      /* columns of the register tile: two 4-double vectors */
+#define GEMM_KC 256    /* inner dimension per packed block: a B sliver is 16 KB, in L1 */
+#define GEMM_MC 96     /* rows per packed A block: 192 KB, in L2 */
+#define GEMM_NC 2048   /* columns per packed B panel: 4 MB, in L3 */
+
+/* c[0..MR)[0..NR) (row stride ldc) += the packed sliver a times the packed sliver b */
+typedef void (*GemmMicroFn)(int kc, const double *a, const double *b, double *c, size_t ldc);
+
+static inline void gemm_micro_scalar(int kc, const double *a, const double *b, double *c, size_t ldc) {
+  double acc[GEMM_MR][GEMM_NR] = { { 0 } };
+  int p, i, j;
+  for (p = 0; p < kc; p++, a += GEMM_MR, b += GEMM_NR)
+    for (i = 0; i < GEMM_MR; i++)
+      for (j = 0; j < GEMM_NR; j++)
+        acc[i][j] += a[i] * b[j];
+  for (i = 0; i < GEMM_MR; i++)
+    for (j = 0; j < GEMM_NR; j++)
+      c[i * ldc + j] += acc[i][j];
+}
+
+#ifdef GEMM_X86
+__attribute__((target("avx2,fma")))
+static inline void gemm_micro_avx2(int kc, const double *a, const double *b, double *c, size_t ldc) {
+  __m256d c00 = _mm256_setzero_pd(), c01 = _mm256_setzero_pd();
+  __m256d c10 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+  __m256d c20 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+  __m256d c30 = _mm256_setzero_pd(), c31 = _mm256_setzero_pd();
+  __m256d c40 = _mm256_setzero_pd(), c41 = _mm256_setzero_pd();
+  __m256d c50 = _mm256_setzero_pd(), c51 = _mm256_setzero_pd();
+  int p;
+
+  for (p = 0; p < kc; p++, a += GEMM_MR, b += GEMM_NR) {
+    __m256d b0 = _mm256_load_pd(b), b1 = _mm256_load_pd(b + 4), ai;
+    ai = _mm256_broadcast_sd(a + 0);
+    c00 = _mm256_fmadd_pd(ai, b0, c00); c01 = _mm256_fmadd_pd(ai, b1, c01);
+    ai = _mm256_broadcast_sd(a + 1);
+    c10 = _mm256_fmadd_pd(ai, b0, c10); c11 = _mm256_fmadd_pd(ai, b1, c11);
+    ai = _mm256_broadcast_sd(a + 2);
+    c20 = _mm256_fmadd_pd(ai, b0, c20); c21 = _mm256_fmadd_pd(ai, b1, c21);
+    ai = _mm256_broadcast_sd(a + 3);
+    c30 = _mm256_fmadd_pd(ai, b0, c30); c31 = _mm256_fmadd_pd(ai, b1, c31);
+    ai = _mm256_broadcast_sd(a + 4);
+    c40 = _mm256_fmadd_pd(ai, b0, c40); c41 = _mm256_fmadd_pd(ai, b1, c41);
+    ai = _mm256_broadcast_sd(a + 5);
+    c50 = _mm256_fmadd_pd(ai, b0, c50); c51 = _mm256_fmadd_pd(ai, b1, c51);
+  }
+#define GEMM_STORE_ROW(i, lo, hi)                                                   \
+  _mm256_storeu_pd(c + (i) * ldc, _mm256_add_pd(_mm256_loadu_pd(c + (i) * ldc), lo)); \
+  _mm256_storeu_pd(c + (i) * ldc + 4, _mm256_add_pd(_mm256_loadu_pd(c + (i) * ldc + 4), hi));
+  GEMM_STORE_ROW(0, c00, c01)
+  GEMM_STORE_ROW(1, c10, c11)
+  GEMM_STORE_ROW(2, c20, c21)
+  GEMM_STORE_ROW(3, c30, c31)
+  GEMM_STORE_ROW(4, c40, c41)
+  GEMM_STORE_ROW(5, c50, c51)
+#undef GEMM_STORE_ROW
+}
+#endif
+
+/* the micro-kernel in use; gemm_kernel_select() replaces it */
+static GemmMicroFn gemm_micro = gemm_micro_scalar;
+static const char *gemm_kernel_name = "scalar";
+
+/* select a micro-kernel by name ("auto" picks the widest supported one);
+   returns its name, or NULL if it is unknown or not supported by this CPU */
+static inline const char *gemm_kernel_select(const char *name) {
+#ifdef GEMM_X86
+  __builtin_cpu_init();
+  bool avx2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  if (strcmp(name, "auto") == 0) name = avx2 ? "avx2" : "scalar";
+  if (strcmp(name, "avx2") == 0 && avx2) {
+    gemm_micro = gemm_micro_avx2;
+    gemm_kernel_name = "avx2";
+    return gemm_kernel_name;
+  }
+#else
+  if (strcmp(name, "auto") == 0) name = "scalar";
+#endif
+  if (strcmp(name, "scalar") == 0) {
+    gemm_micro = gemm_micro_scalar;
+    gemm_kernel_name = "scalar";
+    return gemm_kernel_name;
+  }
+  return NULL;
+}
+
+/* a worker's packing buffers */
+typedef struct {
+  double *a;   /* GEMM_MC x GEMM_KC, in GEMM_MR-row slivers */
+  double *b;   /* GEMM_KC x GEMM_NC, in GEMM_NR-column slivers */
+} GemmBuffers;
+
+static inline void gemm_buffers_alloc(GemmBuffers *buf) {
+  buf->a = aligned_alloc(64, (size_t) GEMM_MC * GEMM_KC * sizeof(double));
+  buf->b = aligned_alloc(64, (size_t) GEMM_KC * GEMM_NC * sizeof(double));
+  if (buf->a == NULL || buf->b == NULL) {
+    fprintf(stderr, "Out of memory for the packing buffers\n");
+    exit(1);
+  }
+}
+
+static inline void gemm_buffers_free(GemmBuffers *buf) {
+  free(buf->a);
+  free(buf->b);
+}
+
+/* pack rows 0..mc-1 and columns 0..kc-1 of a (row stride lda) into MR-row
+   slivers, each p-major (a[p][0..MR)), zero-padding the last one */
+static inline void gemm_pack_a(int mc, int kc, const double *a, size_t lda, double *buf) {
+  int ir, i, p;
+  for (ir = 0; ir < mc; ir += GEMM_MR) {
+    int rows = (mc - ir < GEMM_MR) ? mc - ir : GEMM_MR;
+    for (p = 0; p < kc; p++, buf += GEMM_MR) {
+      for (i = 0; i < rows; i++)
+        buf[i] = a[(size_t) (ir + i) * lda + p];
+      for (; i < GEMM_MR; i++)
+        buf[i] = 0;
+    }
+  }
+}
+
+/* pack rows 0..kc-1 and columns 0..nc-1 of b (row stride ldb) into NR-column
+   slivers, each p-major (b[p][0..NR)), zero-padding the last one */
+static inline void gemm_pack_b(int kc, int nc, const double *b, size_t ldb, double *buf) {
+  int jr, j, p;
+  for (jr = 0; jr < nc; jr += GEMM_NR) {
+    int cols = (nc - jr < GEMM_NR) ? nc - jr : GEMM_NR;
+    for (p = 0; p < kc; p++, buf += GEMM_NR) {
+      const double *row = b + (size_t) p * ldb + jr;
+      for (j = 0; j < cols; j++)
+        buf[j] = row[j];
+      for (; j < GEMM_NR; j++)
+        buf[j] = 0;
+    }
+  }
+}
+
+/* C[m0..m1)[n0..n1) = A[m0..m1)[0..k) * B[0..k)[n0..n1) */
+static inline void gemm_tile(const double *A, const double *B, double *C, int m0, int m1, int n0, int n1,
+                             int k, size_t lda, size_t ldb, size_t ldc, GemmBuffers *buf) {
+  int jc, pc, ic, jr, ir, i, j;
+
+  for (i = m0; i < m1; i++)
+    memset(C + (size_t) i * ldc + n0, 0, (n1 - n0) * sizeof(double));
+
+  for (jc = n0; jc < n1; jc += GEMM_NC) {
+    int nc = (n1 - jc < GEMM_NC) ? n1 - jc : GEMM_NC;
+    for (pc = 0; pc < k; pc += GEMM_KC) {
+      int kc = (k - pc < GEMM_KC) ? k - pc : GEMM_KC;
+      gemm_pack_b(kc, nc, B + (size_t) pc * ldb + jc, ldb, buf->b);
+      for (ic = m0; ic < m1; ic += GEMM_MC) {
+        int mc = (m1 - ic < GEMM_MC) ? m1 - ic : GEMM_MC;
+        gemm_pack_a(mc, kc, A + (size_t) ic * lda + pc, lda, buf->a);
+        for (jr = 0; jr < nc; jr += GEMM_NR)
+          for (ir = 0; ir < mc; ir += GEMM_MR) {
+            const double *a = buf->a + (size_t) ir * kc, *b = buf->b + (size_t) jr * kc;
+            double *c = C + (size_t) (ic + ir) * ldc + jc + jr;
+            if (mc - ir >= GEMM_MR && nc - jr >= GEMM_NR)
+              gemm_micro(kc, a, b, c, ldc);
+            else {
+              /* an edge tile: through a scratch tile */
+              double tile[GEMM_MR * GEMM_NR] = { 0 };
+              int rows = (mc - ir < GEMM_MR) ? mc - ir : GEMM_MR;
+              int cols = (nc - jr < GEMM_NR) ? nc - jr : GEMM_NR;
+              gemm_micro(kc, a, b, tile, GEMM_NR);
+              for (i = 0; i < rows; i++)
+                for (j = 0; j < cols; j++)
+                  c[(size_t) i * ldc + j] += tile[i * GEMM_NR + j];
+            }
+          }
+      }
+    }
+  }
+}
+
+/* a pr x pc grid of numWorkers workers whose tiles of an m x n C are
+   closest to square (smallest m/pr + n/pc, which is the data a tile packs) */
+static inline void gemm_grid(int numWorkers, int m, int n, int *pr, int *pc) {
+  int r;
+  double best = -1;
+  for (r = 1; r <= numWorkers; r++) {
+    double cost;
+    if (numWorkers % r != 0) continue;
+    cost = (double) m / r + (double) n / (numWorkers / r);
+    if (best < 0 || cost < best) {
+      best = cost;
+      *pr = r;
+      *pc = numWorkers / r;
+    }
+  }
+}
+
+/* part id of parts of 0..n-1, in whole units (GEMM_MR rows or GEMM_NR
+   columns) so that only the last part has edge tiles: [*first, *end) */
+static inline void gemm_part(int id, int parts, int n, int unit, int *first, int *end) {
+  int units = (n + unit - 1) / unit, per = units / parts, extra = units % parts;
+  int u0 = id * per + (id < extra ? id : extra);
+  int u1 = u0 + per + (id < extra ? 1 : 0);
+  *first = (u0 * unit < n) ? u0 * unit : n;
+  *end = (u1 * unit < n) ? u1 * unit : n;
+}
+
+#endif /* GEMM_H */
@@ -0,0 +1,157 @@
+/* registry of 1-D integrands for the pi program (Homework_1/Question_3)
+
+   features: an integrand is a function double f(double x) with a name, a
+             default interval, and, for the built-ins, an antiderivative, so
+             the exact integral over any interval is known and the error of
+             a result can be printed. integrand_lookup() finds a built-in by
+             name, or loads "path.so:symbol" from a shared object with
+             dlopen/dlsym and registers it under that name (no default
+             interval or antiderivative: [0, 1] and unknown). Lookups and
+             registration are not thread-safe; they happen before the
+             workers start, and the workers only call the functions.
+
+   a shared object of integrands, e.g. my_integrands.c:
+     #include <math.h>
+     double bump(double x) { return exp(-1.0 / (1.0 - x * x)); }
+   built with
+     gcc -O2 -shared -fPIC my_integrands.c -o my_integrands.so -lm
+   and named on the command line as ./my_integrands.so:bump (a path without
+   a '/' is searched for by dlopen in the library path, not the current
+   directory).
+
+   usage:
+     #include "../../common/integrand.h"
+
+     const Integrand *in = integrand_lookup("gauss");   // or "lib.so:symbol"
+     ... in->fn(x), in->a, in->b, integrand_exact(in, a, b) ...
+     integrand_registry_close();
+
+*/
+#ifndef INTEGRAND_H
+#define INTEGRAND_H
+
+#include <dlfcn.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INTEGRAND_MAX 256      /* built-ins and loaded functions */
+#define INTEGRAND_NAME_MAX 256
+
+typedef double (*IntegrandFn)(double x);
+
+typedef struct {
+  char name[INTEGRAND_NAME_MAX];
+  IntegrandFn fn;
+  IntegrandFn antiderivative;  /* NULL if unknown */
+  double a, b;                 /* the default interval */
+  const char *description;
+} Integrand;
+
+static double integrand_circle(double x) { return sqrt(1.0 - x * x); }
+static double integrand_circle_F(double x) { return (x * sqrt(1.0 - x * x) + asin(x)) / 2; }
+static double integrand_sin_F(double x) { return -cos(x); }
+static double integrand_gauss(double x) { return exp(-x * x); }
+static double integrand_gauss_F(double x) { return sqrt(M_PI) / 2 * erf(x); }
+static double integrand_lorentz(double x) { return 1.0 / (1.0 + x * x); }
+static double integrand_runge(double x) { return 1.0 / (1.0 + 25.0 * x * x); }
+static double integrand_runge_F(double x) { return atan(5.0 * x) / 5.0; }
+static double integrand_log(double x) { return (x > 0) ? log(x) : -HUGE_VAL; }
+static double integrand_log_F(double x) { return (x > 0) ? x * log(x) - x : 0.0; }
+static double integrand_oscill(double x) { return cos(50.0 * x); }
+static double integrand_oscill_F(double x) { return sin(50.0 * x) / 50.0; }
+static double integrand_cbrt(double x) { return cbrt(x); }
+static double integrand_cbrt_F(double x) { return 0.75 * x * cbrt(x); }
+
+static Integrand integrand_table[INTEGRAND_MAX] = {
+  { "circle", integrand_circle, integrand_circle_F, 0, 1, "sqrt(1 - x^2), pi/4 on [0, 1]" },
+  { "sin", sin, integrand_sin_F, 0, M_PI, "sin(x)" },
+  { "exp", exp, exp, 0, 1, "exp(x)" },
+  { "gauss", integrand_gauss, integrand_gauss_F, -3, 3, "exp(-x^2)" },
+  { "lorentz", integrand_lorentz, atan, 0, 1, "1 / (1 + x^2), pi/4 on [0, 1]" },
+  { "runge", integrand_runge, integrand_runge_F, -1, 1, "1 / (1 + 25 x^2)" },
+  { "log", integrand_log, integrand_log_F, 0.5, 2, "log(x), -inf at 0" },
+  { "oscill", integrand_oscill, integrand_oscill_F, 0, 1, "cos(50 x)" },
+  { "cbrt", integrand_cbrt, integrand_cbrt_F, -1, 2, "cbrt(x), infinite slope at 0" },
+};
+static int integrand_count = 9;            /* the built-ins above */
+static void *integrand_handles[INTEGRAND_MAX];
+static int integrand_handle_count = 0;
+
+/* the exact integral over [a, b], or NAN if there is no antiderivative */
+static inline double integrand_exact(const Integrand *in, double a, double b) {
+  return in->antiderivative ? in->antiderivative(b) - in->antiderivative(a) : NAN;
+}
+
+/* load "path:symbol" from a shared object; returns NULL with a message on error */
+static inline const Integrand *integrand_load(const char *spec) {
+  char path[INTEGRAND_NAME_MAX];
+  const char *colon = strrchr(spec, ':');
+  Integrand *in;
+  void *handle, *sym;
+
+  if (colon == NULL || colon == spec || colon[1] == '\0' || (size_t) (colon - spec) >= sizeof(path) ||
+      strlen(spec) >= INTEGRAND_NAME_MAX) {
+    fprintf(stderr, "Bad integrand %s (use a built-in name or path.so:symbol)\n", spec);
+    return NULL;
+  }
+  if (integrand_count == INTEGRAND_MAX) {
+    fprintf(stderr, "Too many integrands (at most %d)\n", INTEGRAND_MAX);
+    return NULL;
+  }
+  memcpy(path, spec, colon - spec);
+  path[colon - spec] = '\0';
+  handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+  if (handle == NULL) {
+    fprintf(stderr, "%s\n", dlerror());
+    return NULL;
+  }
+  sym = dlsym(handle, colon + 1);
+  if (sym == NULL) {
+    fprintf(stderr, "%s: no symbol %s\n", path, colon + 1);
+    dlclose(handle);
+    return NULL;
+  }
+  integrand_handles[integrand_handle_count++] = handle;
+  in = &integrand_table[integrand_count++];
+  snprintf(in->name, sizeof(in->name), "%s", spec);
+  *(void **) &in->fn = sym; /* POSIX: a data pointer from dlsym may hold a function */
+  in->antiderivative = NULL;
+  in->a = 0;
+  in->b = 1;
+  in->description = "loaded";
+  return in;
+}
+
+/* a built-in or already loaded integrand by name, else load it as path:symbol */
+static inline const Integrand *integrand_lookup(const char *spec) {
+  int k;
+
+  for (k = 0; k < integrand_count; k++)
+    if (strcmp(integrand_table[k].name, spec) == 0)
+      return &integrand_table[k];
+  if (strchr(spec, ':') == NULL) {
+    fprintf(stderr, "Unknown integrand %s (see --list)\n", spec);
+    return NULL;
+  }
+  return integrand_load(spec);
+}
+
+static inline void integrand_list(void) {
+  char interval[64];
+  int k;
+
+  for (k = 0; k < integrand_count; k++) {
+    snprintf(interval, sizeof(interval), "[%g, %g]", integrand_table[k].a, integrand_table[k].b);
+    printf("  %-12s %-16s %s\n", integrand_table[k].name, interval, integrand_table[k].description);
+  }
+}
+
+/* unload the shared objects; the loaded integrands are gone after this */
+static inline void integrand_registry_close(void) {
+  while (integrand_handle_count > 0)
+    dlclose(integrand_handles[--integrand_handle_count]);
+}
+
+#endif /* INTEGRAND_H */
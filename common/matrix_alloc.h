@@ -0,0 +1,227 @@
+/* on-demand matrix storage for the matrixSum programs
+
+   features: the matrix is a row-major block of rows*cols ints obtained
+             with mmap at the requested size, so nothing is reserved up
+             front. Pages are either normal, transparent huge pages
+             (madvise(MADV_HUGEPAGE) on a 2 MB aligned block), or explicit
+             huge pages (MAP_HUGETLB, falling back to transparent huge pages
+             when none are reserved).
+             matrix_init_parallel() fills the matrix with one thread per
+             strip, so each page is first touched (and therefore placed on
+             the NUMA node of) the worker that later reduces that strip.
+             With pinning, worker i runs on CPU i mod #CPUs in both phases.
+             matrix_fill_random() draws from the counter-based generator in
+             counter_rng.h, so a seed gives the same matrix for any number
+             of workers; matrix_fill_random_typed() stores the same values
+             in any element type of elem_type.h (matrix_alloc_elems()).
+
+   usage:
+     #include "../../common/matrix_alloc.h"
+
+     MatrixStorage st;
+     int *m = matrix_alloc(&st, rows, cols, PAGES_THP);
+     matrix_init_parallel(m, rows, cols, numWorkers, pin, fill, fillArg);
+     ...
+     matrix_free(&st);
+
+*/
+#ifndef MATRIX_ALLOC_H
+#define MATRIX_ALLOC_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np, MAP_HUGETLB */
+#endif
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "counter_rng.h"
+#include "elem_type.h"
+
+#define HUGE_PAGE_SIZE (2UL * 1024 * 1024)
+
+typedef enum { PAGES_DEFAULT, PAGES_THP, PAGES_HUGETLB } PageMode;
+
+/* what matrix_free() needs to unmap the block */
+typedef struct {
+  void *base;
+  size_t length;
+  PageMode pages; /* the page mode actually obtained */
+} MatrixStorage;
+
+/* parse "default", "thp", or "hugetlb"; returns false if unknown */
+static inline bool matrix_parse_pages(const char *name, PageMode *mode) {
+  if (strcmp(name, "default") == 0) *mode = PAGES_DEFAULT;
+  else if (strcmp(name, "thp") == 0) *mode = PAGES_THP;
+  else if (strcmp(name, "hugetlb") == 0) *mode = PAGES_HUGETLB;
+  else return false;
+  return true;
+}
+
+static inline const char *matrix_pages_name(PageMode mode) {
+  return (mode == PAGES_THP) ? "thp" : (mode == PAGES_HUGETLB) ? "hugetlb" : "default";
+}
+
+/* rows x cols elements of elemSize bytes; the pages are not touched here,
+   exits if the memory cannot be mapped */
+static inline void *matrix_alloc_elems(MatrixStorage *st, size_t rows, size_t cols, size_t elemSize,
+                                       PageMode mode) {
+  size_t bytes = rows * cols * elemSize;
+  size_t length;
+  char *p;
+
+  if (bytes == 0) bytes = sizeof(int);
+  if (mode == PAGES_HUGETLB) {
+    length = (bytes + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+    p = mmap(NULL, length, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      st->base = p; st->length = length; st->pages = PAGES_HUGETLB;
+      return p;
+    }
+    fprintf(stderr, "MAP_HUGETLB failed (no huge pages reserved?), using transparent huge pages\n");
+    mode = PAGES_THP;
+  }
+
+  /* over-map by one huge page so the matrix can start on a 2 MB boundary */
+  length = bytes + ((mode == PAGES_THP) ? HUGE_PAGE_SIZE : 0);
+  p = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "Cannot allocate a %zux%zu matrix (%zu bytes)\n", rows, cols, bytes);
+    exit(1);
+  }
+  st->base = p; st->length = length; st->pages = mode;
+  if (mode == PAGES_THP) {
+    char *aligned = (char *) (((uintptr_t) p + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1));
+#ifdef MADV_HUGEPAGE
+    if (madvise(aligned, bytes, MADV_HUGEPAGE) != 0)
+      fprintf(stderr, "madvise(MADV_HUGEPAGE) failed, using normal pages\n");
+#endif
+    return aligned;
+  }
+  return p;
+}
+
+static inline int *matrix_alloc(MatrixStorage *st, size_t rows, size_t cols, PageMode mode) {
+  return matrix_alloc_elems(st, rows, cols, sizeof(int), mode);
+}
+
+static inline void matrix_free(MatrixStorage *st) {
+  munmap(st->base, st->length);
+}
+
+/* fills rows first..last (inclusive) of a matrix with cols columns */
+typedef void (*MatrixFillFn)(void *m, int cols, int first, int last, void *arg);
+
+/* the rows of strip id when rows are split evenly over numWorkers workers;
+   the last worker also takes the remainder, as in the matrixSum Workers */
+static inline void matrix_strip(long id, int numWorkers, int rows, int *first, int *last) {
+  int stripSize = rows / numWorkers;
+  *first = id * stripSize;
+  *last = (id == numWorkers - 1) ? (rows - 1) : (*first + stripSize - 1);
+}
+
+/* run worker id on CPU id mod #CPUs: set the affinity in attr before pthread_create */
+static inline void matrix_pin_attr(pthread_attr_t *attr, long id) {
+  static long numCpus = 0;
+  cpu_set_t cpus;
+
+  if (numCpus <= 0) numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+  if (numCpus <= 0) numCpus = 1;
+  CPU_ZERO(&cpus);
+  CPU_SET(id % numCpus, &cpus);
+  pthread_attr_setaffinity_np(attr, sizeof(cpus), &cpus);
+}
+
+typedef struct {
+  void *m;
+  int rows, cols, numWorkers;
+  long id;
+  MatrixFillFn fill;
+  void *arg;
+} MatrixInitTask;
+
+static inline void *matrix_init_worker(void *arg) {
+  MatrixInitTask *task = arg;
+  int first, last;
+  matrix_strip(task->id, task->numWorkers, task->rows, &first, &last);
+  if (first <= last)
+    task->fill(task->m, task->cols, first, last, task->arg);
+  return NULL;
+}
+
+/* first-touch initialization: worker id fills (and so places the pages of)
+   strip id, the strip matrix_strip() assigns to the reducing worker id */
+static inline void matrix_init_parallel(void *m, int rows, int cols, int numWorkers, bool pin,
+                                        MatrixFillFn fill, void *arg) {
+  pthread_t *tids = malloc(numWorkers * sizeof(pthread_t));
+  MatrixInitTask *tasks = malloc(numWorkers * sizeof(MatrixInitTask));
+  pthread_attr_t attr;
+  long l;
+
+  if (tids == NULL || tasks == NULL) {
+    fprintf(stderr, "Out of memory for %d init threads\n", numWorkers);
+    exit(1);
+  }
+  pthread_attr_init(&attr);
+  for (l = 0; l < numWorkers; l++) {
+    MatrixInitTask t = { m, rows, cols, numWorkers, l, fill, arg };
+    tasks[l] = t;
+    if (pin) matrix_pin_attr(&attr, l);
+    pthread_create(&tids[l], &attr, matrix_init_worker, &tasks[l]);
+  }
+  for (l = 0; l < numWorkers; l++)
+    pthread_join(tids[l], NULL);
+  pthread_attr_destroy(&attr);
+  free(tasks);
+  free(tids);
+}
+
+/* the random fill: element (i, j) is value i*cols+j of the counter-based
+   stream keyed by *(uint64_t *) arg, in [0, 100), so the matrix is the same
+   for every worker count */
+static inline void matrix_fill_random(void *m, int cols, int first, int last, void *arg) {
+  uint64_t seed = *(uint64_t *) arg;
+  int i, j;
+  for (i = first; i <= last; i++) {
+    int *row = (int *) m + (size_t) i * cols;
+    uint64_t k = (uint64_t) i * cols;
+    for (j = 0; j < cols; j++)
+      row[j] = (int) counter_rng_below(seed, k + j, 100); // Random values between 0 and 99
+  }
+}
+
+/* the argument of matrix_fill_random_typed() */
+typedef struct {
+  uint64_t seed;
+  uint32_t type; /* MATRIX_ELEM_... */
+} MatrixTypedFill;
+
+/* matrix_fill_random() for a matrix of any element type: the same values,
+   stored as arg->type */
+static inline void matrix_fill_random_typed(void *m, int cols, int first, int last, void *arg) {
+  const MatrixTypedFill *fill = arg;
+  uint64_t seed = fill->seed;
+  int i, j;
+
+  switch (fill->type) {
+#define MATRIX_FILL_CASE(ID, code, name, T, ACC, BLOCK, LANES)                    \
+  case code:                                                                    \
+    for (i = first; i <= last; i++) {                                           \
+      T *row = (T *) m + (size_t) i * cols;                                     \
+      uint64_t k = (uint64_t) i * cols;                                         \
+      for (j = 0; j < cols; j++)                                                \
+        row[j] = (T) counter_rng_below(seed, k + j, 100);                       \
+    }                                                                           \
+    break;
+  MATRIX_ELEM_TYPES(MATRIX_FILL_CASE)
+#undef MATRIX_FILL_CASE
+  }
+}
+
+#endif /* MATRIX_ALLOC_H */
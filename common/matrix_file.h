@@ -0,0 +1,155 @@
+/* binary matrix files for the matrixSum programs
+
+   format (all fields in host byte order, i.e. little-endian on x86):
+     offset  0  char     magic[8]    "MSUMMAT" followed by a NUL
+     offset  8  uint32   version     MATRIX_FILE_VERSION
+     offset 12  uint32   elemType    MATRIX_ELEM_INT32, _INT8, ... (elem_type.h)
+     offset 16  uint64   rows
+     offset 24  uint64   cols
+     offset 32  uint64   dataOffset  start of the payload (MATRIX_FILE_ALIGN)
+     dataOffset          rows*cols elements, row-major
+
+   The payload starts on a 4 KB boundary so it is page aligned when mapped
+   and can be read with O_DIRECT.
+
+   features: matrix_file_map() maps a file read-only and advises the kernel
+             that the payload is read sequentially (MADV_SEQUENTIAL), so the
+             workers reduce straight out of the page cache without a copy.
+             matrix_file_create() writes the header and sizes a new file, so
+             that several threads can then fill disjoint rows with pwrite.
+
+   usage:
+     #include "../../common/matrix_file.h"
+
+     MatrixFile mf;
+     const int *m = matrix_file_map("matrix.bin", &mf);
+     ... mf.header.rows, mf.header.cols ...
+     matrix_file_unmap(&mf);
+
+*/
+#ifndef MATRIX_FILE_H
+#define MATRIX_FILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "elem_type.h"
+
+#define MATRIX_FILE_MAGIC "MSUMMAT"
+#define MATRIX_FILE_VERSION 1
+#define MATRIX_FILE_ALIGN 4096
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t elemType;
+  uint64_t rows, cols;
+  uint64_t dataOffset;
+} MatrixFileHeader;
+
+/* an open, mapped matrix file */
+typedef struct {
+  MatrixFileHeader header;
+  int fd;
+  void *map;
+  size_t mapLength;
+} MatrixFile;
+
+/* read and check the header of an open file; returns the length of the
+   header and payload, exits with a message on error */
+static inline size_t matrix_file_read_header(int fd, const char *path, MatrixFileHeader *h) {
+  struct stat st;
+  size_t elemSize, length;
+
+  if (pread(fd, h, sizeof(*h), 0) != (ssize_t) sizeof(*h) ||
+      memcmp(h->magic, MATRIX_FILE_MAGIC, sizeof(h->magic)) != 0) {
+    fprintf(stderr, "%s is not a matrix file\n", path);
+    exit(1);
+  }
+  if (h->version != MATRIX_FILE_VERSION) {
+    fprintf(stderr, "%s: unsupported matrix file version %u\n", path, h->version);
+    exit(1);
+  }
+  elemSize = matrix_elem_size(h->elemType);
+  if (elemSize == 0) {
+    fprintf(stderr, "%s: unsupported element type %u\n", path, h->elemType);
+    exit(1);
+  }
+  if (h->rows == 0 || h->cols == 0) {
+    fprintf(stderr, "%s: %llux%llu has no elements\n", path,
+            (unsigned long long) h->rows, (unsigned long long) h->cols);
+    exit(1);
+  }
+  if (h->dataOffset < sizeof(*h) || h->dataOffset % MATRIX_FILE_ALIGN != 0) {
+    fprintf(stderr, "%s: data offset %llu is not a multiple of %d past the header\n", path,
+            (unsigned long long) h->dataOffset, MATRIX_FILE_ALIGN);
+    exit(1);
+  }
+  if (h->rows > INT32_MAX || h->cols > INT32_MAX ||
+      __builtin_mul_overflow(h->rows, h->cols, &length) ||
+      __builtin_mul_overflow(length, elemSize, &length) ||
+      __builtin_add_overflow(length, h->dataOffset, &length)) {
+    fprintf(stderr, "%s: %llux%llu at offset %llu is too large\n", path,
+            (unsigned long long) h->rows, (unsigned long long) h->cols, (unsigned long long) h->dataOffset);
+    exit(1);
+  }
+  if (fstat(fd, &st) != 0 || (uint64_t) st.st_size < length) {
+    fprintf(stderr, "%s is truncated\n", path);
+    exit(1);
+  }
+  return length;
+}
+
+/* map a matrix file read-only; returns the payload, exits on error */
+static inline const void *matrix_file_map(const char *path, MatrixFile *mf) {
+  mf->fd = open(path, O_RDONLY);
+  if (mf->fd < 0) {
+    perror(path);
+    exit(1);
+  }
+  mf->mapLength = matrix_file_read_header(mf->fd, path, &mf->header);
+  mf->map = mmap(NULL, mf->mapLength, PROT_READ, MAP_SHARED, mf->fd, 0);
+  if (mf->map == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  madvise((char *) mf->map + mf->header.dataOffset, mf->mapLength - mf->header.dataOffset, MADV_SEQUENTIAL);
+  return (const char *) mf->map + mf->header.dataOffset;
+}
+
+static inline void matrix_file_unmap(MatrixFile *mf) {
+  munmap(mf->map, mf->mapLength);
+  close(mf->fd);
+}
+
+/* create (or truncate) a matrix file: write the header and extend the file
+   to its full size; returns the open descriptor, exits on error */
+static inline int matrix_file_create(const char *path, uint32_t elemType, uint64_t rows, uint64_t cols,
+                                     MatrixFileHeader *h) {
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+  if (fd < 0) {
+    perror(path);
+    exit(1);
+  }
+  memset(h, 0, sizeof(*h));
+  memcpy(h->magic, MATRIX_FILE_MAGIC, sizeof(h->magic));
+  h->version = MATRIX_FILE_VERSION;
+  h->elemType = elemType;
+  h->rows = rows;
+  h->cols = cols;
+  h->dataOffset = MATRIX_FILE_ALIGN;
+  if (pwrite(fd, h, sizeof(*h), 0) != (ssize_t) sizeof(*h) ||
+      ftruncate(fd, h->dataOffset + rows * cols * matrix_elem_size(elemType)) != 0) {
+    perror(path);
+    exit(1);
+  }
+  return fd;
+}
+
+#endif /* MATRIX_FILE_H */
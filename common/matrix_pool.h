@@ -0,0 +1,246 @@
+/* persistent worker pool for matrix reductions
+
+   features: numWorkers threads are created once and reduce any number of
+             submitted matrices, so a stream of small matrices does not pay
+             for thread creation and joining each time.
+             Each submitted matrix is split into strips of rows as in
+             matrixSum_a's Worker: a large matrix gets one strip per worker,
+             a small one fewer (at least MATRIX_POOL_PART_ELEMS elements per
+             strip, so one strip for a tiny matrix). The strips are queued
+             as tasks in a FIFO shared by the workers. Each strip is reduced
+             with reduce_row into its own cache-line sized partial slot; the
+             worker finishing the last strip of a matrix merges the slots in
+             strip order (so ties resolve as in a sequential scan) and
+             completes the matrix's future.
+             Futures record when they were submitted and completed
+             (CLOCK_MONOTONIC seconds), for latency measurements.
+
+   usage:
+     #include "../../common/reduce_kernel.h"
+     #include "../../common/matrix_pool.h"
+
+     reduce_kernel_select("auto");         // the workers call reduce_row
+     MatrixPool *pool = matrix_pool_create(numWorkers);
+     MatrixFuture *f = matrix_pool_submit(pool, m, rows, cols);
+     ...                                   // m must stay valid until waited on
+     Reduction r = matrix_pool_wait(f);    // blocks until reduced
+     matrix_future_free(f);
+     matrix_pool_destroy(pool);            // finishes queued work first
+
+*/
+#ifndef MATRIX_POOL_H
+#define MATRIX_POOL_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "reduce_kernel.h"
+
+#define MATRIX_POOL_CACHE_LINE 64
+#define MATRIX_POOL_PART_ELEMS 65536 /* smallest strip worth its own task */
+
+struct MatrixFuture;
+
+/* one strip of a submitted matrix: its queue link and its partial result,
+   padded so workers finishing neighbouring strips do not share a line */
+typedef struct MatrixPoolSlot {
+  _Alignas(MATRIX_POOL_CACHE_LINE) Reduction r;
+  struct MatrixFuture *future;
+  struct MatrixPoolSlot *next;
+  int part;
+} MatrixPoolSlot;
+
+typedef struct MatrixFuture {
+  const int *m;
+  int rows, cols, parts;
+  atomic_int partsLeft;
+  Reduction result;
+  bool done;
+  pthread_mutex_t mutex;    /* protects done */
+  pthread_cond_t completed; /* signalled when done */
+  double submitTime, completeTime;
+  MatrixPoolSlot slots[];
+} MatrixFuture;
+
+typedef struct {
+  int numWorkers;
+  pthread_t *workers;
+  pthread_mutex_t mutex;    /* protects the queue and shutdown */
+  pthread_cond_t nonEmpty;
+  MatrixPoolSlot *head, *tail;
+  bool shutdown;
+} MatrixPool;
+
+static inline double matrix_pool_now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
+
+/* reduce one strip; the last strip of a matrix completes its future */
+static inline void matrix_pool_run(MatrixPoolSlot *slot) {
+  MatrixFuture *f = slot->future;
+  int stripSize = f->rows / f->parts;
+  int first_row = slot->part * stripSize;
+  int last_row = (slot->part == f->parts - 1) ? (f->rows - 1) : (first_row + stripSize - 1);
+  Reduction local;
+  int i;
+
+  reduction_init(&local);
+  for (i = first_row; i <= last_row; i++)
+    reduce_row(f->m + (size_t) i * f->cols, f->cols, i, &local);
+  slot->r = local;
+
+  if (atomic_fetch_sub(&f->partsLeft, 1) == 1) { /* acq_rel: sees every slot */
+    reduction_init(&f->result);
+    for (i = 0; i < f->parts; i++)
+      reduction_merge(&f->result, &f->slots[i].r);
+    f->completeTime = matrix_pool_now();
+    pthread_mutex_lock(&f->mutex);
+    f->done = true;
+    pthread_cond_broadcast(&f->completed);
+    pthread_mutex_unlock(&f->mutex);
+  }
+}
+
+static inline void *matrix_pool_worker(void *arg) {
+  MatrixPool *pool = arg;
+  MatrixPoolSlot *slot;
+
+  for (;;) {
+    pthread_mutex_lock(&pool->mutex);
+    while (pool->head == NULL && !pool->shutdown)
+      pthread_cond_wait(&pool->nonEmpty, &pool->mutex);
+    if (pool->head == NULL) { /* shut down and drained */
+      pthread_mutex_unlock(&pool->mutex);
+      return NULL;
+    }
+    slot = pool->head;
+    pool->head = slot->next;
+    if (pool->head == NULL) pool->tail = NULL;
+    pthread_mutex_unlock(&pool->mutex);
+
+    matrix_pool_run(slot);
+  }
+}
+
+static inline MatrixPool *matrix_pool_create(int numWorkers) {
+  MatrixPool *pool = malloc(sizeof(MatrixPool));
+  pthread_attr_t attr;
+  long l;
+
+  if (numWorkers <= 0) numWorkers = 1;
+  if (pool == NULL || (pool->workers = malloc(numWorkers * sizeof(pthread_t))) == NULL) {
+    fprintf(stderr, "Out of memory for a pool of %d workers\n", numWorkers);
+    exit(1);
+  }
+  pool->numWorkers = numWorkers;
+  pool->head = pool->tail = NULL;
+  pool->shutdown = false;
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->nonEmpty, NULL);
+
+  pthread_attr_init(&attr);
+  pthread_attr_setscope(&attr, PTHREAD_SCOPE_SYSTEM);
+  for (l = 0; l < numWorkers; l++)
+    pthread_create(&pool->workers[l], &attr, matrix_pool_worker, pool);
+  pthread_attr_destroy(&attr);
+  return pool;
+}
+
+/* queue a rows x cols row-major matrix for reduction */
+static inline MatrixFuture *matrix_pool_submit(MatrixPool *pool, const int *m, int rows, int cols) {
+  long long elems = (long long) rows * cols;
+  int parts = (int) (elems / MATRIX_POOL_PART_ELEMS), i;
+  size_t bytes;
+  MatrixFuture *f;
+
+  if (parts > pool->numWorkers) parts = pool->numWorkers;
+  if (parts > rows) parts = rows;
+  if (parts < 1) parts = 1;
+  bytes = sizeof(MatrixFuture) + parts * sizeof(MatrixPoolSlot);
+  bytes = (bytes + MATRIX_POOL_CACHE_LINE - 1) & ~(size_t) (MATRIX_POOL_CACHE_LINE - 1);
+  f = aligned_alloc(MATRIX_POOL_CACHE_LINE, bytes);
+  if (f == NULL) {
+    fprintf(stderr, "Out of memory for a matrix future\n");
+    exit(1);
+  }
+  f->m = m;
+  f->rows = rows;
+  f->cols = cols;
+  f->parts = parts;
+  atomic_init(&f->partsLeft, parts);
+  f->done = false;
+  pthread_mutex_init(&f->mutex, NULL);
+  pthread_cond_init(&f->completed, NULL);
+  for (i = 0; i < parts; i++) {
+    f->slots[i].future = f;
+    f->slots[i].part = i;
+    f->slots[i].next = (i + 1 < parts) ? &f->slots[i + 1] : NULL;
+  }
+  f->submitTime = matrix_pool_now();
+  if (rows <= 0 || cols <= 0) { /* nothing to queue: the empty reduction */
+    f->rows = 0;
+    matrix_pool_run(&f->slots[0]);
+    return f;
+  }
+
+  pthread_mutex_lock(&pool->mutex);
+  if (pool->tail != NULL)
+    pool->tail->next = &f->slots[0];
+  else
+    pool->head = &f->slots[0];
+  pool->tail = &f->slots[parts - 1];
+  if (parts == 1)
+    pthread_cond_signal(&pool->nonEmpty);
+  else
+    pthread_cond_broadcast(&pool->nonEmpty);
+  pthread_mutex_unlock(&pool->mutex);
+  return f;
+}
+
+/* true once the result is available */
+static inline bool matrix_pool_ready(MatrixFuture *f) {
+  bool done;
+  pthread_mutex_lock(&f->mutex);
+  done = f->done;
+  pthread_mutex_unlock(&f->mutex);
+  return done;
+}
+
+/* block until the matrix is reduced; returns its sum, min, and max */
+static inline Reduction matrix_pool_wait(MatrixFuture *f) {
+  pthread_mutex_lock(&f->mutex);
+  while (!f->done)
+    pthread_cond_wait(&f->completed, &f->mutex);
+  pthread_mutex_unlock(&f->mutex);
+  return f->result;
+}
+
+/* after matrix_pool_wait() */
+static inline void matrix_future_free(MatrixFuture *f) {
+  pthread_mutex_destroy(&f->mutex);
+  pthread_cond_destroy(&f->completed);
+  free(f);
+}
+
+/* let the workers finish the queued matrices, then join them */
+static inline void matrix_pool_destroy(MatrixPool *pool) {
+  int i;
+
+  pthread_mutex_lock(&pool->mutex);
+  pool->shutdown = true;
+  pthread_cond_broadcast(&pool->nonEmpty);
+  pthread_mutex_unlock(&pool->mutex);
+  for (i = 0; i < pool->numWorkers; i++)
+    pthread_join(pool->workers[i], NULL);
+  pthread_mutex_destroy(&pool->mutex);
+  pthread_cond_destroy(&pool->nonEmpty);
+  free(pool->workers);
+  free(pool);
+}
+
+#endif /* MATRIX_POOL_H */
@@ -0,0 +1,401 @@
+/* one-pass mergeable matrix statistics
+
+   features: statistics beyond sum, min, and max that a worker gathers over
+             its strip in the same pass, as a partial state that merges with
+             the other workers' states:
+               var     count, mean, and sum of squared deviations (M2); each
+                       row is reduced to (n, mean, M2) while it is cache-hot,
+                       and rows and workers are combined with the parallel
+                       form of Welford's update (Chan et al.), which does not
+                       lose precision the way sum-of-squares minus square-of-
+                       sum does
+               hist    exact count of every value, in a dense table over the
+                       range of values seen so far (grown by doubling)
+               median  exact, from the same count table
+               topk=K  the K largest values with their positions, in a
+                       min-heap; ties go to the earlier position, so the
+                       answer does not depend on the number of workers;
+                       NaN elements are skipped, as by the min and max
+             hist and median need integer elements spanning at most
+             STATS_MAX_SPAN distinct values (all of int8/uint8/int16 do).
+             Sum, min, and max come from the TypedReduction of the kernel.
+             Each statistic is a separate loop over the row just reduced,
+             so the matrix is still read from memory once.
+
+   usage:
+     #include "../../common/matrix_stats.h"
+
+     StatsConfig cfg;
+     matrix_stats_parse("sum,min,max,var,hist,topk=10", elemType, &cfg);
+     MatrixStats s;                                   // one per worker
+     matrix_stats_init(&s, &cfg, elemType);
+     matrix_stats_row(&s, row, cols, i);              // after the kernel, per row
+     matrix_stats_merge(&all, &s);                    // once every worker is done
+     matrix_stats_print(&all, &reduction);
+     matrix_stats_destroy(&s);
+
+*/
+#ifndef MATRIX_STATS_H
+#define MATRIX_STATS_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* qsort_r */
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "typed_kernel.h"
+
+#define STATS_MAX_SPAN (1 << 20)  /* largest count table, in distinct values */
+#define STATS_HIST_BINS 20        /* printed histogram bins; fewer values are printed one by one */
+
+enum {
+  STATS_SUM = 1, STATS_MIN = 2, STATS_MAX = 4, STATS_VAR = 8,
+  STATS_HIST = 16, STATS_MEDIAN = 32, STATS_TOPK = 64
+};
+
+typedef struct {
+  unsigned mask;   /* STATS_* */
+  int topK;
+} StatsConfig;
+
+/* a top-K entry */
+typedef struct {
+  ElemValue value;
+  int row, col;
+} StatsEntry;
+
+typedef struct {
+  StatsConfig cfg;
+  uint32_t type;
+  /* var */
+  long long n;
+  double mean, m2;
+  /* hist and median: counts[v - lo] for v in lo .. lo + span - 1 */
+  long long lo;
+  size_t span;
+  long long *counts;
+  bool tooWide;          /* the values span more than STATS_MAX_SPAN */
+  /* topk: heap[0] is the worst of the best K so far */
+  StatsEntry *heap;
+  int numTop;
+} MatrixStats;
+
+/* parse a --stats list; false (with a message) if it names an unknown
+   statistic or one the element type does not support */
+static inline bool matrix_stats_parse(const char *list, uint32_t type, StatsConfig *cfg) {
+  char name[32];
+  const char *p = list;
+
+  cfg->mask = 0;
+  cfg->topK = 0;
+  while (*p != '\0') {
+    size_t len = strcspn(p, ",");
+    if (len == 0 || len >= sizeof(name)) {
+      fprintf(stderr, "Bad statistics list: %s\n", list);
+      return false;
+    }
+    memcpy(name, p, len);
+    name[len] = '\0';
+    if (strcmp(name, "sum") == 0) cfg->mask |= STATS_SUM;
+    else if (strcmp(name, "min") == 0) cfg->mask |= STATS_MIN;
+    else if (strcmp(name, "max") == 0) cfg->mask |= STATS_MAX;
+    else if (strcmp(name, "var") == 0) cfg->mask |= STATS_VAR;
+    else if (strcmp(name, "hist") == 0) cfg->mask |= STATS_HIST;
+    else if (strcmp(name, "median") == 0) cfg->mask |= STATS_MEDIAN;
+    else if (strncmp(name, "topk=", 5) == 0 && atoi(name + 5) > 0) {
+      cfg->mask |= STATS_TOPK;
+      cfg->topK = atoi(name + 5);
+    } else {
+      fprintf(stderr, "Unknown statistic: %s (use sum, min, max, var, hist, median, or topk=K)\n", name);
+      return false;
+    }
+    p += len;
+    if (*p == ',') p++;
+  }
+  if ((cfg->mask & (STATS_HIST | STATS_MEDIAN)) && matrix_elem_is_float(type)) {
+    fprintf(stderr, "hist and median need integer elements, not %s\n", matrix_elem_name(type));
+    return false;
+  }
+  return true;
+}
+
+/* true if the state needs a loop over the elements besides the kernel's */
+static inline bool matrix_stats_extra(const StatsConfig *cfg) {
+  return (cfg->mask & (STATS_VAR | STATS_HIST | STATS_MEDIAN | STATS_TOPK)) != 0;
+}
+
+static inline void matrix_stats_init(MatrixStats *s, const StatsConfig *cfg, uint32_t type) {
+  memset(s, 0, sizeof(*s));
+  s->cfg = *cfg;
+  s->type = type;
+  if (cfg->mask & STATS_TOPK) {
+    s->heap = malloc(cfg->topK * sizeof(StatsEntry));
+    if (s->heap == NULL) {
+      fprintf(stderr, "Out of memory for the top %d values\n", cfg->topK);
+      exit(1);
+    }
+  }
+}
+
+static inline void matrix_stats_destroy(MatrixStats *s) {
+  free(s->counts);
+  free(s->heap);
+  s->counts = NULL;
+  s->heap = NULL;
+}
+
+/* fold a (n, mean, M2) summary into s */
+static inline void matrix_stats_combine(MatrixStats *s, long long n, double mean, double m2) {
+  long long total = s->n + n;
+  double delta = mean - s->mean;
+  if (n == 0) return;
+  s->mean += delta * n / total;
+  s->m2 += m2 + delta * delta * ((double) s->n * n / total);
+  s->n = total;
+}
+
+/* make the count table cover lo .. hi as well; false if that would exceed
+   STATS_MAX_SPAN values */
+static inline bool matrix_stats_cover(MatrixStats *s, long long lo, long long hi) {
+  long long nlo, nhi;
+  unsigned long long need, span;
+  long long *counts;
+
+  if (s->span == 0) {
+    nlo = lo;
+    nhi = hi;
+  } else {
+    long long top = s->lo + (long long) s->span - 1;
+    if (lo >= s->lo && hi <= top) return true;
+    nlo = (lo < s->lo) ? lo : s->lo;
+    nhi = (hi > top) ? hi : top;
+  }
+  need = (unsigned long long) nhi - (unsigned long long) nlo + 1;
+  if (need == 0 || need > STATS_MAX_SPAN) return false;
+  /* double the table towards the new values, so a slowly widening range
+     does not copy the table for every new value */
+  span = (s->span * 2 > need) ? s->span * 2 : need;
+  if (span > STATS_MAX_SPAN) span = STATS_MAX_SPAN;
+  if (s->span > 0 && lo < s->lo)
+    nlo = ((unsigned long long) nhi - (unsigned long long) LLONG_MIN < span - 1)
+          ? LLONG_MIN : nhi - (long long) (span - 1);
+  else if ((unsigned long long) LLONG_MAX - (unsigned long long) nlo < span - 1)
+    nlo = LLONG_MAX - (long long) (span - 1);
+
+  counts = calloc(span, sizeof(long long));
+  if (counts == NULL) {
+    fprintf(stderr, "Out of memory for the value counts\n");
+    exit(1);
+  }
+  if (s->span > 0)
+    memcpy(counts + (s->lo - nlo), s->counts, s->span * sizeof(long long));
+  free(s->counts);
+  s->counts = counts;
+  s->lo = nlo;
+  s->span = span;
+  return true;
+}
+
+/* a is a better top-K entry than b: larger, or equal and earlier */
+static inline bool matrix_stats_better(uint32_t type, const StatsEntry *a, const StatsEntry *b) {
+  if (matrix_elem_is_float(type) ? a->value.f != b->value.f : a->value.i != b->value.i)
+    return matrix_elem_is_float(type) ? a->value.f > b->value.f : a->value.i > b->value.i;
+  return reduce_pos_before(a->row, a->col, b->row, b->col);
+}
+
+/* offer an entry to the top-K heap */
+static inline void matrix_stats_offer(MatrixStats *s, const StatsEntry *e) {
+  StatsEntry *h = s->heap;
+  int i, k = s->cfg.topK;
+
+  if (s->numTop < k) {
+    /* sift up */
+    for (i = s->numTop++; i > 0 && matrix_stats_better(s->type, &h[(i - 1) / 2], e); i = (i - 1) / 2)
+      h[i] = h[(i - 1) / 2];
+    h[i] = *e;
+    return;
+  }
+  if (!matrix_stats_better(s->type, e, &h[0])) return;
+  /* replace the root and sift down */
+  for (i = 0; 2 * i + 1 < k; ) {
+    int c = 2 * i + 1;
+    if (c + 1 < k && matrix_stats_better(s->type, &h[c], &h[c + 1])) c++;
+    if (!matrix_stats_better(s->type, e, &h[c])) break;
+    h[i] = h[c];
+    i = c;
+  }
+  h[i] = *e;
+}
+
+/* Gather the statistics of row[0..n) of type T. Rows must be given in
+   increasing order within a worker: then an element equal to the worst of
+   the top K comes later, so only strictly larger values are offered. */
+#define STATS_ROW_KERNEL(ID, code, name, T, ACC, BLOCK, LANES)                      \
+static inline void matrix_stats_row_##name(MatrixStats *s, const void *row, int n,  \
+                                           int rowIndex) {                          \
+  const T *x = row;                                                                 \
+  int j;                                                                            \
+  if (s->cfg.mask & STATS_VAR) {                                                    \
+    double sum = 0, mean, m2 = 0;                                                   \
+    for (j = 0; j < n; j++)                                                         \
+      sum += x[j];                                                                  \
+    mean = sum / n;                                                                 \
+    for (j = 0; j < n; j++)                                                         \
+      m2 += (x[j] - mean) * (x[j] - mean);                                          \
+    matrix_stats_combine(s, n, mean, m2);                                           \
+  }                                                                                 \
+  if ((s->cfg.mask & (STATS_HIST | STATS_MEDIAN)) && !s->tooWide) {                 \
+    for (j = 0; j < n; j++) {                                                       \
+      unsigned long long k = (unsigned long long) (long long) x[j] -                \
+                             (unsigned long long) s->lo;                            \
+      if (k >= s->span) {                                                           \
+        if (!matrix_stats_cover(s, (long long) x[j], (long long) x[j])) {           \
+          s->tooWide = true;                                                        \
+          break;                                                                    \
+        }                                                                           \
+        k = (unsigned long long) (long long) x[j] - (unsigned long long) s->lo;     \
+      }                                                                             \
+      s->counts[k]++;                                                               \
+    }                                                                               \
+  }                                                                                 \
+  if (s->cfg.mask & STATS_TOPK) {                                                   \
+    for (j = 0; j < n; j++)                                                         \
+      if (x[j] == x[j] && /* not NaN, as for the min and max */                     \
+          (s->numTop < s->cfg.topK || x[j] > TYPED_VALUE(T, s->heap[0].value))) {   \
+        StatsEntry e;                                                               \
+        TYPED_VALUE(T, e.value) = x[j];                                             \
+        e.row = rowIndex;                                                           \
+        e.col = j;                                                                  \
+        matrix_stats_offer(s, &e);                                                  \
+      }                                                                             \
+  }                                                                                 \
+}
+
+MATRIX_ELEM_TYPES(STATS_ROW_KERNEL)
+
+static inline void matrix_stats_row(MatrixStats *s, const void *row, int n, int rowIndex) {
+  switch (s->type) {
+#define STATS_ROW_CASE(ID, code, name, T, ACC, BLOCK, LANES) \
+  case code: matrix_stats_row_##name(s, row, n, rowIndex); break;
+  MATRIX_ELEM_TYPES(STATS_ROW_CASE)
+#undef STATS_ROW_CASE
+  }
+}
+
+/* merge a worker's state into another of the same configuration and type */
+static inline void matrix_stats_merge(MatrixStats *into, const MatrixStats *from) {
+  int i;
+  size_t k;
+
+  matrix_stats_combine(into, from->n, from->mean, from->m2);
+  if (from->tooWide) into->tooWide = true;
+  if (!into->tooWide && from->span > 0) {
+    if (!matrix_stats_cover(into, from->lo, from->lo + (long long) from->span - 1))
+      into->tooWide = true;
+    else
+      for (k = 0; k < from->span; k++)
+        into->counts[from->lo - into->lo + k] += from->counts[k];
+  }
+  for (i = 0; i < from->numTop; i++)
+    matrix_stats_offer(into, &from->heap[i]);
+}
+
+/* the value with (0-based) rank r in the count table */
+static inline long long matrix_stats_rank(const MatrixStats *s, long long r) {
+  size_t k;
+  for (k = 0; k < s->span; k++) {
+    if (r < s->counts[k]) break;
+    r -= s->counts[k];
+  }
+  return s->lo + (long long) k;
+}
+
+static inline int matrix_stats_compare(const void *a, const void *b, void *type) {
+  return matrix_stats_better(*(uint32_t *) type, a, b) ? -1 : 1;
+}
+
+static inline void matrix_stats_print_value(uint32_t type, ElemValue v) {
+  if (matrix_elem_is_float(type)) printf("%.15g", v.f);
+  else printf("%lld", v.i);
+}
+
+/* print the selected statistics of the merged state s; r is the merged
+   sum, min, and max */
+static inline void matrix_stats_print(MatrixStats *s, const TypedReduction *r) {
+  unsigned mask = s->cfg.mask;
+  long long total = 0;
+  size_t k;
+  int i;
+
+  if ((mask & (STATS_SUM | STATS_MIN | STATS_MAX)) == (STATS_SUM | STATS_MIN | STATS_MAX))
+    typed_reduction_print(r);
+  else {
+    if (mask & STATS_SUM) {
+      printf("The total sum is ");
+      matrix_stats_print_value(r->type, r->sum);
+      printf("\n");
+    }
+    if ((mask & (STATS_MIN | STATS_MAX)) && r->minRow < 0)
+      printf("There is no minimum or maximum element: all elements are NaN\n");
+    else {
+      if (mask & STATS_MIN) {
+        printf("The minimum element is ");
+        matrix_stats_print_value(r->type, r->min);
+        printf(" at (%d, %d)\n", r->minRow, r->minCol);
+      }
+      if (mask & STATS_MAX) {
+        printf("The maximum element is ");
+        matrix_stats_print_value(r->type, r->max);
+        printf(" at (%d, %d)\n", r->maxRow, r->maxCol);
+      }
+    }
+    if (r->nans > 0)
+      printf("NaN elements: %lld (skipped by the minimum, maximum, and top K)\n", r->nans);
+  }
+  if (mask & STATS_VAR)
+    printf("The mean is %.15g, the variance %.15g\n", s->mean, s->n > 0 ? s->m2 / s->n : 0.0);
+
+  if ((mask & (STATS_HIST | STATS_MEDIAN)) && s->tooWide)
+    printf("The values span more than %d distinct values: no histogram or median\n", STATS_MAX_SPAN);
+  else if (mask & (STATS_HIST | STATS_MEDIAN)) {
+    for (k = 0; k < s->span; k++)
+      total += s->counts[k];
+    if ((mask & STATS_MEDIAN) && total > 0) {
+      long long a = matrix_stats_rank(s, (total - 1) / 2), b = matrix_stats_rank(s, total / 2);
+      printf("The median is %.15g\n", (a + b) / 2.0);
+    }
+    if (mask & STATS_HIST) {
+      /* trim the table to the values present, then print them one by one or
+         in STATS_HIST_BINS equal-width bins */
+      size_t first = 0, last = s->span;
+      while (first < last && s->counts[first] == 0) first++;
+      while (last > first && s->counts[last - 1] == 0) last--;
+      size_t width = (last - first + STATS_HIST_BINS - 1) / STATS_HIST_BINS;
+      printf("Histogram (%lld values):\n", total);
+      for (k = first; k < last; k += width) {
+        long long count = 0;
+        size_t j;
+        for (j = k; j < k + width && j < last; j++)
+          count += s->counts[j];
+        if (width == 1)
+          printf("  %12lld %lld\n", s->lo + (long long) k, count);
+        else
+          printf("  %12lld .. %-12lld %lld\n", s->lo + (long long) k,
+                 s->lo + (long long) (j - 1), count);
+      }
+    }
+  }
+
+  if (mask & STATS_TOPK) {
+    qsort_r(s->heap, s->numTop, sizeof(StatsEntry), matrix_stats_compare, &s->type);
+    printf("The %d largest elements:\n", s->numTop);
+    for (i = 0; i < s->numTop; i++) {
+      printf("  ");
+      matrix_stats_print_value(s->type, s->heap[i].value);
+      printf(" at (%d, %d)\n", s->heap[i].row, s->heap[i].col);
+    }
+  }
+}
+
+#endif /* MATRIX_STATS_H */
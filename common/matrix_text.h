@@ -0,0 +1,374 @@
+/* text matrix files for the matrixSum programs
+
+   format: one matrix row per line, int32 values in decimal (optional sign)
+           separated by commas and/or blanks (spaces, tabs), so both CSV and
+           whitespace-separated files are read. Blank lines and lines
+           starting with '#' are skipped; '\r' before a newline is ignored.
+           Every row must have as many values as the first one.
+
+   features: matrix_text_load() maps the file read-only and splits it into
+             one byte range per worker, each moved forward to the start of a
+             line, so no line is shared. The workers run twice:
+               count  each worker counts the rows in its range, so the row
+                      each range starts at is known (a prefix sum) and the
+                      matrix can be allocated (common/matrix_alloc.h)
+               parse  each worker parses its range straight into its rows;
+                      these are first touched by that worker
+             Numbers are parsed 8 digits at a time (SWAR: SIMD within a
+             register): 8 bytes are loaded into a uint64_t, the first
+             non-digit byte is found with one mask and a count of trailing
+             zeros, and the digits are combined with three multiplies
+             instead of one multiply-add per digit. The last 7 bytes of the
+             file are parsed a digit at a time, so a load never crosses the
+             end of the mapping.
+             The bytes each worker parsed and its parse time are kept, so
+             matrix_text_report() prints the MB/s of each worker.
+
+   usage:
+     #include "../../common/matrix_text.h"
+
+     MatrixStorage st;
+     MatrixTextInfo info;
+     int *m = matrix_text_load("matrix.csv", numWorkers, pin, PAGES_DEFAULT, &st, &info);
+     matrix_text_report(&info);
+     ... info.rows, info.cols ...
+     matrix_text_info_free(&info);
+     matrix_free(&st);
+
+*/
+#ifndef MATRIX_TEXT_H
+#define MATRIX_TEXT_H
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* pthread_attr_setaffinity_np in matrix_alloc.h */
+#endif
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include "matrix_alloc.h"
+
+#define MATRIX_TEXT_MAX ((uint64_t) INT32_MAX + 1) /* magnitude of INT32_MIN */
+
+/* what was loaded, and how fast */
+typedef struct {
+  int rows, cols;
+  int numWorkers;
+  size_t bytes;          /* size of the file */
+  double countTime;      /* wall time of the count pass */
+  double parseTime;      /* wall time of the parse pass */
+  size_t *workerBytes;   /* bytes parsed by each worker */
+  double *workerTime;    /* parse time of each worker */
+} MatrixTextInfo;
+
+/* one worker's range of the file and rows */
+typedef struct {
+  const char *path;
+  const char *text;      /* the whole file */
+  size_t begin, end;     /* the worker's bytes: whole lines */
+  int firstRow, rows;    /* rows found by the count pass */
+  int cols;
+  int *matrix;
+  double seconds;        /* parse time */
+} MatrixTextTask;
+
+static inline double matrix_text_now(void) {
+  struct timeval t;
+  gettimeofday(&t, NULL);
+  return t.tv_sec + 1.0e-6 * t.tv_usec;
+}
+
+static inline int matrix_text_blank(char c) {
+  return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+/* the value of 8 decimal digits as loaded little-endian from the text (the
+   first, most significant, in the low byte); a zero byte counts as digit 0 */
+static inline uint32_t matrix_text_eight(uint64_t x) {
+  x = ((x & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;             /* pairs: 10*a + b */
+  x = ((x & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;         /* quads: 100*ab + cd */
+  return (uint32_t) (((x & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32);
+}
+
+/* parse one integer at p (before end); stores it in *value and returns the
+   byte after it, or NULL if there is no number or it does not fit an int */
+static inline const char *matrix_text_int(const char *p, const char *end, int *value) {
+  static const uint32_t pow10[9] = { 1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000 };
+  const char *digits;
+  uint64_t v = 0;
+  int negative = 0;
+
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+  digits = p;
+  while (end - p >= 8) {
+    uint64_t chunk, nondigit;
+    int n;
+    memcpy(&chunk, p, 8);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    chunk = __builtin_bswap64(chunk);
+#endif
+    /* a byte is a digit if its high nibble is 3 and adding 6 keeps it 3;
+       a carry out of a non-digit byte only reaches later bytes */
+    nondigit = ((chunk & 0xF0F0F0F0F0F0F0F0ULL) |
+                (((chunk + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4)) ^
+               0x3333333333333333ULL;
+    if (nondigit == 0) {
+      v = v * 100000000 + matrix_text_eight(chunk);
+      p += 8;
+      if (v > MATRIX_TEXT_MAX) return NULL;
+      continue;
+    }
+    n = __builtin_ctzll(nondigit) >> 3;
+    if (n > 0) {
+      /* shift the n digits to the top, below them come zero bytes */
+      v = v * pow10[n] + matrix_text_eight(chunk << (8 * (8 - n)));
+      p += n;
+    }
+    goto done;
+  }
+  while (p < end && *p >= '0' && *p <= '9') {
+    v = v * 10 + (*p - '0');
+    p++;
+    if (v > MATRIX_TEXT_MAX) return NULL;
+  }
+done:
+  if (p == digits || v > MATRIX_TEXT_MAX - !negative)
+    return NULL;
+  *value = negative ? (int) -(int64_t) v : (int) v;
+  return p;
+}
+
+/* the start of the line after p (or end) */
+static inline const char *matrix_text_next_line(const char *p, const char *end) {
+  const char *nl = memchr(p, '\n', end - p);
+  return (nl != NULL) ? nl + 1 : end;
+}
+
+/* the first byte of a line that is not a blank; *skip says whether the
+   line is blank or a comment */
+static inline const char *matrix_text_line_start(const char *p, const char *end, int *skip) {
+  while (p < end && matrix_text_blank(*p))
+    p++;
+  *skip = (p == end || *p == '\n' || *p == '#');
+  return p;
+}
+
+/* parse the line at p, storing at most maxCols values into row (NULL to
+   only count them); returns the number of values, or -1 on a bad number,
+   and leaves *next at the start of the next line */
+static inline int matrix_text_row(const char *p, const char *end, int *row, int maxCols,
+                                  const char **next) {
+  int n = 0, value;
+
+  for (;;) {
+    p = matrix_text_int(p, end, &value);
+    if (p == NULL) {
+      *next = NULL;
+      return -1;
+    }
+    if (n < maxCols)
+      row[n] = value;
+    n++;
+    while (p < end && matrix_text_blank(*p))
+      p++;
+    if (p == end || *p == '\n')
+      break;
+  }
+  *next = (p < end) ? p + 1 : end;
+  return n;
+}
+
+/* report a bad line and exit */
+static inline void matrix_text_error(const MatrixTextTask *task, const char *at, const char *what) {
+  const char *line = at, *end = task->text + task->end, *eol = at;
+  while (line > task->text && line[-1] != '\n')
+    line--;
+  while (eol < end && *eol != '\n' && *eol != '\r')
+    eol++;
+  fprintf(stderr, "%s: %s at byte %zu: \"%.*s\"\n", task->path, what, (size_t) (at - task->text),
+          (int) (eol - line), line);
+  exit(1);
+}
+
+static inline void *matrix_text_count_worker(void *arg) {
+  MatrixTextTask *task = arg;
+  const char *p = task->text + task->begin, *end = task->text + task->end;
+  int skip;
+
+  task->rows = 0;
+  while (p < end) {
+    matrix_text_line_start(p, end, &skip);
+    task->rows += !skip;
+    p = matrix_text_next_line(p, end);
+  }
+  return NULL;
+}
+
+static inline void *matrix_text_parse_worker(void *arg) {
+  MatrixTextTask *task = arg;
+  const char *p = task->text + task->begin, *end = task->text + task->end, *start;
+  int *row = task->matrix + (size_t) task->firstRow * task->cols;
+  double t = matrix_text_now();
+  int skip, n;
+
+  while (p < end) {
+    start = matrix_text_line_start(p, end, &skip);
+    if (skip) {
+      p = matrix_text_next_line(start, end);
+      continue;
+    }
+    n = matrix_text_row(start, end, row, task->cols, &p);
+    if (n < 0)
+      matrix_text_error(task, start, "bad or out of range number");
+    if (n != task->cols)
+      matrix_text_error(task, start, "wrong number of values");
+    row += task->cols;
+  }
+  task->seconds = matrix_text_now() - t;
+  return NULL;
+}
+
+/* run fn on every task, one thread each */
+static inline void matrix_text_run(MatrixTextTask *tasks, int numWorkers, bool pin, void *(*fn)(void *)) {
+  pthread_t *tids = malloc(numWorkers * sizeof(pthread_t));
+  pthread_attr_t attr;
+  long l;
+
+  if (tids == NULL) {
+    fprintf(stderr, "Out of memory for %d parse threads\n", numWorkers);
+    exit(1);
+  }
+  pthread_attr_init(&attr);
+  for (l = 0; l < numWorkers; l++) {
+    if (pin) matrix_pin_attr(&attr, l);
+    pthread_create(&tids[l], &attr, fn, &tasks[l]);
+  }
+  for (l = 0; l < numWorkers; l++)
+    pthread_join(tids[l], NULL);
+  pthread_attr_destroy(&attr);
+  free(tids);
+}
+
+/* load the text matrix in path with numWorkers threads into new storage;
+   returns the matrix, exits with a message on error */
+static inline int *matrix_text_load(const char *path, int numWorkers, bool pin, PageMode mode,
+                                    MatrixStorage *st, MatrixTextInfo *info) {
+  MatrixTextTask *tasks;
+  struct stat sb;
+  const char *text, *p, *next;
+  int *matrix, fd, skip, l;
+  long long rows = 0;
+  double t;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &sb) != 0) {
+    perror(path);
+    exit(1);
+  }
+  if (sb.st_size == 0) {
+    fprintf(stderr, "%s is empty\n", path);
+    exit(1);
+  }
+  text = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (text == MAP_FAILED) {
+    perror("mmap");
+    exit(1);
+  }
+  madvise((void *) text, sb.st_size, MADV_SEQUENTIAL);
+
+  memset(info, 0, sizeof(*info));
+  info->numWorkers = numWorkers;
+  info->bytes = sb.st_size;
+  tasks = calloc(numWorkers, sizeof(MatrixTextTask));
+  info->workerBytes = malloc(numWorkers * sizeof(size_t));
+  info->workerTime = malloc(numWorkers * sizeof(double));
+  if (tasks == NULL || info->workerBytes == NULL || info->workerTime == NULL) {
+    fprintf(stderr, "Out of memory for %d parse threads\n", numWorkers);
+    exit(1);
+  }
+
+  /* equal byte ranges, each moved to the start of the next line */
+  for (l = 0; l < numWorkers; l++) {
+    size_t begin = (size_t) ((double) sb.st_size * l / numWorkers);
+    if (l > 0 && begin > 0 && text[begin - 1] != '\n')
+      begin = matrix_text_next_line(text + begin, text + sb.st_size) - text;
+    tasks[l].path = path;
+    tasks[l].text = text;
+    tasks[l].begin = begin;
+  }
+  for (l = 0; l < numWorkers; l++)
+    tasks[l].end = (l < numWorkers - 1) ? tasks[l + 1].begin : (size_t) sb.st_size;
+
+  t = matrix_text_now();
+  matrix_text_run(tasks, numWorkers, pin, matrix_text_count_worker);
+  info->countTime = matrix_text_now() - t;
+  for (l = 0; l < numWorkers; l++) {
+    tasks[l].firstRow = (int) rows;
+    rows += tasks[l].rows;
+  }
+  if (rows == 0 || rows > INT32_MAX) {
+    fprintf(stderr, "%s: %lld rows\n", path, rows);
+    exit(1);
+  }
+
+  /* the first row gives the number of columns */
+  p = text;
+  for (;;) {
+    p = matrix_text_line_start(p, text + sb.st_size, &skip);
+    if (!skip)
+      break;
+    p = matrix_text_next_line(p, text + sb.st_size);
+  }
+  info->rows = (int) rows;
+  info->cols = matrix_text_row(p, text + sb.st_size, NULL, 0, &next);
+  if (info->cols < 0) {
+    MatrixTextTask whole = { path, text, 0, sb.st_size, 0, 0, 0, NULL, 0 };
+    matrix_text_error(&whole, p, "bad or out of range number");
+  }
+
+  matrix = matrix_alloc(st, info->rows, info->cols, mode);
+  for (l = 0; l < numWorkers; l++) {
+    tasks[l].cols = info->cols;
+    tasks[l].matrix = matrix;
+  }
+  t = matrix_text_now();
+  matrix_text_run(tasks, numWorkers, pin, matrix_text_parse_worker);
+  info->parseTime = matrix_text_now() - t;
+  for (l = 0; l < numWorkers; l++) {
+    info->workerBytes[l] = tasks[l].end - tasks[l].begin;
+    info->workerTime[l] = tasks[l].seconds;
+  }
+
+  free(tasks);
+  munmap((void *) text, sb.st_size);
+  close(fd);
+  return matrix;
+}
+
+/* print the load rates: overall, then MB/s parsed by each worker */
+static inline void matrix_text_report(const MatrixTextInfo *info) {
+  int l;
+
+  printf("Parsed %dx%d from %.1f MB of text in %g sec (count %g, parse %g): %.1f MB/s\n",
+         info->rows, info->cols, info->bytes / 1e6, info->countTime + info->parseTime,
+         info->countTime, info->parseTime, info->bytes / 1e6 / (info->countTime + info->parseTime));
+  printf("MB/s parsed per worker:");
+  for (l = 0; l < info->numWorkers; l++)
+    printf(" %.1f", (info->workerTime[l] > 0) ? info->workerBytes[l] / 1e6 / info->workerTime[l] : 0.0);
+  printf("\n");
+}
+
+static inline void matrix_text_info_free(MatrixTextInfo *info) {
+  free(info->workerBytes);
+  free(info->workerTime);
+}
+
+#endif /* MATRIX_TEXT_H */
@@ -0,0 +1,216 @@
+/* midpoint-rule kernels for the area under the quarter circle f(x) = sqrt(1 - x*x)
+
+   features: midpoint_sum(first, last, dx) returns the sum of f((i + 0.5) * dx)
+             for first <= i < last, the midpoint rule without the final
+             multiply by dx. The naive kernel is the textbook loop: one
+             accumulator, so every add waits for the previous one. The other
+             kernels keep MIDPOINT_ACCS independent accumulators of one
+             vector each (scalar: one double each), so the adds and the
+             square roots (vsqrtpd) of several vectors are in flight at once.
+             Instead of converting i to double for every step, each lane
+             keeps i + 0.5 as a double and adds the step count per iteration;
+             both are integers (plus one half) below 2^52, so this is exact
+             and x = (i + 0.5) * dx is the same as in the naive loop, unlike
+             an accumulated x += dx whose error grows with the step count.
+             The accumulators only sum MIDPOINT_BLOCK steps; block sums are
+             added with Neumaier's compensated (Kahan-Babuska) summation, so
+             the rounding error stays at a few ulps at 10^10 steps and more,
+             where a single running sum loses several digits.
+             Scalar, AVX2, and AVX-512 paths are compiled with per-function
+             target attributes and picked at runtime via cpuid, as in
+             reduce_kernel.h.
+
+   usage:
+     #include "../../common/midpoint_kernel.h"
+
+     midpoint_kernel_select("auto");   // or "naive", "scalar", "avx2", "avx512"
+     area = midpoint_sum(first, last, dx) * dx;
+
+*/
+#ifndef MIDPOINT_KERNEL_H
+#define MIDPOINT_KERNEL_H
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MIDPOINT_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+#define MIDPOINT_ACCS 4      /* independent accumulators per kernel */
+#define MIDPOINT_BLOCK 4096  /* steps summed before a compensated add */
+
+/* a compensated sum: the exact total is about sum + comp */
+typedef struct {
+  double sum, comp;
+} MidpointSum;
+
+/* Neumaier's variant of Kahan summation: also exact when v is larger than the sum */
+static inline void midpoint_sum_add(MidpointSum *s, double v) {
+  double t = s->sum + v;
+  if (fabs(s->sum) >= fabs(v))
+    s->comp += (s->sum - t) + v;
+  else
+    s->comp += (v - t) + s->sum;
+  s->sum = t;
+}
+
+static inline double midpoint_sum_value(const MidpointSum *s) {
+  return s->sum + s->comp;
+}
+
+/* sums n steps from first (n a multiple of the kernel's lanes) */
+typedef double (*MidpointBlockFn)(long long first, long long n, double dx);
+
+/* the blocks of first..last-1 of at most MIDPOINT_BLOCK steps, added with
+   compensation; the last steps that do not fill the lanes are summed here */
+static inline double midpoint_blocks(long long first, long long last, double dx, MidpointBlockFn block,
+                                     int lanes) {
+  MidpointSum total = { 0, 0 };
+  long long i = first, n;
+
+  while (i < last) {
+    n = (last - i < MIDPOINT_BLOCK) ? last - i : MIDPOINT_BLOCK;
+    n -= n % lanes;
+    if (n == 0)
+      break;
+    midpoint_sum_add(&total, block(i, n, dx));
+    i += n;
+  }
+  for (; i < last; i++) {
+    double x = (i + 0.5) * dx;
+    midpoint_sum_add(&total, sqrt(1.0 - x * x));
+  }
+  return midpoint_sum_value(&total);
+}
+
+/* the textbook loop: one dependent chain of adds, no compensation */
+static inline double midpoint_sum_naive(long long first, long long last, double dx) {
+  double sum = 0.0;
+  long long i;
+
+  for (i = first; i < last; i++) {
+    double x = (i + 0.5) * dx;
+    sum += sqrt(1.0 - x * x);
+  }
+  return sum;
+}
+
+static inline double midpoint_block_scalar(long long first, long long n, double dx) {
+  double acc[MIDPOINT_ACCS] = { 0 }, mid[MIDPOINT_ACCS];
+  long long j;
+  int k;
+
+  for (k = 0; k < MIDPOINT_ACCS; k++)
+    mid[k] = first + k + 0.5;
+  for (j = 0; j < n; j += MIDPOINT_ACCS)
+    for (k = 0; k < MIDPOINT_ACCS; k++) {
+      double x = mid[k] * dx;
+      acc[k] += sqrt(1.0 - x * x);
+      mid[k] += MIDPOINT_ACCS;
+    }
+  return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+static inline double midpoint_sum_scalar(long long first, long long last, double dx) {
+  return midpoint_blocks(first, last, dx, midpoint_block_scalar, MIDPOINT_ACCS);
+}
+
+#ifdef MIDPOINT_KERNEL_X86
+
+__attribute__((target("avx2")))
+static inline double midpoint_block_avx2(long long first, long long n, double dx) {
+  const __m256d vdx = _mm256_set1_pd(dx), one = _mm256_set1_pd(1.0);
+  const __m256d stride = _mm256_set1_pd(4 * MIDPOINT_ACCS);
+  __m256d acc[MIDPOINT_ACCS], mid[MIDPOINT_ACCS], x;
+  double lanes[4];
+  long long j;
+  int k;
+
+  for (k = 0; k < MIDPOINT_ACCS; k++) {
+    acc[k] = _mm256_setzero_pd();
+    mid[k] = _mm256_add_pd(_mm256_set1_pd(first + 4 * k), _mm256_set_pd(3.5, 2.5, 1.5, 0.5));
+  }
+  for (j = 0; j < n; j += 4 * MIDPOINT_ACCS)
+    for (k = 0; k < MIDPOINT_ACCS; k++) {
+      x = _mm256_mul_pd(mid[k], vdx);
+      acc[k] = _mm256_add_pd(acc[k], _mm256_sqrt_pd(_mm256_sub_pd(one, _mm256_mul_pd(x, x))));
+      mid[k] = _mm256_add_pd(mid[k], stride);
+    }
+  _mm256_storeu_pd(lanes, _mm256_add_pd(_mm256_add_pd(acc[0], acc[1]), _mm256_add_pd(acc[2], acc[3])));
+  return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+}
+
+static inline double midpoint_sum_avx2(long long first, long long last, double dx) {
+  return midpoint_blocks(first, last, dx, midpoint_block_avx2, 4 * MIDPOINT_ACCS);
+}
+
+__attribute__((target("avx512f")))
+static inline double midpoint_block_avx512(long long first, long long n, double dx) {
+  const __m512d vdx = _mm512_set1_pd(dx), one = _mm512_set1_pd(1.0);
+  const __m512d stride = _mm512_set1_pd(8 * MIDPOINT_ACCS);
+  __m512d acc[MIDPOINT_ACCS], mid[MIDPOINT_ACCS], x;
+  long long j;
+  int k;
+
+  for (k = 0; k < MIDPOINT_ACCS; k++) {
+    acc[k] = _mm512_setzero_pd();
+    mid[k] = _mm512_add_pd(_mm512_set1_pd(first + 8 * k),
+                           _mm512_set_pd(7.5, 6.5, 5.5, 4.5, 3.5, 2.5, 1.5, 0.5));
+  }
+  for (j = 0; j < n; j += 8 * MIDPOINT_ACCS)
+    for (k = 0; k < MIDPOINT_ACCS; k++) {
+      x = _mm512_mul_pd(mid[k], vdx);
+      acc[k] = _mm512_add_pd(acc[k], _mm512_sqrt_pd(_mm512_sub_pd(one, _mm512_mul_pd(x, x))));
+      mid[k] = _mm512_add_pd(mid[k], stride);
+    }
+  return _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(acc[0], acc[1]), _mm512_add_pd(acc[2], acc[3])));
+}
+
+static inline double midpoint_sum_avx512(long long first, long long last, double dx) {
+  return midpoint_blocks(first, last, dx, midpoint_block_avx512, 8 * MIDPOINT_ACCS);
+}
+
+#endif /* MIDPOINT_KERNEL_X86 */
+
+typedef double (*MidpointSumFn)(long long first, long long last, double dx);
+
+/* the kernel in use; midpoint_kernel_select() replaces it */
+static MidpointSumFn midpoint_sum = midpoint_sum_scalar;
+static const char *midpoint_kernel_name = "scalar";
+
+static inline int midpoint_kernel_supported(const char *name) {
+  if (strcmp(name, "naive") == 0 || strcmp(name, "scalar") == 0) return 1;
+#ifdef MIDPOINT_KERNEL_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+  if (strcmp(name, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+#endif
+  return 0;
+}
+
+/* select a kernel by name ("auto" picks the widest supported one);
+   returns the name of the selected kernel, or NULL if it is unknown or
+   not supported by this CPU (the current kernel is then left unchanged) */
+static inline const char *midpoint_kernel_select(const char *name) {
+  static const char *widest[] = { "avx512", "avx2", "scalar" };
+  int k;
+
+  if (name == NULL || strcmp(name, "auto") == 0) {
+    for (k = 0; !midpoint_kernel_supported(widest[k]); k++)
+      ;
+    name = widest[k];
+  }
+  if (!midpoint_kernel_supported(name)) return NULL;
+
+  if (strcmp(name, "naive") == 0) { midpoint_sum = midpoint_sum_naive; midpoint_kernel_name = "naive"; }
+  else if (strcmp(name, "scalar") == 0) { midpoint_sum = midpoint_sum_scalar; midpoint_kernel_name = "scalar"; }
+#ifdef MIDPOINT_KERNEL_X86
+  else if (strcmp(name, "avx2") == 0) { midpoint_sum = midpoint_sum_avx2; midpoint_kernel_name = "avx2"; }
+  else if (strcmp(name, "avx512") == 0) { midpoint_sum = midpoint_sum_avx512; midpoint_kernel_name = "avx512"; }
+#endif
+  return midpoint_kernel_name;
+}
+
+#endif /* MIDPOINT_KERNEL_H */
@@ -0,0 +1,169 @@
+/* hit-or-miss Monte Carlo kernels for the quarter circle x^2 + y^2 < 1
+
+   features: monte_carlo_hits(seed, first, last) returns how many of the
+             samples first..last-1 fall inside the quarter circle. Sample k
+             is the point (x, y) of the two 32-bit halves of
+             splitmix64_at(seed, k) (common/counter_rng.h), scaled by 2^-32.
+             The generator is counter-based, so a worker starts its range
+             at any k without stepping through the ones before it (the
+             jump-ahead is free), and the hit count of a range does not
+             depend on how it is split among workers: for a given seed the
+             result is the same with any number of threads.
+             The test is exact integer arithmetic: x^2 and y^2 are 64-bit
+             products of 32-bit values, and x^2 + y^2 < 2^64 exactly when
+             their 64-bit sum does not wrap around, i.e. is not below x^2.
+             So every kernel counts the same hits (a floating-point test
+             could differ between kernels where the compiler fuses the
+             multiply and add). The grid of 2^-32 adds a bias of about
+             2^-32 to the hit rate, far below the standard error of any
+             feasible number of samples.
+             The AVX2 and AVX-512 kernels run SplitMix64 on 4 or 8 counters
+             at once (AVX2 builds the 64-bit multiplies from 32-bit ones,
+             AVX-512DQ has them), compare with vector compares, and count
+             the misses per lane. Scalar, AVX2, and AVX-512 paths are
+             compiled with per-function target attributes and picked at
+             runtime via cpuid, as in midpoint_kernel.h.
+
+   usage:
+     #include "../../common/monte_carlo_kernel.h"
+
+     monte_carlo_kernel_select("auto");   // or "scalar", "avx2", "avx512"
+     hits = monte_carlo_hits(seed, first, last);
+     pi = 4.0 * total_hits / samples;
+
+*/
+#ifndef MONTE_CARLO_KERNEL_H
+#define MONTE_CARLO_KERNEL_H
+
+#include <stdint.h>
+#include <string.h>
+#include "counter_rng.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MONTE_CARLO_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+#define MONTE_CARLO_C1 0xBF58476D1CE4E5B9ULL  /* the multipliers of splitmix64_mix() */
+#define MONTE_CARLO_C2 0x94D049BB133111EBULL
+
+/* 1 if the sample of the random bits r lies inside the quarter circle */
+static inline uint64_t monte_carlo_inside(uint64_t r) {
+  uint64_t x = r >> 32, y = r & 0xFFFFFFFFu, xx = x * x;
+  return xx + y * y >= xx;  /* no wrap-around: x^2 + y^2 < 2^64 */
+}
+
+static inline uint64_t monte_carlo_hits_scalar(uint64_t seed, uint64_t first, uint64_t last) {
+  uint64_t hits = 0, k;
+
+  for (k = first; k < last; k++)
+    hits += monte_carlo_inside(splitmix64_at(seed, k));
+  return hits;
+}
+
+#ifdef MONTE_CARLO_KERNEL_X86
+
+/* the low 64 bits of a * b in each lane, from three 32 x 32 -> 64 multiplies */
+__attribute__((target("avx2")))
+static inline __m256i monte_carlo_mul64_avx2(__m256i a, uint64_t b) {
+  const __m256i blo = _mm256_set1_epi64x((long long) (b & 0xFFFFFFFFu));
+  const __m256i bhi = _mm256_set1_epi64x((long long) (b >> 32));
+  __m256i cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), blo), _mm256_mul_epu32(a, bhi));
+  return _mm256_add_epi64(_mm256_mul_epu32(a, blo), _mm256_slli_epi64(cross, 32));
+}
+
+__attribute__((target("avx2")))
+static inline uint64_t monte_carlo_hits_avx2(uint64_t seed, uint64_t first, uint64_t last) {
+  const __m256i step = _mm256_set1_epi64x((long long) (4 * SPLITMIX64_GAMMA));
+  const __m256i sign = _mm256_set1_epi64x((long long) 0x8000000000000000ULL);
+  __m256i state, z, xx, sum, misses = _mm256_setzero_si256();
+  uint64_t n = (last - first) / 4 * 4, k, lanes[4];
+
+  state = _mm256_set_epi64x((long long) (seed + (first + 4) * SPLITMIX64_GAMMA),
+                            (long long) (seed + (first + 3) * SPLITMIX64_GAMMA),
+                            (long long) (seed + (first + 2) * SPLITMIX64_GAMMA),
+                            (long long) (seed + (first + 1) * SPLITMIX64_GAMMA));
+  for (k = 0; k < n; k += 4) {
+    z = _mm256_xor_si256(state, _mm256_srli_epi64(state, 30));
+    z = monte_carlo_mul64_avx2(z, MONTE_CARLO_C1);
+    z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 27));
+    z = monte_carlo_mul64_avx2(z, MONTE_CARLO_C2);
+    z = _mm256_xor_si256(z, _mm256_srli_epi64(z, 31));
+    xx = _mm256_mul_epu32(_mm256_srli_epi64(z, 32), _mm256_srli_epi64(z, 32));
+    sum = _mm256_add_epi64(xx, _mm256_mul_epu32(z, z));   /* mul_epu32 uses the low halves */
+    /* a miss wrapped around: x^2 > sum, compared unsigned by flipping the signs */
+    misses = _mm256_sub_epi64(misses, _mm256_cmpgt_epi64(_mm256_xor_si256(xx, sign),
+                                                         _mm256_xor_si256(sum, sign)));
+    state = _mm256_add_epi64(state, step);
+  }
+  _mm256_storeu_si256((__m256i *) lanes, misses);
+  return n - (lanes[0] + lanes[1] + lanes[2] + lanes[3]) + monte_carlo_hits_scalar(seed, first + n, last);
+}
+
+__attribute__((target("avx512f,avx512dq")))
+static inline uint64_t monte_carlo_hits_avx512(uint64_t seed, uint64_t first, uint64_t last) {
+  const __m512i step = _mm512_set1_epi64((long long) (8 * SPLITMIX64_GAMMA));
+  const __m512i c1 = _mm512_set1_epi64((long long) MONTE_CARLO_C1);
+  const __m512i c2 = _mm512_set1_epi64((long long) MONTE_CARLO_C2);
+  const __m512i one = _mm512_set1_epi64(1);
+  __m512i state, z, xx, sum, misses = _mm512_setzero_si512();
+  uint64_t n = (last - first) / 8 * 8, k;
+
+  state = _mm512_add_epi64(_mm512_set1_epi64((long long) (seed + (first + 1) * SPLITMIX64_GAMMA)),
+                           _mm512_mullo_epi64(_mm512_set_epi64(7, 6, 5, 4, 3, 2, 1, 0),
+                                              _mm512_set1_epi64((long long) SPLITMIX64_GAMMA)));
+  for (k = 0; k < n; k += 8) {
+    z = _mm512_xor_si512(state, _mm512_srli_epi64(state, 30));
+    z = _mm512_mullo_epi64(z, c1);
+    z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 27));
+    z = _mm512_mullo_epi64(z, c2);
+    z = _mm512_xor_si512(z, _mm512_srli_epi64(z, 31));
+    xx = _mm512_mul_epu32(_mm512_srli_epi64(z, 32), _mm512_srli_epi64(z, 32));
+    sum = _mm512_add_epi64(xx, _mm512_mul_epu32(z, z));   /* mul_epu32 uses the low halves */
+    misses = _mm512_mask_add_epi64(misses, _mm512_cmp_epu64_mask(sum, xx, _MM_CMPINT_LT), misses, one);
+    state = _mm512_add_epi64(state, step);
+  }
+  return n - (uint64_t) _mm512_reduce_add_epi64(misses) + monte_carlo_hits_scalar(seed, first + n, last);
+}
+
+#endif /* MONTE_CARLO_KERNEL_X86 */
+
+typedef uint64_t (*MonteCarloHitsFn)(uint64_t seed, uint64_t first, uint64_t last);
+
+/* the kernel in use; monte_carlo_kernel_select() replaces it */
+static MonteCarloHitsFn monte_carlo_hits = monte_carlo_hits_scalar;
+static const char *monte_carlo_kernel_name = "scalar";
+
+static inline int monte_carlo_kernel_supported(const char *name) {
+  if (strcmp(name, "scalar") == 0) return 1;
+#ifdef MONTE_CARLO_KERNEL_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+  if (strcmp(name, "avx512") == 0) return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq");
+#endif
+  return 0;
+}
+
+/* select a kernel by name ("auto" picks the widest supported one);
+   returns the name of the selected kernel, or NULL if it is unknown or
+   not supported by this CPU (the current kernel is then left unchanged) */
+static inline const char *monte_carlo_kernel_select(const char *name) {
+  static const char *widest[] = { "avx512", "avx2", "scalar" };
+  int k;
+
+  if (name == NULL || strcmp(name, "auto") == 0) {
+    for (k = 0; !monte_carlo_kernel_supported(widest[k]); k++)
+      ;
+    name = widest[k];
+  }
+  if (!monte_carlo_kernel_supported(name)) return NULL;
+
+  if (strcmp(name, "scalar") == 0) { monte_carlo_hits = monte_carlo_hits_scalar; monte_carlo_kernel_name = "scalar"; }
+#ifdef MONTE_CARLO_KERNEL_X86
+  else if (strcmp(name, "avx2") == 0) { monte_carlo_hits = monte_carlo_hits_avx2; monte_carlo_kernel_name = "avx2"; }
+  else if (strcmp(name, "avx512") == 0) { monte_carlo_hits = monte_carlo_hits_avx512; monte_carlo_kernel_name = "avx512"; }
+#endif
+  return monte_carlo_kernel_name;
+}
+
+#endif /* MONTE_CARLO_KERNEL_H */
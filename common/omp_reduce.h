@@ -0,0 +1,109 @@
+/* OpenMP sum, min, and max with locations over a block of matrix rows
+
+   features: the user-defined reductions minloc and maxloc over (value, row,
+             col) for "omp declare reduction", and omp_reduce_rows(), which
+             reduces rows with a single parallel for using them, so there is
+             no critical section and no cap on the number of threads. Ties go
+             to the earlier position, so the result does not depend on the
+             number of threads or the schedule (schedule(runtime): set it
+             with omp_set_schedule() or OMP_SCHEDULE).
+             Each row is reduced by an omp simd loop, or by the SIMD kernel
+             in reduce_kernel.h when useKernel is set.
+             Compile with -fopenmp.
+
+   usage:
+     #include "../../common/omp_reduce.h"
+
+     long long sum;
+     Located mn, mx;
+     omp_reduce_rows(m, rows, cols, cols, firstRow, false, &sum, &mn, &mx);
+
+*/
+#ifndef OMP_REDUCE_H
+#define OMP_REDUCE_H
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "reduce_kernel.h"
+
+/* an element value and its position */
+typedef struct {
+  int value, row, col;
+} Located;
+
+/* the smaller of two located values; ties go to the earlier position, and
+   an empty one (row -1) loses to anything */
+static inline Located located_min(Located a, Located b) {
+  if (b.row < 0) return a;
+  if (a.row < 0 || b.value < a.value ||
+      (b.value == a.value && reduce_pos_before(b.row, b.col, a.row, a.col)))
+    return b;
+  return a;
+}
+
+static inline Located located_max(Located a, Located b) {
+  if (b.row < 0) return a;
+  if (a.row < 0 || b.value > a.value ||
+      (b.value == a.value && reduce_pos_before(b.row, b.col, a.row, a.col)))
+    return b;
+  return a;
+}
+
+#pragma omp declare reduction(minloc : Located : omp_out = located_min(omp_out, omp_in)) \
+  initializer(omp_priv = (Located) { INT_MAX, -1, -1 })
+#pragma omp declare reduction(maxloc : Located : omp_out = located_max(omp_out, omp_in)) \
+  initializer(omp_priv = (Located) { INT_MIN, -1, -1 })
+
+/* sum, min, and max of the rows x cols row-major block m, whose rows start
+   stride elements apart and whose first row is row firstRow of the whole
+   matrix (the positions are reported in it) */
+static inline void omp_reduce_rows(const int *m, int rows, int cols, size_t stride, int firstRow,
+                                   bool useKernel, long long *sum, Located *minLoc, Located *maxLoc) {
+  int i;
+  long long total_sum = 0;
+  Located mn = { INT_MAX, -1, -1 }, mx = { INT_MIN, -1, -1 };
+
+  #pragma omp parallel for schedule(runtime) \
+    reduction(+:total_sum) reduction(minloc:mn) reduction(maxloc:mx)
+  for (i = 0; i < rows; i++) {
+    const int *row = m + (size_t) i * stride;
+    int j, rowMin = INT_MAX, rowMax = INT_MIN;
+    long long rowSum = 0;
+
+    if (useKernel) {
+      Reduction r;
+      reduction_init(&r);
+      reduce_row(row, cols, firstRow + i, &r);
+      total_sum += r.sum;
+      mn = located_min(mn, (Located) { r.min, r.minRow, r.minCol });
+      mx = located_max(mx, (Located) { r.max, r.maxRow, r.maxCol });
+      continue;
+    }
+
+    #pragma omp simd reduction(+:rowSum) reduction(min:rowMin) reduction(max:rowMax)
+    for (j = 0; j < cols; j++) {
+      rowSum += row[j];
+      rowMin = (row[j] < rowMin) ? row[j] : rowMin;
+      rowMax = (row[j] > rowMax) ? row[j] : rowMax;
+    }
+    total_sum += rowSum;
+    /* find the position only when the row improves on this thread's best,
+       or ties it at an earlier row (a thread may get rows out of order) */
+    if (mn.row < 0 || rowMin < mn.value || (rowMin == mn.value && firstRow + i < mn.row)) {
+      for (j = 0; row[j] != rowMin; j++)
+        ;
+      mn = located_min(mn, (Located) { rowMin, firstRow + i, j });
+    }
+    if (mx.row < 0 || rowMax > mx.value || (rowMax == mx.value && firstRow + i < mx.row)) {
+      for (j = 0; row[j] != rowMax; j++)
+        ;
+      mx = located_max(mx, (Located) { rowMax, firstRow + i, j });
+    }
+  }
+  *sum = total_sum;
+  *minLoc = mn;
+  *maxLoc = mx;
+}
+
+#endif /* OMP_REDUCE_H */
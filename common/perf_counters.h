@@ -0,0 +1,210 @@
+/* per-thread hardware performance counters (Linux perf_event_open)
+
+   features: perf_counters_start() opens, for the calling thread only, the
+             counters of PERF_EVENTS (task clock, cycles, instructions,
+             last-level cache misses, branch misses), counting user space
+             only so that the default perf_event_paranoid setting allows it.
+             perf_counters_stop() reads and closes them. Each event is opened
+             on its own, so a machine (or VM) lacking one of them still
+             reports the others; a count the kernel had to multiplex with
+             other events is scaled up by time enabled / time running and
+             marked with '~'. The task clock is a software event, so it is
+             there even without a PMU.
+             perf_counters_print() prints one row per worker and a total,
+             with n/a for the counters that could not be opened, or a single
+             line saying why none could.
+             Workers of pthreads programs call start/stop at the top and the
+             bottom of Worker(); in OpenMP programs each thread of the
+             parallel region does, indexed by omp_get_thread_num().
+
+   usage:
+     #include "../../common/perf_counters.h"
+
+     PerfCounters *perf = calloc(numWorkers, sizeof(PerfCounters));
+     ... in worker id:
+     perf_counters_start(&perf[id]);
+     ... the parallel phase ...
+     perf_counters_stop(&perf[id]);
+     ... after joining:
+     perf_counters_print(perf, numWorkers, "reduction");
+
+*/
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+/* X(name, type, config, column heading) */
+#define PERF_EVENTS(X)                                                                   \
+  X(PERF_TASK_CLOCK, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK, "task ms")            \
+  X(PERF_CYCLES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, "cycles")                 \
+  X(PERF_INSTRUCTIONS, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, "instructions")   \
+  X(PERF_LLC_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, "LLC misses")       \
+  X(PERF_BRANCH_MISSES, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, "branch misses")
+
+#define PERF_EVENT_ENUM(name, type, config, heading) name,
+typedef enum { PERF_EVENTS(PERF_EVENT_ENUM) PERF_NUM_EVENTS } PerfEvent;
+#undef PERF_EVENT_ENUM
+
+/* the counters of one thread */
+typedef struct {
+  int fd[PERF_NUM_EVENTS];
+  uint64_t value[PERF_NUM_EVENTS];
+  bool valid[PERF_NUM_EVENTS];       /* opened and read */
+  bool scaled[PERF_NUM_EVENTS];      /* multiplexed, so estimated */
+  int error[PERF_NUM_EVENTS];        /* errno of a failed open */
+  bool started;
+} PerfCounters;
+
+#ifdef __linux__
+#define PERF_EVENT_ATTR(name, type, config, heading) { type, config },
+static const struct { uint32_t type; uint64_t config; } perf_event_ids[PERF_NUM_EVENTS] = {
+  PERF_EVENTS(PERF_EVENT_ATTR)
+};
+#undef PERF_EVENT_ATTR
+#endif
+
+#define PERF_EVENT_HEADING(name, type, config, heading) heading,
+static const char *const perf_event_headings[PERF_NUM_EVENTS] = { PERF_EVENTS(PERF_EVENT_HEADING) };
+#undef PERF_EVENT_HEADING
+
+/* open and enable the counters of the calling thread */
+static inline void perf_counters_start(PerfCounters *pc) {
+  int e;
+
+  memset(pc, 0, sizeof(*pc));
+  pc->started = true;
+  for (e = 0; e < PERF_NUM_EVENTS; e++) {
+#ifdef __linux__
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = perf_event_ids[e].type;
+    attr.config = perf_event_ids[e].config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    pc->fd[e] = (int) syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0); /* this thread, any CPU */
+    pc->error[e] = (pc->fd[e] < 0) ? errno : 0;
+#else
+    pc->fd[e] = -1;
+    pc->error[e] = ENOSYS;
+#endif
+  }
+#ifdef __linux__
+  for (e = 0; e < PERF_NUM_EVENTS; e++)
+    if (pc->fd[e] >= 0)
+      ioctl(pc->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+#endif
+}
+
+/* disable, read, and close the counters of the calling thread */
+static inline void perf_counters_stop(PerfCounters *pc) {
+#ifdef __linux__
+  uint64_t data[3]; /* value, time enabled, time running */
+  int e;
+
+  for (e = 0; e < PERF_NUM_EVENTS; e++)
+    if (pc->fd[e] >= 0)
+      ioctl(pc->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+  for (e = 0; e < PERF_NUM_EVENTS; e++) {
+    if (pc->fd[e] < 0)
+      continue;
+    if (read(pc->fd[e], data, sizeof(data)) == (ssize_t) sizeof(data) && data[2] > 0) {
+      pc->value[e] = data[0];
+      if (data[2] < data[1]) {
+        pc->value[e] = (uint64_t) ((double) data[0] * data[1] / data[2]);
+        pc->scaled[e] = true;
+      }
+      pc->valid[e] = true;
+    }
+    close(pc->fd[e]);
+    pc->fd[e] = -1;
+  }
+#else
+  (void) pc;
+#endif
+}
+
+/* one cell of the table: the count (task clock in ms), or n/a */
+static inline void perf_counters_cell(PerfEvent e, bool valid, bool scaled, uint64_t value) {
+  char text[32];
+
+  if (!valid)
+    snprintf(text, sizeof(text), "n/a");
+  else if (e == PERF_TASK_CLOCK)
+    snprintf(text, sizeof(text), "%s%.3f", scaled ? "~" : "", value / 1e6);
+  else
+    snprintf(text, sizeof(text), "%s%llu", scaled ? "~" : "", (unsigned long long) value);
+  printf(" %14s", text);
+}
+
+/* print a row per started worker and the total; a total is only given
+   for a counter every worker has */
+static inline void perf_counters_print(const PerfCounters *pcs, int n, const char *phase) {
+  uint64_t total[PERF_NUM_EVENTS] = { 0 };
+  bool all[PERF_NUM_EVENTS], any = false, scaled[PERF_NUM_EVENTS] = { false };
+  int e, w, error = 0;
+
+  for (e = 0; e < PERF_NUM_EVENTS; e++)
+    all[e] = true;
+  for (w = 0; w < n; w++) {
+    if (!pcs[w].started)
+      continue;
+    for (e = 0; e < PERF_NUM_EVENTS; e++) {
+      all[e] &= pcs[w].valid[e];
+      any |= pcs[w].valid[e];
+      scaled[e] |= pcs[w].scaled[e];
+      total[e] += pcs[w].value[e];
+      if (error == 0) error = pcs[w].error[e];
+    }
+  }
+  if (!any) {
+    printf("Performance counters of the %s are unavailable: %s (see /proc/sys/kernel/perf_event_paranoid)\n",
+           phase, strerror(error ? error : ENOSYS));
+    return;
+  }
+
+  printf("Performance counters of the %s (user space; ~ = multiplexed, estimated):\n", phase);
+  printf("%6s", "worker");
+  for (e = 0; e < PERF_NUM_EVENTS; e++)
+    printf(" %14s", perf_event_headings[e]);
+  printf(" %6s\n", "IPC");
+  for (w = 0; w < n; w++) {
+    const PerfCounters *pc = &pcs[w];
+    if (!pc->started)
+      continue;
+    printf("%6d", w);
+    for (e = 0; e < PERF_NUM_EVENTS; e++)
+      perf_counters_cell(e, pc->valid[e], pc->scaled[e], pc->value[e]);
+    if (pc->valid[PERF_CYCLES] && pc->valid[PERF_INSTRUCTIONS] && pc->value[PERF_CYCLES] > 0)
+      printf(" %6.2f\n", (double) pc->value[PERF_INSTRUCTIONS] / pc->value[PERF_CYCLES]);
+    else
+      printf(" %6s\n", "n/a");
+  }
+  printf("%6s", "total");
+  for (e = 0; e < PERF_NUM_EVENTS; e++)
+    perf_counters_cell(e, all[e], scaled[e], total[e]);
+  if (all[PERF_CYCLES] && all[PERF_INSTRUCTIONS] && total[PERF_CYCLES] > 0)
+    printf(" %6.2f\n", (double) total[PERF_INSTRUCTIONS] / total[PERF_CYCLES]);
+  else
+    printf(" %6s\n", "n/a");
+  for (e = 0; e < PERF_NUM_EVENTS; e++)
+    if (!all[e]) {
+      printf("n/a: %s (no PMU, e.g. in a VM, or blocked by perf_event_paranoid)\n", strerror(error ? error : ENOSYS));
+      break;
+    }
+}
+
+#endif /* PERF_COUNTERS_H */
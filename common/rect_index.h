@@ -0,0 +1,220 @@
+/* constant-time sub-rectangle sum, min, and max
+
+   features: two indexes over a rows x cols int matrix:
+               - a summed-area table, sat[i][j] = sum of the elements above
+                 and left of (i, j), so any rectangle sum is 4 lookups
+               - a 2D sparse table, level (kr, kc) holding the min and max of
+                 the 2^kr x 2^kc rectangle at each (i, j), so any rectangle
+                 is covered by 4 (overlapping) entries of one level
+             rect_index_build() is called by every worker with the same
+             barrier and builds both in parallel by strips of rows:
+               summed-area table: two-pass prefix scan. Pass 1 makes each
+                 strip's table local to the strip; the strips' last rows are
+                 then chained by columns (worker w adds up its columns down
+                 the strips), and pass 2 adds the previous strip's corrected
+                 last row to every other row of a strip.
+               sparse table: the levels (0, kc) only combine elements of one
+                 row, so each worker builds all of them for its own rows;
+                 level (kr, kc) combines two rows of level (kr-1, kc), so the
+                 workers meet at a barrier after each kr.
+             The sparse table takes rows*cols*L_r*L_c*sizeof(MinMax) bytes,
+             L = floor(log2 n) + 1; rect_index_bytes() tells beforehand.
+
+   usage:
+     #include "../../common/rect_index.h"
+
+     RectIndex ix;
+     rect_index_init(&ix, rows, cols);
+     rect_index_build(&ix, m, myid, numWorkers, &barrier);  // in each worker
+     long long s = rect_index_sum(&ix, r0, c0, r1, c1);     // inclusive corners
+     MinMax mm = rect_index_minmax(&ix, r0, c0, r1, c1);
+     rect_index_destroy(&ix);
+
+*/
+#ifndef RECT_INDEX_H
+#define RECT_INDEX_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "barrier.h"
+
+typedef struct {
+  int min, max;
+} MinMax;
+
+typedef struct {
+  int rows, cols;
+  int levelsR, levelsC;   /* sparse-table levels per dimension */
+  long long *sat;         /* (rows + 1) x (cols + 1), row 0 and column 0 are zero */
+  MinMax *sparse;         /* levelsR * levelsC levels of rows x cols */
+  unsigned char *lg;      /* lg[n] = floor(log2 n), for n = 1 .. max(rows, cols) */
+} RectIndex;
+
+static inline int rect_index_levels(int n) {
+  int l = 0;
+  while ((2L << l) <= n) l++;
+  return l + 1;
+}
+
+/* bytes rect_index_init() will allocate */
+static inline size_t rect_index_bytes(int rows, int cols) {
+  return (size_t) (rows + 1) * (cols + 1) * sizeof(long long) +
+         (size_t) rect_index_levels(rows) * rect_index_levels(cols) * rows * cols * sizeof(MinMax);
+}
+
+static inline void rect_index_init(RectIndex *ix, int rows, int cols) {
+  int n = (rows > cols) ? rows : cols, i;
+
+  ix->rows = rows;
+  ix->cols = cols;
+  ix->levelsR = rect_index_levels(rows);
+  ix->levelsC = rect_index_levels(cols);
+  ix->sat = malloc((size_t) (rows + 1) * (cols + 1) * sizeof(long long));
+  ix->sparse = malloc((size_t) ix->levelsR * ix->levelsC * rows * cols * sizeof(MinMax));
+  ix->lg = malloc(n + 1);
+  if (ix->sat == NULL || ix->sparse == NULL || ix->lg == NULL) {
+    fprintf(stderr, "Out of memory for the rectangle index (%zu bytes)\n", rect_index_bytes(rows, cols));
+    exit(1);
+  }
+  ix->lg[0] = 0;
+  ix->lg[1] = 0;
+  for (i = 2; i <= n; i++)
+    ix->lg[i] = ix->lg[i / 2] + 1;
+}
+
+static inline void rect_index_destroy(RectIndex *ix) {
+  free(ix->sat);
+  free(ix->sparse);
+  free(ix->lg);
+}
+
+static inline long long *rect_sat_row(const RectIndex *ix, int i) {
+  return ix->sat + (size_t) i * (ix->cols + 1);
+}
+
+static inline MinMax *rect_level(const RectIndex *ix, int kr, int kc) {
+  return ix->sparse + ((size_t) kr * ix->levelsC + kc) * ix->rows * ix->cols;
+}
+
+/* the strip of rows of worker id; like matrix_strip() in matrix_alloc.h */
+static inline void rect_strip(long id, int numWorkers, int rows, int *first, int *last) {
+  int stripSize = rows / numWorkers;
+  *first = id * stripSize;
+  *last = (id == numWorkers - 1) ? (rows - 1) : (*first + stripSize - 1);
+}
+
+/* build both indexes over m; every one of numWorkers workers calls this with
+   its id and the same barrier (for numWorkers threads). numWorkers must not
+   exceed rows. */
+static inline void rect_index_build(RectIndex *ix, const int *m, long id, int numWorkers,
+                                    ThreadBarrier *barrier) {
+  int rows = ix->rows, cols = ix->cols;
+  int first, last, i, j, s, kr, kc, c0, c1;
+
+  rect_strip(id, numWorkers, rows, &first, &last);
+
+  /* summed-area table, pass 1: local to the strip */
+  if (id == 0)
+    for (j = 0; j <= cols; j++)
+      rect_sat_row(ix, 0)[j] = 0;
+  for (i = first; i <= last; i++) {
+    long long *above = rect_sat_row(ix, i), *row = rect_sat_row(ix, i + 1), prefix = 0;
+    const int *mrow = m + (size_t) i * cols;
+    row[0] = 0;
+    for (j = 0; j < cols; j++) {
+      prefix += mrow[j];
+      row[j + 1] = prefix + ((i == first) ? 0 : above[j + 1]);
+    }
+  }
+  barrier_wait(barrier, id);
+
+  /* chain the strips' last rows, each worker over its own columns */
+  rect_strip(id, numWorkers, cols + 1, &c0, &c1);
+  for (s = 1; s < numWorkers; s++) {
+    int prevFirst, prevLast, sFirst, sLast;
+    long long *prevRow, *lastRow;
+    rect_strip(s - 1, numWorkers, rows, &prevFirst, &prevLast);
+    rect_strip(s, numWorkers, rows, &sFirst, &sLast);
+    prevRow = rect_sat_row(ix, prevLast + 1);
+    lastRow = rect_sat_row(ix, sLast + 1);
+    for (j = c0; j <= c1; j++)
+      lastRow[j] += prevRow[j];
+  }
+  barrier_wait(barrier, id);
+
+  /* pass 2: add the corrected last row of the previous strip */
+  if (id > 0) {
+    int prevFirst, prevLast;
+    long long *prevRow;
+    rect_strip(id - 1, numWorkers, rows, &prevFirst, &prevLast);
+    prevRow = rect_sat_row(ix, prevLast + 1);
+    for (i = first; i < last; i++) {
+      long long *row = rect_sat_row(ix, i + 1);
+      for (j = 1; j <= cols; j++)
+        row[j] += prevRow[j];
+    }
+  }
+
+  /* sparse table, levels (0, kc): row-local, so no barriers */
+  for (i = first; i <= last; i++) {
+    MinMax *row = rect_level(ix, 0, 0) + (size_t) i * cols;
+    const int *mrow = m + (size_t) i * cols;
+    for (j = 0; j < cols; j++)
+      row[j].min = row[j].max = mrow[j];
+    for (kc = 1; kc < ix->levelsC; kc++) {
+      const MinMax *prev = rect_level(ix, 0, kc - 1) + (size_t) i * cols;
+      MinMax *cur = rect_level(ix, 0, kc) + (size_t) i * cols;
+      int half = 1 << (kc - 1);
+      for (j = 0; j + (1 << kc) <= cols; j++) {
+        MinMax a = prev[j], b = prev[j + half];
+        cur[j].min = (b.min < a.min) ? b.min : a.min;
+        cur[j].max = (b.max > a.max) ? b.max : a.max;
+      }
+    }
+  }
+  barrier_wait(barrier, id);
+
+  /* levels (kr, kc) from (kr - 1, kc), the valid rows split among workers */
+  for (kr = 1; kr < ix->levelsR; kr++) {
+    int half = 1 << (kr - 1), valid = rows - (1 << kr) + 1, f, l;
+    rect_strip(id, numWorkers, valid, &f, &l);
+    for (kc = 0; kc < ix->levelsC; kc++) {
+      int width = cols - (1 << kc) + 1;
+      for (i = f; i <= l; i++) {
+        const MinMax *top = rect_level(ix, kr - 1, kc) + (size_t) i * cols;
+        const MinMax *bottom = rect_level(ix, kr - 1, kc) + (size_t) (i + half) * cols;
+        MinMax *cur = rect_level(ix, kr, kc) + (size_t) i * cols;
+        for (j = 0; j < width; j++) {
+          cur[j].min = (bottom[j].min < top[j].min) ? bottom[j].min : top[j].min;
+          cur[j].max = (bottom[j].max > top[j].max) ? bottom[j].max : top[j].max;
+        }
+      }
+    }
+    barrier_wait(barrier, id);
+  }
+}
+
+/* sum of rows r0..r1 and columns c0..c1 (inclusive) */
+static inline long long rect_index_sum(const RectIndex *ix, int r0, int c0, int r1, int c1) {
+  const long long *top = rect_sat_row(ix, r0), *bottom = rect_sat_row(ix, r1 + 1);
+  return bottom[c1 + 1] - bottom[c0] - top[c1 + 1] + top[c0];
+}
+
+/* min and max of rows r0..r1 and columns c0..c1 (inclusive) */
+static inline MinMax rect_index_minmax(const RectIndex *ix, int r0, int c0, int r1, int c1) {
+  int kr = ix->lg[r1 - r0 + 1], kc = ix->lg[c1 - c0 + 1];
+  int r2 = r1 - (1 << kr) + 1, c2 = c1 - (1 << kc) + 1;
+  const MinMax *level = rect_level(ix, kr, kc);
+  MinMax a = level[(size_t) r0 * ix->cols + c0], b = level[(size_t) r0 * ix->cols + c2];
+  MinMax c = level[(size_t) r2 * ix->cols + c0], d = level[(size_t) r2 * ix->cols + c2];
+  MinMax r;
+  r.min = (a.min < b.min) ? a.min : b.min;
+  if (c.min < r.min) r.min = c.min;
+  if (d.min < r.min) r.min = d.min;
+  r.max = (a.max > b.max) ? a.max : b.max;
+  if (c.max > r.max) r.max = c.max;
+  if (d.max > r.max) r.max = d.max;
+  return r;
+}
+
+#endif /* RECT_INDEX_H */
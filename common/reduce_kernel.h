@@ -0,0 +1,240 @@
+/* sum, min, and max (with positions) reduction kernel for the matrixSum programs
+
+   features: one pass over a matrix row computes the row sum, min, and max;
+             the first (row, col) position of a new min/max is recovered by a
+             scalar rescan of the (cache-hot) row, which only happens when the
+             row improves on the running value.
+             Scalar, SSE4.1, AVX2, and AVX-512 paths are compiled with
+             per-function target attributes and picked at runtime via cpuid,
+             so no -m flags are needed on the gcc command line.
+
+   usage:
+     #include "../../common/reduce_kernel.h"
+
+     Reduction r;
+     reduction_init(&r);
+     reduce_kernel_select("auto");   // or "scalar", "sse4.1", "avx2", "avx512"
+     for (i = first; i <= last; i++)
+       reduce_row(matrix[i], size, i, &r);
+
+*/
+#ifndef REDUCE_KERNEL_H
+#define REDUCE_KERNEL_H
+
+#include <stddef.h>
+#include <string.h>
+#include <limits.h> // For INT_MAX, INT_MIN
+
+#if defined(__x86_64__) || defined(__i386__)
+#define REDUCE_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+/* running sum, min, and max with the position of the first occurrence */
+typedef struct {
+  long long sum;
+  int min, minRow, minCol;
+  int max, maxRow, maxCol;
+} Reduction;
+
+static inline void reduction_init(Reduction *r) {
+  r->sum = 0;
+  r->min = INT_MAX; r->minRow = -1; r->minCol = -1;
+  r->max = INT_MIN; r->maxRow = -1; r->maxCol = -1;
+}
+
+/* true if (r1, c1) comes before (r2, c2) in row-major order; -1 means "none yet" */
+static inline int reduce_pos_before(int r1, int c1, int r2, int c2) {
+  if (r2 < 0) return 1;
+  return r1 < r2 || (r1 == r2 && c1 < c2);
+}
+
+/* merge a partial result into another; ties go to the earlier position */
+static inline void reduction_merge(Reduction *into, const Reduction *from) {
+  into->sum += from->sum;
+  if (from->minRow >= 0 &&
+      (from->min < into->min ||
+       (from->min == into->min &&
+        reduce_pos_before(from->minRow, from->minCol, into->minRow, into->minCol)))) {
+    into->min = from->min;
+    into->minRow = from->minRow;
+    into->minCol = from->minCol;
+  }
+  if (from->maxRow >= 0 &&
+      (from->max > into->max ||
+       (from->max == into->max &&
+        reduce_pos_before(from->maxRow, from->maxCol, into->maxRow, into->maxCol)))) {
+    into->max = from->max;
+    into->maxRow = from->maxRow;
+    into->maxCol = from->maxCol;
+  }
+}
+
+/* fold one row's sum/min/max into r, locating positions only if they are needed */
+static inline void reduce_row_finish(const int *row, int n, int rowIndex,
+                                     long long sum, int mn, int mx, Reduction *r) {
+  int j;
+  r->sum += sum;
+  if (n <= 0) return;
+  if (mn < r->min || r->minRow < 0 || (mn == r->min && rowIndex < r->minRow)) {
+    for (j = 0; row[j] != mn; j++)
+      ;
+    r->min = mn; r->minRow = rowIndex; r->minCol = j;
+  }
+  if (mx > r->max || r->maxRow < 0 || (mx == r->max && rowIndex < r->maxRow)) {
+    for (j = 0; row[j] != mx; j++)
+      ;
+    r->max = mx; r->maxRow = rowIndex; r->maxCol = j;
+  }
+}
+
+static inline void reduce_row_scalar(const int *row, int n, int rowIndex, Reduction *r) {
+  long long sum = 0;
+  int mn = INT_MAX, mx = INT_MIN;
+  int j;
+  for (j = 0; j < n; j++) {
+    int v = row[j];
+    sum += v;
+    mn = (v < mn) ? v : mn;
+    mx = (v > mx) ? v : mx;
+  }
+  reduce_row_finish(row, n, rowIndex, sum, mn, mx, r);
+}
+
+#ifdef REDUCE_KERNEL_X86
+
+__attribute__((target("sse4.1")))
+static inline void reduce_row_sse41(const int *row, int n, int rowIndex, Reduction *r) {
+  __m128i vsum = _mm_setzero_si128();
+  __m128i vmin = _mm_set1_epi32(INT_MAX), vmax = _mm_set1_epi32(INT_MIN);
+  long long sum;
+  int mn, mx, k, j = 0;
+  int lanes[4];
+  long long sums[2];
+
+  for (; j + 4 <= n; j += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *) (row + j));
+    vmin = _mm_min_epi32(vmin, v);
+    vmax = _mm_max_epi32(vmax, v);
+    vsum = _mm_add_epi64(vsum, _mm_cvtepi32_epi64(v));
+    vsum = _mm_add_epi64(vsum, _mm_cvtepi32_epi64(_mm_unpackhi_epi64(v, v)));
+  }
+  _mm_storeu_si128((__m128i *) sums, vsum);
+  sum = sums[0] + sums[1];
+  _mm_storeu_si128((__m128i *) lanes, vmin);
+  mn = lanes[0];
+  for (k = 1; k < 4; k++) if (lanes[k] < mn) mn = lanes[k];
+  _mm_storeu_si128((__m128i *) lanes, vmax);
+  mx = lanes[0];
+  for (k = 1; k < 4; k++) if (lanes[k] > mx) mx = lanes[k];
+  for (; j < n; j++) {
+    sum += row[j];
+    if (row[j] < mn) mn = row[j];
+    if (row[j] > mx) mx = row[j];
+  }
+  reduce_row_finish(row, n, rowIndex, sum, mn, mx, r);
+}
+
+__attribute__((target("avx2")))
+static inline void reduce_row_avx2(const int *row, int n, int rowIndex, Reduction *r) {
+  __m256i vsum0 = _mm256_setzero_si256(), vsum1 = _mm256_setzero_si256();
+  __m256i vmin = _mm256_set1_epi32(INT_MAX), vmax = _mm256_set1_epi32(INT_MIN);
+  long long sum;
+  int mn, mx, k, j = 0;
+  int lanes[8];
+  long long sums[4];
+
+  for (; j + 8 <= n; j += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *) (row + j));
+    vmin = _mm256_min_epi32(vmin, v);
+    vmax = _mm256_max_epi32(vmax, v);
+    vsum0 = _mm256_add_epi64(vsum0, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v)));
+    vsum1 = _mm256_add_epi64(vsum1, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1)));
+  }
+  _mm256_storeu_si256((__m256i *) sums, _mm256_add_epi64(vsum0, vsum1));
+  sum = sums[0] + sums[1] + sums[2] + sums[3];
+  _mm256_storeu_si256((__m256i *) lanes, vmin);
+  mn = lanes[0];
+  for (k = 1; k < 8; k++) if (lanes[k] < mn) mn = lanes[k];
+  _mm256_storeu_si256((__m256i *) lanes, vmax);
+  mx = lanes[0];
+  for (k = 1; k < 8; k++) if (lanes[k] > mx) mx = lanes[k];
+  for (; j < n; j++) {
+    sum += row[j];
+    if (row[j] < mn) mn = row[j];
+    if (row[j] > mx) mx = row[j];
+  }
+  reduce_row_finish(row, n, rowIndex, sum, mn, mx, r);
+}
+
+__attribute__((target("avx512f")))
+static inline void reduce_row_avx512(const int *row, int n, int rowIndex, Reduction *r) {
+  __m512i vsum0 = _mm512_setzero_si512(), vsum1 = _mm512_setzero_si512();
+  __m512i vmin = _mm512_set1_epi32(INT_MAX), vmax = _mm512_set1_epi32(INT_MIN);
+  long long sum;
+  int mn, mx, j = 0;
+
+  for (; j + 16 <= n; j += 16) {
+    __m512i v = _mm512_loadu_si512((const void *) (row + j));
+    vmin = _mm512_min_epi32(vmin, v);
+    vmax = _mm512_max_epi32(vmax, v);
+    vsum0 = _mm512_add_epi64(vsum0, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)));
+    vsum1 = _mm512_add_epi64(vsum1, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+  }
+  if (j < n) { /* masked tail: inactive lanes load the identity of each operation */
+    __mmask16 m = (__mmask16) ((1u << (n - j)) - 1);
+    __m512i v = _mm512_maskz_loadu_epi32(m, row + j);
+    vmin = _mm512_min_epi32(vmin, _mm512_mask_loadu_epi32(_mm512_set1_epi32(INT_MAX), m, row + j));
+    vmax = _mm512_max_epi32(vmax, _mm512_mask_loadu_epi32(_mm512_set1_epi32(INT_MIN), m, row + j));
+    vsum0 = _mm512_add_epi64(vsum0, _mm512_cvtepi32_epi64(_mm512_castsi512_si256(v)));
+    vsum1 = _mm512_add_epi64(vsum1, _mm512_cvtepi32_epi64(_mm512_extracti64x4_epi64(v, 1)));
+  }
+  sum = _mm512_reduce_add_epi64(_mm512_add_epi64(vsum0, vsum1));
+  mn = _mm512_reduce_min_epi32(vmin);
+  mx = _mm512_reduce_max_epi32(vmax);
+  reduce_row_finish(row, n, rowIndex, sum, mn, mx, r);
+}
+
+#endif /* REDUCE_KERNEL_X86 */
+
+typedef void (*ReduceRowFn)(const int *row, int n, int rowIndex, Reduction *r);
+
+/* the kernel in use; reduce_kernel_select() replaces it */
+static ReduceRowFn reduce_row = reduce_row_scalar;
+static const char *reduce_kernel_name = "scalar";
+
+static inline int reduce_kernel_supported(const char *name) {
+  if (strcmp(name, "scalar") == 0) return 1;
+#ifdef REDUCE_KERNEL_X86
+  __builtin_cpu_init();
+  if (strcmp(name, "sse4.1") == 0) return __builtin_cpu_supports("sse4.1");
+  if (strcmp(name, "avx2") == 0) return __builtin_cpu_supports("avx2");
+  if (strcmp(name, "avx512") == 0) return __builtin_cpu_supports("avx512f");
+#endif
+  return 0;
+}
+
+/* select a kernel by name ("auto" picks the widest supported one);
+   returns the name of the selected kernel, or NULL if it is unknown or
+   not supported by this CPU (the current kernel is then left unchanged) */
+static inline const char *reduce_kernel_select(const char *name) {
+  static const char *widest[] = { "avx512", "avx2", "sse4.1", "scalar" };
+  int k;
+
+  if (name == NULL || strcmp(name, "auto") == 0) {
+    for (k = 0; !reduce_kernel_supported(widest[k]); k++)
+      ;
+    name = widest[k];
+  }
+  if (!reduce_kernel_supported(name)) return NULL;
+
+  if (strcmp(name, "scalar") == 0) { reduce_row = reduce_row_scalar; reduce_kernel_name = "scalar"; }
+#ifdef REDUCE_KERNEL_X86
+  else if (strcmp(name, "sse4.1") == 0) { reduce_row = reduce_row_sse41; reduce_kernel_name = "sse4.1"; }
+  else if (strcmp(name, "avx2") == 0) { reduce_row = reduce_row_avx2; reduce_kernel_name = "avx2"; }
+  else if (strcmp(name, "avx512") == 0) { reduce_row = reduce_row_avx512; reduce_kernel_name = "avx512"; }
+#endif
+  return reduce_kernel_name;
+}
+
+#endif /* REDUCE_KERNEL_H */
@@ -0,0 +1,216 @@
+/* incremental sum, min, and max of a changing matrix
+
+   features: a two-level summary tree over a row-major int matrix. Each row
+             is cut into blocks of `block` columns; a segment tree per row
+             combines the block summaries into a row summary, and a segment
+             tree over the rows combines the row summaries into the global
+             one. Every node is a Reduction (sum, min, max and positions), so
+             the answer is always at the root of the row tree.
+             Changing one element costs O(block) to re-reduce its block plus
+             O(log(cols/block) + log rows) node merges, instead of a pass over
+             the whole matrix.
+             A batch of updates is applied in two steps so it can run in
+             parallel: summary_tree_update_rows() applies the updates of a
+             range of rows (each worker owns a strip, so nobody else writes
+             those rows' elements and trees) and reports which rows changed;
+             summary_tree_propagate() then refreshes the row tree above those
+             rows once, even if several updates hit the same node.
+             Within a batch, later updates of the same element win.
+
+   usage:
+     #include "../../common/summary_tree.h"
+
+     SummaryTree t;
+     summary_tree_init(&t, m, rows, cols, 256);
+     summary_tree_build_rows(&t, first, last);   // in parallel over strips
+     summary_tree_build_top(&t);
+     ... summary_tree_result(&t)->sum ...
+
+     n = summary_tree_update_rows(&t, updates, count, first, last, dirty);
+     summary_tree_propagate(&t, dirty, n);       // after all strips are done
+
+*/
+#ifndef SUMMARY_TREE_H
+#define SUMMARY_TREE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "reduce_kernel.h"
+
+/* set element (row, col) to value */
+typedef struct {
+  int row, col, value;
+} MatrixUpdate;
+
+typedef struct {
+  int *m;
+  int rows, cols, block;
+  int blocksPerRow;
+  int rowLeaves;          /* leaves per row tree: blocksPerRow rounded up to a power of two */
+  int topLeaves;          /* leaves of the tree over rows: rows rounded up likewise */
+  Reduction *rowNodes;    /* row i's tree is rowNodes[i * 2 * rowLeaves ...], root at index 1 */
+  Reduction *topNodes;    /* root at index 1, row i at topLeaves + i */
+  unsigned *blockStamp;   /* batch that last re-reduced a block */
+  unsigned *rowStamp;     /* batch that last marked a row dirty */
+  unsigned *topStamp;     /* batch that last refreshed a top node */
+  unsigned rowEpoch;      /* the batch being applied; stamps compare against it */
+} SummaryTree;
+
+static inline int summary_tree_pow2(int n) {
+  int p = 1;
+  while (p < n) p *= 2;
+  return p;
+}
+
+static inline void *summary_tree_calloc(size_t count, size_t size) {
+  void *p = calloc(count, size);
+  if (p == NULL) {
+    fprintf(stderr, "Out of memory for the summary tree\n");
+    exit(1);
+  }
+  return p;
+}
+
+static inline void summary_tree_init(SummaryTree *t, int *m, int rows, int cols, int block) {
+  t->m = m;
+  t->rows = rows;
+  t->cols = cols;
+  t->block = (block > 0) ? block : 1;
+  t->blocksPerRow = (cols + t->block - 1) / t->block;
+  t->rowLeaves = summary_tree_pow2(t->blocksPerRow);
+  t->topLeaves = summary_tree_pow2(rows);
+  t->rowNodes = summary_tree_calloc((size_t) rows * 2 * t->rowLeaves, sizeof(Reduction));
+  t->topNodes = summary_tree_calloc((size_t) 2 * t->topLeaves, sizeof(Reduction));
+  t->blockStamp = summary_tree_calloc((size_t) rows * t->blocksPerRow, sizeof(unsigned));
+  t->rowStamp = summary_tree_calloc(rows, sizeof(unsigned));
+  t->topStamp = summary_tree_calloc((size_t) 2 * t->topLeaves, sizeof(unsigned));
+  t->rowEpoch = 0;
+}
+
+static inline void summary_tree_destroy(SummaryTree *t) {
+  free(t->rowNodes);
+  free(t->topNodes);
+  free(t->blockStamp);
+  free(t->rowStamp);
+  free(t->topStamp);
+}
+
+/* node = left child merged with right child */
+static inline void summary_tree_combine(Reduction *nodes, int node) {
+  Reduction r;
+  reduction_init(&r);
+  reduction_merge(&r, &nodes[2 * node]);
+  reduction_merge(&r, &nodes[2 * node + 1]);
+  nodes[node] = r;
+}
+
+/* re-reduce block b of row i into its leaf */
+static inline void summary_tree_reduce_block(SummaryTree *t, int i, int b) {
+  Reduction *leaf = &t->rowNodes[(size_t) i * 2 * t->rowLeaves + t->rowLeaves + b];
+  int first = b * t->block;
+  int n = (t->cols - first < t->block) ? t->cols - first : t->block;
+
+  reduction_init(leaf);
+  reduce_row(t->m + (size_t) i * t->cols + first, n, i, leaf);
+  leaf->minCol += first; /* reduce_row counts columns from the block start */
+  leaf->maxCol += first;
+}
+
+/* the summary of the whole matrix */
+static inline const Reduction *summary_tree_result(const SummaryTree *t) {
+  return &t->topNodes[1];
+}
+
+/* the summary of row i */
+static inline const Reduction *summary_tree_row(const SummaryTree *t, int i) {
+  return &t->rowNodes[(size_t) i * 2 * t->rowLeaves + 1];
+}
+
+/* build the trees of rows first..last (inclusive) and their top leaves */
+static inline void summary_tree_build_rows(SummaryTree *t, int first, int last) {
+  int i, b, node;
+
+  for (i = first; i <= last; i++) {
+    Reduction *nodes = &t->rowNodes[(size_t) i * 2 * t->rowLeaves];
+    for (b = 0; b < t->blocksPerRow; b++)
+      summary_tree_reduce_block(t, i, b);
+    for (b = t->blocksPerRow; b < t->rowLeaves; b++)
+      reduction_init(&nodes[t->rowLeaves + b]);
+    for (node = t->rowLeaves - 1; node >= 1; node--)
+      summary_tree_combine(nodes, node);
+    t->topNodes[t->topLeaves + i] = nodes[1];
+  }
+}
+
+/* build the tree over rows, after all rows are built */
+static inline void summary_tree_build_top(SummaryTree *t) {
+  int i;
+  for (i = t->rows; i < t->topLeaves; i++)
+    reduction_init(&t->topNodes[t->topLeaves + i]);
+  for (i = t->topLeaves - 1; i >= 1; i--)
+    summary_tree_combine(t->topNodes, i);
+}
+
+/* start a new batch; call once, before any summary_tree_update_rows() of it */
+static inline void summary_tree_begin_batch(SummaryTree *t) {
+  t->rowEpoch++;
+}
+
+/* apply, in order, the updates that fall in rows first..last; re-reduce each
+   touched block once and refresh its row tree; write the changed rows to
+   dirty (in no particular order) and return how many there are */
+static inline int summary_tree_update_rows(SummaryTree *t, const MatrixUpdate *updates, int count,
+                                           int first, int last, int *dirty) {
+  unsigned epoch = t->rowEpoch;
+  int k, numDirty = 0;
+
+  /* writes first, so a block is re-reduced after all of its updates */
+  for (k = 0; k < count; k++)
+    if (updates[k].row >= first && updates[k].row <= last)
+      t->m[(size_t) updates[k].row * t->cols + updates[k].col] = updates[k].value;
+
+  for (k = 0; k < count; k++) {
+    int i = updates[k].row, b, node;
+    unsigned *stamp;
+    Reduction *nodes;
+    if (i < first || i > last) continue;
+    b = updates[k].col / t->block;
+    stamp = &t->blockStamp[(size_t) i * t->blocksPerRow + b];
+    if (*stamp == epoch) continue;
+    *stamp = epoch;
+
+    summary_tree_reduce_block(t, i, b);
+    nodes = &t->rowNodes[(size_t) i * 2 * t->rowLeaves];
+    for (node = (t->rowLeaves + b) / 2; node >= 1; node /= 2)
+      summary_tree_combine(nodes, node);
+    t->topNodes[t->topLeaves + i] = nodes[1];
+    if (t->rowStamp[i] != epoch) {
+      t->rowStamp[i] = epoch;
+      dirty[numDirty++] = i;
+    }
+  }
+  return numDirty;
+}
+
+/* refresh the tree over rows above the dirty rows, one level at a time so
+   each node is recombined once; dirty is overwritten */
+static inline void summary_tree_propagate(SummaryTree *t, int *dirty, int numDirty) {
+  unsigned epoch = t->rowEpoch;
+  int k, n;
+
+  for (k = 0; k < numDirty; k++)
+    dirty[k] += t->topLeaves;
+  while (numDirty > 0 && dirty[0] > 1) {
+    for (k = 0, n = 0; k < numDirty; k++) {
+      int parent = dirty[k] / 2;
+      if (t->topStamp[parent] != epoch) {
+        t->topStamp[parent] = epoch;
+        summary_tree_combine(t->topNodes, parent);
+        dirty[n++] = parent;
+      }
+    }
+    numDirty = n;
+  }
+}
+
+#endif /* SUMMARY_TREE_H */
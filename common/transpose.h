@@ -0,0 +1,56 @@
+/* cache-oblivious matrix transpose
+
+   features: dst = transpose of src for row-major int matrices, by
+             recursively halving the longer side of the block until it fits
+             in TRANSPOSE_LEAF x TRANSPOSE_LEAF, so that at some level of the
+             recursion both the rows read from src and the rows written to
+             dst fit in each level of the cache, whatever its size.
+             Naively, one of the two walks strides a whole row per element.
+             transpose_rows() transposes a strip of rows of src (all columns),
+             so workers transpose disjoint strips in parallel and write
+             disjoint column ranges of dst.
+
+   usage:
+     #include "../../common/transpose.h"
+
+     transpose_rows(src, rows, cols, dst, first, last);  // rows first..last of src
+     // dst is cols x rows: dst[j * rows + i] == src[i * cols + j]
+
+*/
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include <stddef.h>
+
+#define TRANSPOSE_LEAF 16 /* a leaf block: 16 x 16 ints, 1 KB each side */
+
+/* transpose the block rows r0..r1-1, columns c0..c1-1 of src (row stride
+   lds) into dst (row stride ldd) */
+static inline void transpose_block(const int *src, size_t lds, int *dst, size_t ldd,
+                                   int r0, int r1, int c0, int c1) {
+  int i, j;
+
+  while (r1 - r0 > TRANSPOSE_LEAF || c1 - c0 > TRANSPOSE_LEAF) {
+    if (r1 - r0 >= c1 - c0) {
+      int mid = r0 + (r1 - r0) / 2;
+      transpose_block(src, lds, dst, ldd, r0, mid, c0, c1);
+      r0 = mid;
+    } else {
+      int mid = c0 + (c1 - c0) / 2;
+      transpose_block(src, lds, dst, ldd, r0, r1, c0, mid);
+      c0 = mid;
+    }
+  }
+  for (j = c0; j < c1; j++)
+    for (i = r0; i < r1; i++)
+      dst[(size_t) j * ldd + i] = src[(size_t) i * lds + j];
+}
+
+/* transpose rows first..last (inclusive) of the rows x cols src into the
+   cols x rows dst */
+static inline void transpose_rows(const int *src, int rows, int cols, int *dst, int first, int last) {
+  if (first <= last)
+    transpose_block(src, cols, dst, rows, first, last + 1, 0, cols);
+}
+
+#endif /* TRANSPOSE_H */
@@ -0,0 +1,258 @@
+/* sum, min, and max reduction kernels for every element type in elem_type.h
+
+   features: one kernel per element type, generated by TYPED_ROW_KERNEL from
+             the MATRIX_ELEM_TYPES list and picked at load time with
+             typed_row_kernel(type). A row is reduced in blocks: within a
+             block the sum goes into the narrowest accumulator that cannot
+             overflow (int32 for int8/int16, double for float), and only the
+             block sum is widened into the 64-bit running sum. The inner
+             loop runs over fixed-size chunks so gcc vectorizes it at -O2,
+             and each kernel is compiled twice, for the baseline ISA and
+             with target("avx2"), chosen at runtime via cpuid.
+             As in reduce_kernel.h, the position of a new min/max is found by
+             rescanning the (cache-hot) block only when it improves on the
+             running value. Integer results are kept as long long, floating-
+             point ones as double.
+             NaN: min and max skip NaN elements (each block starts from
+             +/-infinity, and every comparison with NaN is false), while the
+             sum takes them in and becomes NaN. The NaN elements are counted
+             (only in a block whose sum came out NaN, so the loop is not
+             slowed down) and the count is printed with the result.
+
+   usage:
+     #include "../../common/typed_kernel.h"
+
+     TypedRowFn row = typed_row_kernel(MATRIX_ELEM_INT8, "auto");
+     TypedReduction r;
+     typed_reduction_init(&r, MATRIX_ELEM_INT8);
+     for (i = first; i <= last; i++)
+       row((const int8_t *) m + (size_t) i * cols, cols, i, &r);
+
+*/
+#ifndef TYPED_KERNEL_H
+#define TYPED_KERNEL_H
+
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "elem_type.h"
+#include "reduce_kernel.h"
+
+#define TYPED_CHUNK 64 /* elements per vectorized inner loop; divides every block */
+
+/* an element value: .i for the integer types, .f for float and double */
+typedef union {
+  long long i;
+  double f;
+} ElemValue;
+
+/* running sum, min, and max of one element type, with the position of the
+   first occurrence */
+typedef struct {
+  uint32_t type;
+  ElemValue sum, min, max;
+  int minRow, minCol;
+  int maxRow, maxCol;
+  long long nans;  /* NaN elements, skipped by min and max */
+} TypedReduction;
+
+typedef void (*TypedRowFn)(const void *row, int n, int rowIndex, TypedReduction *r);
+
+/* the member of an ElemValue that holds values of C type T */
+#define TYPED_VALUE(T, v) (*_Generic((T) 0, float: &(v).f, double: &(v).f, default: &(v).i))
+
+/* the largest and smallest value of C type T, infinite for float and double */
+#define TYPED_HIGHEST(T)                                                      \
+  _Generic((T) 0, float: INFINITY, double: INFINITY, int8_t: INT8_MAX, uint8_t: UINT8_MAX, \
+           int16_t: INT16_MAX, int32_t: INT32_MAX, int64_t: INT64_MAX)
+#define TYPED_LOWEST(T)                                                       \
+  _Generic((T) 0, float: -INFINITY, double: -INFINITY, int8_t: INT8_MIN, uint8_t: 0, \
+           int16_t: INT16_MIN, int32_t: INT32_MIN, int64_t: INT64_MIN)
+
+static inline void typed_reduction_init(TypedReduction *r, uint32_t type) {
+  r->type = type;
+  if (matrix_elem_is_float(type)) {
+    r->sum.f = 0; r->min.f = INFINITY; r->max.f = -INFINITY;
+  } else {
+    r->sum.i = 0; r->min.i = LLONG_MAX; r->max.i = LLONG_MIN;
+  }
+  r->minRow = r->minCol = -1;
+  r->maxRow = r->maxCol = -1;
+  r->nans = 0;
+}
+
+/* the int32 result of reduce_row as a TypedReduction */
+static inline void typed_reduction_from(TypedReduction *t, const Reduction *r) {
+  t->type = MATRIX_ELEM_INT32;
+  t->sum.i = r->sum;
+  t->min.i = (r->minRow >= 0) ? r->min : LLONG_MAX;
+  t->max.i = (r->maxRow >= 0) ? r->max : LLONG_MIN;
+  t->minRow = r->minRow; t->minCol = r->minCol;
+  t->maxRow = r->maxRow; t->maxCol = r->maxCol;
+  t->nans = 0;
+}
+
+/* a < b, for values of the reduction's type */
+static inline int typed_less(const TypedReduction *r, ElemValue a, ElemValue b) {
+  return matrix_elem_is_float(r->type) ? a.f < b.f : a.i < b.i;
+}
+
+static inline int typed_equal(const TypedReduction *r, ElemValue a, ElemValue b) {
+  return matrix_elem_is_float(r->type) ? a.f == b.f : a.i == b.i;
+}
+
+/* merge a partial result into another of the same type; ties go to the
+   earlier position */
+static inline void typed_reduction_merge(TypedReduction *into, const TypedReduction *from) {
+  if (matrix_elem_is_float(into->type))
+    into->sum.f += from->sum.f;
+  else
+    into->sum.i += from->sum.i;
+  into->nans += from->nans;
+  if (from->minRow >= 0 &&
+      (into->minRow < 0 || typed_less(into, from->min, into->min) ||
+       (typed_equal(into, from->min, into->min) &&
+        reduce_pos_before(from->minRow, from->minCol, into->minRow, into->minCol)))) {
+    into->min = from->min;
+    into->minRow = from->minRow;
+    into->minCol = from->minCol;
+  }
+  if (from->maxRow >= 0 &&
+      (into->maxRow < 0 || typed_less(into, into->max, from->max) ||
+       (typed_equal(into, from->max, into->max) &&
+        reduce_pos_before(from->maxRow, from->maxCol, into->maxRow, into->maxCol)))) {
+    into->max = from->max;
+    into->maxRow = from->maxRow;
+    into->maxCol = from->maxCol;
+  }
+}
+
+/* print the result the way the matrixSum programs do */
+static inline void typed_reduction_print(const TypedReduction *r) {
+  if (matrix_elem_is_float(r->type)) {
+    printf("The total sum is %.15g\n", r->sum.f);
+    if (r->minRow < 0) {
+      printf("There is no minimum or maximum element: all elements are NaN\n");
+    } else {
+      printf("The minimum element is %.15g at (%d, %d)\n", r->min.f, r->minRow, r->minCol);
+      printf("The maximum element is %.15g at (%d, %d)\n", r->max.f, r->maxRow, r->maxCol);
+    }
+    if (r->nans > 0)
+      printf("NaN elements: %lld (skipped by the minimum and maximum)\n", r->nans);
+  } else {
+    printf("The total sum is %lld\n", r->sum.i);
+    printf("The minimum element is %lld at (%d, %d)\n", r->min.i, r->minRow, r->minCol);
+    printf("The maximum element is %lld at (%d, %d)\n", r->max.i, r->maxRow, r->maxCol);
+  }
+}
+
+/* Reduce row[0..n) of type T into r, one block of BLOCK elements at a time.
+   LANES independent sums, mins, and maxs per chunk let gcc vectorize the
+   floating-point types without reassociating a single sum. */
+#define TYPED_ROW_BODY(T, ACC, BLOCK, LANES)                                        \
+  const T *x = row;                                                                 \
+  long b;                                                                           \
+  for (b = 0; b < n; b += (BLOCK)) {                                                \
+    long end = (n - b < (BLOCK)) ? n : b + (BLOCK), j, k;                           \
+    ACC s[LANES], sum = 0;                                                          \
+    T mn[LANES], mx[LANES], bmn, bmx;                                               \
+    int l;                                                                          \
+    for (l = 0; l < LANES; l++) {                                                   \
+      s[l] = 0;                                                                     \
+      mn[l] = TYPED_HIGHEST(T);                                                     \
+      mx[l] = TYPED_LOWEST(T);                                                      \
+    }                                                                               \
+    for (j = b; j + TYPED_CHUNK <= end; j += TYPED_CHUNK)                           \
+      for (k = 0; k < TYPED_CHUNK; k += LANES)                                      \
+        for (l = 0; l < LANES; l++) {                                               \
+          T v = x[j + k + l];                                                       \
+          s[l] += v;                                                                \
+          mn[l] = (v < mn[l]) ? v : mn[l];                                          \
+          mx[l] = (v > mx[l]) ? v : mx[l];                                          \
+        }                                                                           \
+    bmn = mn[0]; bmx = mx[0];                                                       \
+    for (l = 0; l < LANES; l++) {                                                   \
+      sum += s[l];                                                                  \
+      bmn = (mn[l] < bmn) ? mn[l] : bmn;                                            \
+      bmx = (mx[l] > bmx) ? mx[l] : bmx;                                            \
+    }                                                                               \
+    for (; j < end; j++) {                                                          \
+      sum += x[j];                                                                  \
+      bmn = (x[j] < bmn) ? x[j] : bmn;                                              \
+      bmx = (x[j] > bmx) ? x[j] : bmx;                                              \
+    }                                                                               \
+    TYPED_VALUE(T, r->sum) += sum;                                                  \
+    if (sum != sum) /* NaN: only float and double get here */                       \
+      for (j = b; j < end; j++)                                                     \
+        r->nans += (x[j] != x[j]);                                                  \
+    /* an all-NaN block leaves the seeds, which the rescan does not find */        \
+    if (r->minRow < 0 || bmn < TYPED_VALUE(T, r->min) ||                            \
+        (bmn == TYPED_VALUE(T, r->min) && rowIndex < r->minRow)) {                  \
+      for (j = b; j < end && x[j] != bmn; j++)                                      \
+        ;                                                                           \
+      if (j < end) {                                                                \
+        TYPED_VALUE(T, r->min) = bmn; r->minRow = rowIndex; r->minCol = (int) j;    \
+      }                                                                             \
+    }                                                                               \
+    if (r->maxRow < 0 || bmx > TYPED_VALUE(T, r->max) ||                            \
+        (bmx == TYPED_VALUE(T, r->max) && rowIndex < r->maxRow)) {                  \
+      for (j = b; j < end && x[j] != bmx; j++)                                      \
+        ;                                                                           \
+      if (j < end) {                                                                \
+        TYPED_VALUE(T, r->max) = bmx; r->maxRow = rowIndex; r->maxCol = (int) j;    \
+      }                                                                             \
+    }                                                                               \
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TYPED_ROW_AVX2(name, T, ACC, BLOCK, LANES)                                  \
+__attribute__((target("avx2")))                                                     \
+static inline void typed_row_##name##_avx2(const void *row, int n, int rowIndex,    \
+                                           TypedReduction *r) {                     \
+  TYPED_ROW_BODY(T, ACC, BLOCK, LANES)                                              \
+}
+#else
+#define TYPED_ROW_AVX2(name, T, ACC, BLOCK, LANES)
+#endif
+
+#define TYPED_ROW_KERNEL(ID, code, name, T, ACC, BLOCK, LANES)                      \
+static inline void typed_row_##name(const void *row, int n, int rowIndex,           \
+                                    TypedReduction *r) {                            \
+  TYPED_ROW_BODY(T, ACC, BLOCK, LANES)                                              \
+}                                                                                   \
+TYPED_ROW_AVX2(name, T, ACC, BLOCK, LANES)
+
+MATRIX_ELEM_TYPES(TYPED_ROW_KERNEL)
+
+/* true if typed_row_kernel() picks the AVX2 builds: kernelName is as for
+   reduce_kernel_select(), "scalar" and "sse4.1" get the baseline build,
+   "auto", "avx2", and "avx512" the AVX2 one if the CPU has AVX2 */
+static inline bool typed_kernel_avx2(const char *kernelName) {
+#if defined(__x86_64__) || defined(__i386__)
+  return strcmp(kernelName, "scalar") != 0 && strcmp(kernelName, "sse4.1") != 0 &&
+         __builtin_cpu_supports("avx2");
+#else
+  (void) kernelName;
+  return false;
+#endif
+}
+
+/* the kernel for an element type, NULL if unknown */
+static inline TypedRowFn typed_row_kernel(uint32_t type, const char *kernelName) {
+  bool avx2 = typed_kernel_avx2(kernelName);
+  switch (type) {
+#if defined(__x86_64__) || defined(__i386__)
+#define TYPED_ROW_CASE(ID, code, name, T, ACC, BLOCK, LANES) \
+  case code: return avx2 ? typed_row_##name##_avx2 : typed_row_##name;
+#else
+#define TYPED_ROW_CASE(ID, code, name, T, ACC, BLOCK, LANES) \
+  case code: (void) avx2; return typed_row_##name;
+#endif
+  MATRIX_ELEM_TYPES(TYPED_ROW_CASE)
+#undef TYPED_ROW_CASE
+  }
+  return NULL;
+}
+
+#endif /* TYPED_KERNEL_H */
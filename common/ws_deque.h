@@ -0,0 +1,137 @@
+/* Chase-Lev work-stealing deque
+
+   features: the owning thread pushes and takes tasks at the bottom (LIFO),
+             other threads steal from the top (FIFO). Only a take of the
+             last task and steals synchronize with compare-and-swap; the
+             memory orders follow Le et al., "Correct and Efficient
+             Work-Stealing for Weak Memory Models" (PPoPP 2013).
+             The buffer doubles when full; retired buffers are kept until
+             ws_deque_destroy() because a thief may still be reading one.
+             Tasks are opaque non-NULL pointers.
+
+   usage:
+     #include "../../common/ws_deque.h"
+
+     WsDeque q;
+     ws_deque_init(&q, 64);
+     ws_deque_push(&q, task);          // owner only
+     task = ws_deque_take(&q);         // owner only, NULL if empty
+     task = ws_deque_steal(&q);        // any thread, NULL if empty or lost a race
+     ws_deque_destroy(&q);
+
+*/
+#ifndef WS_DEQUE_H
+#define WS_DEQUE_H
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+typedef struct WsArray {
+  long capacity;              /* a power of two */
+  struct WsArray *retired;    /* the buffer this one replaced */
+  _Atomic(void *) tasks[];
+} WsArray;
+
+typedef struct {
+  atomic_long top, bottom;
+  _Atomic(WsArray *) array;
+} WsDeque;
+
+static inline WsArray *ws_array_new(long capacity, WsArray *retired) {
+  WsArray *a = malloc(sizeof(WsArray) + capacity * sizeof(_Atomic(void *)));
+  if (a == NULL) {
+    fprintf(stderr, "Out of memory for the work-stealing deque\n");
+    exit(1);
+  }
+  a->capacity = capacity;
+  a->retired = retired;
+  return a;
+}
+
+/* capacity is rounded up to a power of two */
+static inline void ws_deque_init(WsDeque *q, long capacity) {
+  long c = 1;
+  while (c < capacity) c *= 2;
+  atomic_init(&q->top, 0);
+  atomic_init(&q->bottom, 0);
+  atomic_init(&q->array, ws_array_new(c, NULL));
+}
+
+static inline void ws_deque_destroy(WsDeque *q) {
+  WsArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+  while (a != NULL) {
+    WsArray *next = a->retired;
+    free(a);
+    a = next;
+  }
+}
+
+/* owner only: copy the live tasks [t, b) into a buffer twice as large */
+static inline WsArray *ws_deque_grow(WsDeque *q, WsArray *a, long t, long b) {
+  WsArray *bigger = ws_array_new(2 * a->capacity, a);
+  long i;
+  for (i = t; i < b; i++)
+    atomic_store_explicit(&bigger->tasks[i & (bigger->capacity - 1)],
+                          atomic_load_explicit(&a->tasks[i & (a->capacity - 1)], memory_order_relaxed),
+                          memory_order_relaxed);
+  atomic_store_explicit(&q->array, bigger, memory_order_release);
+  return bigger;
+}
+
+/* owner only */
+static inline void ws_deque_push(WsDeque *q, void *task) {
+  long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+  long t = atomic_load_explicit(&q->top, memory_order_acquire);
+  WsArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+  if (b - t > a->capacity - 1)
+    a = ws_deque_grow(q, a, t, b);
+  atomic_store_explicit(&a->tasks[b & (a->capacity - 1)], task, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+}
+
+/* owner only: the most recently pushed task, or NULL if the deque is empty */
+static inline void *ws_deque_take(WsDeque *q) {
+  long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+  WsArray *a = atomic_load_explicit(&q->array, memory_order_relaxed);
+  long t;
+  void *task = NULL;
+
+  atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  t = atomic_load_explicit(&q->top, memory_order_relaxed);
+  if (t <= b) {
+    task = atomic_load_explicit(&a->tasks[b & (a->capacity - 1)], memory_order_relaxed);
+    if (t == b) { /* the last task: race the thieves for it */
+      if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                   memory_order_seq_cst, memory_order_relaxed))
+        task = NULL;
+      atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+  } else { /* empty */
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+  }
+  return task;
+}
+
+/* any thread: the oldest task, or NULL if the deque is empty or another
+   thread won the race for it */
+static inline void *ws_deque_steal(WsDeque *q) {
+  long t = atomic_load_explicit(&q->top, memory_order_acquire);
+  long b;
+  void *task = NULL;
+
+  atomic_thread_fence(memory_order_seq_cst);
+  b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+  if (t < b) {
+    WsArray *a = atomic_load_explicit(&q->array, memory_order_acquire);
+    task = atomic_load_explicit(&a->tasks[t & (a->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed))
+      return NULL;
+  }
+  return task;
+}
+
+#endif /* WS_DEQUE_H */